@@ -41,6 +41,8 @@ const char* attr_name(AttrTag t)
 		"&is_assigned",
 		"&is_used",
 		"&ordered",
+		"&max_size",
+		"&eviction",
 	};
 
 	return attr_names[int(t)];
@@ -202,6 +204,11 @@ Attributes::Attributes(std::vector<AttrPtr> a, TypePtr t, bool arg_in_record, bo
 
 	for ( auto& attr : a )
 		AddAttr(std::move(attr));
+
+	// CheckAttr() only sees the attributes preceding the one it checks,
+	// so this one needs to wait until we have all of them.
+	if ( Find(ATTR_EVICTION) && ! Find(ATTR_MAX_SIZE) )
+		Error("&eviction requires &max_size");
 	}
 
 void Attributes::AddAttr(AttrPtr attr, bool is_redef)
@@ -531,6 +538,9 @@ void Attributes::CheckAttr(Attr* a)
 			if ( Find(ATTR_BROKER_STORE) )
 				Error("&backend and &broker_store cannot be used simultaneously");
 
+			if ( Find(ATTR_MAX_SIZE) )
+				Error("&backend and &max_size cannot be used simultaneously");
+
 			break;
 			}
 
@@ -566,6 +576,9 @@ void Attributes::CheckAttr(Attr* a)
 			if ( Find(ATTR_BACKEND) )
 				Error("&backend and &broker_store cannot be used simultaneously");
 
+			if ( Find(ATTR_MAX_SIZE) )
+				Error("&broker_store and &max_size cannot be used simultaneously");
+
 			break;
 			}
 
@@ -630,6 +643,48 @@ void Attributes::CheckAttr(Attr* a)
 				Error("&ordered only applicable to tables");
 			break;
 
+		case ATTR_MAX_SIZE:
+			{
+			if ( type->Tag() != TYPE_TABLE )
+				{
+				Error("&max_size only applicable to sets/tables");
+				break;
+				}
+
+			if ( a->GetExpr()->GetType()->Tag() != TYPE_COUNT )
+				{
+				Error("&max_size must take a count argument");
+				break;
+				}
+
+			if ( Find(ATTR_BROKER_STORE) )
+				Error("&broker_store and &max_size cannot be used simultaneously");
+
+			if ( Find(ATTR_BACKEND) )
+				Error("&backend and &max_size cannot be used simultaneously");
+
+			break;
+			}
+
+		case ATTR_EVICTION:
+			{
+			if ( type->Tag() != TYPE_TABLE )
+				{
+				Error("&eviction only applicable to sets/tables");
+				break;
+				}
+
+			// As for &on_change, the TableEviction type might not
+			// exist yet, so we can only check for an enum here.
+			if ( a->GetExpr()->GetType()->Tag() != TYPE_ENUM )
+				{
+				Error("&eviction must take a TableEviction enum argument");
+				break;
+				}
+
+			break;
+			}
+
 		default:
 			BadTag("Attributes::CheckAttr", attr_name(a->Tag()));
 		}
@@ -52,6 +52,8 @@ enum AttrTag
 	ATTR_IS_ASSIGNED, // to suppress usage warnings
 	ATTR_IS_USED, // to suppress usage warnings
 	ATTR_ORDERED, // used to store tables in ordered mode
+	ATTR_MAX_SIZE, // caps the number of table entries
+	ATTR_EVICTION, // policy for evicting entries of capped tables
 	NUM_ATTRS // this item should always be last
 	};
 
@@ -4,13 +4,200 @@
 
 #include <cmath>
 
+#include "zeek/3rdparty/doctest.h"
 #include "zeek/Conn.h"
 #include "zeek/Reporter.h"
 #include "zeek/ZeekString.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ZEEK_BASE64_X86_SIMD
+#include <immintrin.h>
+#endif
+
 namespace zeek::detail
 	{
 
+namespace
+	{
+
+// The bulk decoders below only consume complete groups of four characters
+// that are all part of the alphabet and contain no '=' padding. They stop
+// in front of the first group violating that, leaving it to the byte-wise
+// state machine in Base64Converter::Decode(), which takes care of padding
+// and of error reporting. Each returns the number of input bytes consumed,
+// always a multiple of 4; the number of bytes written is 3/4 of that.
+
+int decode_groups_scalar(const int* table, const unsigned char* data, int len, char* out,
+                         int out_len)
+	{
+	int n = 0;
+
+	while ( len - n >= 4 && out_len >= 3 )
+		{
+		const unsigned char* d = data + n;
+
+		if ( d[0] == '=' || d[1] == '=' || d[2] == '=' || d[3] == '=' )
+			break;
+
+		int k0 = table[d[0]];
+		int k1 = table[d[1]];
+		int k2 = table[d[2]];
+		int k3 = table[d[3]];
+
+		if ( (k0 | k1 | k2 | k3) < 0 )
+			break;
+
+		uint32_t bit32 = (k0 << 18) | (k1 << 12) | (k2 << 6) | k3;
+		*out++ = char((bit32 >> 16) & 0xff);
+		*out++ = char((bit32 >> 8) & 0xff);
+		*out++ = char(bit32 & 0xff);
+
+		out_len -= 3;
+		n += 4;
+		}
+
+	return n;
+	}
+
+#ifdef ZEEK_BASE64_X86_SIMD
+
+// The vectorized decoders only support the default alphabet. They classify
+// each input byte through two nibble lookups (any byte outside the alphabet,
+// including '=', aborts the block) and translate it to its 6-bit value by
+// adding an offset selected by its high nibble. Stores are always full
+// vector width, so they need some slack in the output buffer.
+
+__attribute__((target("ssse3"))) int decode_groups_ssse3(const unsigned char* data, int len,
+                                                          char* out, int out_len)
+	{
+	const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+	                                     0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10,
+	                                     0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0,
+	                                       0);
+	const __m128i mask_2f = _mm_set1_epi8(0x2f);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+	int n = 0;
+
+	while ( len - n >= 16 && out_len >= 16 )
+		{
+		__m128i str = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + n));
+		__m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2f);
+		__m128i lo_nibbles = _mm_and_si128(str, mask_2f);
+		__m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+		__m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+
+		if ( _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), zero)) != 0xffff )
+			break;
+
+		__m128i eq_2f = _mm_cmpeq_epi8(str, mask_2f);
+		__m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+		str = _mm_add_epi8(str, roll);
+
+		// Merge the 6-bit values into 24-bit groups and pack them.
+		__m128i merged = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+		merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+		merged = _mm_shuffle_epi8(merged, pack);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out), merged);
+
+		out += 12;
+		out_len -= 12;
+		n += 16;
+		}
+
+	return n;
+	}
+
+__attribute__((target("avx2"))) int decode_groups_avx2(const unsigned char* data, int len,
+                                                        char* out, int out_len)
+	{
+	const __m256i lut_lo = _mm256_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B,
+		0x1A, 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B,
+		0x1B, 0x1A);
+	const __m256i lut_hi = _mm256_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+		0x10, 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+		0x10, 0x10);
+	const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0,
+	                                          0, 0, 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0,
+	                                          0, 0, 0, 0);
+	const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+	const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+	                                      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+
+	int n = 0;
+
+	while ( len - n >= 32 && out_len >= 32 )
+		{
+		__m256i str = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + n));
+		__m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask_2f);
+		__m256i lo_nibbles = _mm256_and_si256(str, mask_2f);
+		__m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+		__m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+
+		if ( ! _mm256_testz_si256(lo, hi) )
+			break;
+
+		__m256i eq_2f = _mm256_cmpeq_epi8(str, mask_2f);
+		__m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+		str = _mm256_add_epi8(str, roll);
+
+		__m256i merged = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+		merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+		merged = _mm256_shuffle_epi8(merged, pack);
+		merged = _mm256_permutevar8x32_epi32(merged, lanes);
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out), merged);
+
+		out += 24;
+		out_len -= 24;
+		n += 32;
+		}
+
+	return n;
+	}
+
+#endif
+
+using simd_decoder = int (*)(const unsigned char* data, int len, char* out, int out_len);
+
+simd_decoder select_simd_decoder()
+	{
+#ifdef ZEEK_BASE64_X86_SIMD
+	__builtin_cpu_init();
+
+	if ( __builtin_cpu_supports("avx2") )
+		return decode_groups_avx2;
+
+	if ( __builtin_cpu_supports("ssse3") )
+		return decode_groups_ssse3;
+#endif
+
+	return nullptr;
+	}
+
+int decode_groups(const int* table, bool default_alphabet, const unsigned char* data, int len,
+                  char* out, int out_len)
+	{
+	static const simd_decoder simd = select_simd_decoder();
+
+	int n = 0;
+
+	if ( simd && default_alphabet )
+		n = simd(data, len, out, out_len);
+
+	return n + decode_groups_scalar(table, data + n, len - n, out + n / 4 * 3,
+	                                out_len - n / 4 * 3);
+	}
+
+	} // namespace
+
 int Base64Converter::default_base64_table[256];
 const std::string Base64Converter::default_alphabet =
 	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
@@ -142,9 +329,20 @@ int Base64Converter::Decode(int len, const char* data, int* pblen, char** pbuf)
 		}
 
 	int dlen = 0;
+	bool is_default_alphabet = (base64_table == default_base64_table);
 
 	while ( true )
 		{
+		if ( base64_group_next == 0 && ! base64_after_padding && dlen < len )
+			{
+			// Fast path for runs of well-formed groups.
+			int n = decode_groups(base64_table, is_default_alphabet,
+			                      reinterpret_cast<const unsigned char*>(data) + dlen, len - dlen,
+			                      buf, *pbuf + blen - buf);
+			dlen += n;
+			buf += n / 4 * 3;
+			}
+
 		if ( base64_group_next == 4 )
 			{
 			// For every group of 4 6-bit numbers,
@@ -282,3 +480,50 @@ String* encode_base64(const String* s, const String* a, Connection* conn)
 	}
 
 	} // namespace zeek::detail
+
+TEST_SUITE_BEGIN("Base64");
+
+TEST_CASE("bulk decoding")
+	{
+	// Long enough to go through the vectorized decoders, with a tail
+	// that needs the scalar loop.
+	std::string plain;
+	for ( int i = 0; i < 1000; ++i )
+		plain.push_back(static_cast<char>((i * 7 + 3) & 0xff));
+
+	for ( size_t len : {0, 1, 2, 3, 11, 12, 24, 47, 48, 100, 1000} )
+		{
+		zeek::String in(reinterpret_cast<const u_char*>(plain.data()), len, true);
+		zeek::String* enc = zeek::detail::encode_base64(&in);
+		zeek::String* dec = zeek::detail::decode_base64(enc);
+		REQUIRE(dec);
+		CHECK_EQ(*dec, in);
+		delete enc;
+		delete dec;
+		}
+
+	zeek::String alphabet("!#$%&/(),-.:;<>@[]^ `_{|}~abcdefghijklmnopqrstuvwxyz0123456789+?");
+	zeek::String in(reinterpret_cast<const u_char*>(plain.data()), plain.size(), true);
+	zeek::String* enc = zeek::detail::encode_base64(&in, &alphabet);
+	zeek::String* dec = zeek::detail::decode_base64(enc, &alphabet);
+	REQUIRE(dec);
+	CHECK_EQ(*dec, in);
+	delete enc;
+	delete dec;
+	}
+
+TEST_CASE("bulk decoding stops at padding")
+	{
+	// The padded final group must be left to the byte-wise decoder.
+	zeek::detail::Base64Converter dec(nullptr);
+	std::string in = "QUJDREVGR0hJSktMTU5PUFFSU1RVVldYWVo=";
+	char* buf = nullptr;
+	int blen = 0;
+	dec.Decode(in.size(), in.data(), &blen, &buf);
+	CHECK_EQ(std::string(buf, blen), "ABCDEFGHIJKLMNOPQRSTUVWXYZ");
+	CHECK_FALSE(dec.Errored());
+	CHECK_FALSE(dec.HasData());
+	delete[] buf;
+	}
+
+TEST_SUITE_END();
@@ -60,14 +60,436 @@ const HashkeyMapPtr ordered_hashkeys(const TableVal* tv)
 	return res;
 	}
 
+// Returns the size and alignment of an atomic value of the given type in
+// a key, or false if it doesn't have a fixed size.  These mirror the
+// reservations made by CompositeHash::ReserveSingleTypeKeySize().
+static bool fixed_key_size(const Type* t, size_t& size, size_t& align)
+	{
+	switch ( t->InternalType() )
+		{
+		case TYPE_INTERNAL_INT:
+		case TYPE_INTERNAL_UNSIGNED:
+		case TYPE_INTERNAL_DOUBLE:
+			size = align = sizeof(zeek_int_t);
+			return true;
+
+		case TYPE_INTERNAL_ADDR:
+			size = sizeof(uint32_t) * 4;
+			align = sizeof(uint32_t);
+			return true;
+
+		case TYPE_INTERNAL_SUBNET:
+			size = sizeof(uint32_t) * 5;
+			align = sizeof(uint32_t);
+			return true;
+
+		default:
+			return false;
+		}
+	}
+
+// Writes an atomic value of fixed size to the given location of a key.
+static void write_fixed_val(char* dst, InternalTypeTag it, const Val* v)
+	{
+	switch ( it )
+		{
+		case TYPE_INTERNAL_INT:
+			{
+			zeek_int_t i = v->AsInt();
+			memcpy(dst, &i, sizeof(i));
+			}
+			break;
+
+		case TYPE_INTERNAL_UNSIGNED:
+			{
+			zeek_uint_t u = v->AsCount();
+			memcpy(dst, &u, sizeof(u));
+			}
+			break;
+
+		case TYPE_INTERNAL_DOUBLE:
+			{
+			double d = v->InternalDouble();
+			memcpy(dst, &d, sizeof(d));
+			}
+			break;
+
+		case TYPE_INTERNAL_ADDR:
+			v->AsAddr().CopyIPv6(reinterpret_cast<uint32_t*>(dst));
+			break;
+
+		case TYPE_INTERNAL_SUBNET:
+			{
+			const auto& sn = v->AsSubNet();
+			uint32_t width = sn.Length();
+			sn.Prefix().CopyIPv6(reinterpret_cast<uint32_t*>(dst));
+			memcpy(dst + sizeof(uint32_t) * 4, &width, sizeof(width));
+			}
+			break;
+
+		default:
+			reporter->InternalError("bad internal type in write_fixed_val()");
+		}
+	}
+
+// Same, for the given field of a record, which must be present.  Reads
+// the field directly rather than going through a Val.
+static void write_fixed_field(char* dst, InternalTypeTag it, const RecordVal* rv, int field)
+	{
+	switch ( it )
+		{
+		case TYPE_INTERNAL_INT:
+			{
+			auto i = rv->GetFieldAs<zeek_int_t>(field);
+			memcpy(dst, &i, sizeof(i));
+			}
+			break;
+
+		case TYPE_INTERNAL_UNSIGNED:
+			{
+			auto u = rv->GetFieldAs<zeek_uint_t>(field);
+			memcpy(dst, &u, sizeof(u));
+			}
+			break;
+
+		case TYPE_INTERNAL_DOUBLE:
+			{
+			auto d = rv->GetFieldAs<double>(field);
+			memcpy(dst, &d, sizeof(d));
+			}
+			break;
+
+		case TYPE_INTERNAL_ADDR:
+			rv->GetFieldAs<AddrVal>(field).CopyIPv6(reinterpret_cast<uint32_t*>(dst));
+			break;
+
+		case TYPE_INTERNAL_SUBNET:
+			{
+			const auto& sn = rv->GetFieldAs<SubNetVal>(field);
+			uint32_t width = sn.Length();
+			sn.Prefix().CopyIPv6(reinterpret_cast<uint32_t*>(dst));
+			memcpy(dst + sizeof(uint32_t) * 4, &width, sizeof(width));
+			}
+			break;
+
+		default:
+			reporter->InternalError("bad internal type in write_fixed_field()");
+		}
+	}
+
+// The inverse of write_fixed_val(), returning a value of the given type.
+static ValPtr read_fixed_val(const char* src, Type* t)
+	{
+	TypeTag tag = t->Tag();
+
+	switch ( t->InternalType() )
+		{
+		case TYPE_INTERNAL_INT:
+			{
+			zeek_int_t i;
+			memcpy(&i, src, sizeof(i));
+
+			if ( tag == TYPE_ENUM )
+				return t->AsEnumType()->GetEnumVal(i);
+			else if ( tag == TYPE_BOOL )
+				return val_mgr->Bool(i);
+			else
+				return val_mgr->Int(i);
+			}
+
+		case TYPE_INTERNAL_UNSIGNED:
+			{
+			zeek_uint_t u;
+			memcpy(&u, src, sizeof(u));
+
+			if ( tag == TYPE_PORT )
+				return val_mgr->Port(u);
+			else
+				return val_mgr->Count(u);
+			}
+
+		case TYPE_INTERNAL_DOUBLE:
+			{
+			double d;
+			memcpy(&d, src, sizeof(d));
+
+			if ( tag == TYPE_INTERVAL )
+				return make_intrusive<IntervalVal>(d, 1.0);
+			else if ( tag == TYPE_TIME )
+				return make_intrusive<TimeVal>(d);
+			else
+				return make_intrusive<DoubleVal>(d);
+			}
+
+		case TYPE_INTERNAL_ADDR:
+			return make_intrusive<AddrVal>(
+				IPAddr(IPv6, reinterpret_cast<const uint32_t*>(src), IPAddr::Network));
+
+		case TYPE_INTERNAL_SUBNET:
+			{
+			IPAddr addr(IPv6, reinterpret_cast<const uint32_t*>(src), IPAddr::Network);
+			uint32_t width;
+			memcpy(&width, src + sizeof(uint32_t) * 4, sizeof(width));
+			return make_intrusive<SubNetVal>(addr, width);
+			}
+
+		default:
+			reporter->InternalError("bad internal type in read_fixed_val()");
+			return nullptr;
+		}
+	}
+
 CompositeHash::CompositeHash(TypeListPtr composite_type) : type(std::move(composite_type))
 	{
 	if ( type->GetTypes().size() == 1 )
 		is_singleton = true;
+
+	SelectKeyKind();
+	}
+
+void CompositeHash::SelectKeyKind()
+	{
+	const auto& tl = type->GetTypes();
+
+	if ( is_singleton )
+		{
+		switch ( tl[0]->InternalType() )
+			{
+			case TYPE_INTERNAL_INT:
+				key_kind = KEY_INT;
+				break;
+
+			case TYPE_INTERNAL_UNSIGNED:
+				key_kind = KEY_UNSIGNED;
+				break;
+
+			case TYPE_INTERNAL_DOUBLE:
+				key_kind = KEY_DOUBLE;
+				break;
+
+			case TYPE_INTERNAL_STRING:
+				key_kind = KEY_STRING;
+				return;
+
+			default:
+				break;
+			}
+		}
+
+	// Lay out the values in order, aligned the same way that
+	// HashKey::Reserve() and HashKey::Write() do.
+	size_t size = 0;
+
+	auto place = [this, &size](const Type* t, size_t& offset)
+	{
+		size_t t_size, t_align;
+		if ( ! fixed_key_size(t, t_size, t_align) )
+			return false;
+
+		offset = util::memory_size_align(size, t_align);
+		if ( offset != size )
+			fixed_padded = true;
+
+		size = offset + t_size;
+		return true;
+	};
+
+	for ( const auto& t : tl )
+		{
+		FixedKeyIndex fi{t.get(), 0, {}};
+
+		if ( t->Tag() == TYPE_RECORD )
+			{
+			auto rt = t->AsRecordType();
+
+			// An empty record would be indistinguishable from an
+			// atomic value, and isn't worth optimizing for.
+			if ( rt->NumFields() == 0 )
+				return;
+
+			for ( int i = 0; i < rt->NumFields(); ++i )
+				{
+				Attributes* a = rt->FieldDecl(i)->attrs.get();
+				if ( a && a->Find(ATTR_OPTIONAL) )
+					return;
+
+				FixedKeyField ff{rt->GetFieldType(i).get(), 0};
+				if ( ! place(ff.type, ff.offset) )
+					return;
+
+				fi.fields.emplace_back(ff);
+				}
+			}
+
+		else if ( ! place(fi.type, fi.offset) )
+			return;
+
+		fixed_layout.emplace_back(std::move(fi));
+		}
+
+	fixed_size = size;
+
+	// Leave the inline singletons be.
+	if ( key_kind == KEY_GENERIC )
+		key_kind = KEY_FIXED;
+	}
+
+std::unique_ptr<HashKey> CompositeHash::MakeSpecializedHashKey(const Val& argv, bool type_check,
+                                                               bool& handled) const
+	{
+	handled = true;
+	const Val* v = &argv;
+
+	if ( is_singleton )
+		{
+		// As for the generic method, unwrap a bundled value.
+		if ( v->GetType()->Tag() == TYPE_LIST )
+			{
+			auto lv = v->AsListVal();
+
+			if ( type_check && lv->Length() != 1 )
+				return nullptr;
+
+			v = lv->Idx(0).get();
+			}
+
+		if ( type_check && v->GetType()->InternalType() != type->GetTypes()[0]->InternalType() )
+			return nullptr;
+
+		switch ( key_kind )
+			{
+			case KEY_INT:
+				return std::make_unique<HashKey>(v->AsInt());
+
+			case KEY_UNSIGNED:
+				return std::make_unique<HashKey>(v->AsCount());
+
+			case KEY_DOUBLE:
+				return std::make_unique<HashKey>(v->InternalDouble());
+
+			case KEY_STRING:
+				{
+				auto s = v->AsString();
+				return std::make_unique<HashKey>(static_cast<const void*>(s->Bytes()), s->Len());
+				}
+
+			default:
+				break;
+			}
+		}
+
+	else if ( type_check && (argv.GetType()->Tag() != TYPE_LIST ||
+	                         argv.AsListVal()->Length() != int(fixed_layout.size())) )
+		return nullptr;
+
+	ASSERT(key_kind == KEY_FIXED);
+
+	auto res = std::make_unique<HashKey>();
+	res->Reserve("fixed", fixed_size);
+	res->Allocate();
+
+	auto key = static_cast<char*>(res->KeyAtWrite());
+
+	if ( fixed_padded )
+		memset(key, 0, fixed_size);
+
+	for ( auto i = 0u; i < fixed_layout.size(); ++i )
+		{
+		const auto& fi = fixed_layout[i];
+		const Val* vi = is_singleton ? v : argv.AsListVal()->Idx(i).get();
+
+		if ( fi.fields.empty() )
+			{
+			auto it = fi.type->InternalType();
+
+			if ( type_check && vi->GetType()->InternalType() != it )
+				return nullptr;
+
+			write_fixed_val(key + fi.offset, it, vi);
+			continue;
+			}
+
+		// A record value of some other type than the index's might
+		// have a different layout, as does the index type itself if
+		// it's been extended since we computed ours.
+		if ( vi->GetType().get() != fi.type ||
+		     fi.type->AsRecordType()->NumFields() != int(fi.fields.size()) )
+			{
+			handled = false;
+			return nullptr;
+			}
+
+		auto rv = vi->AsRecordVal();
+
+		for ( auto j = 0u; j < fi.fields.size(); ++j )
+			{
+			if ( ! rv->HasField(j) )
+				return nullptr;
+
+			const auto& ff = fi.fields[j];
+			write_fixed_field(key + ff.offset, ff.type->InternalType(), rv, j);
+			}
+		}
+
+	res->SkipWrite("fixed", fixed_size);
+
+	return res;
+	}
+
+ListValPtr CompositeHash::RecoverSpecializedVals(const HashKey& hk) const
+	{
+	auto l = make_intrusive<ListVal>(TYPE_ANY);
+	auto key = static_cast<const char*>(hk.Key());
+
+	if ( key_kind == KEY_STRING )
+		{
+		l->Append(make_intrusive<StringVal>(new String((const byte_vec)key, hk.Size(), true)));
+		return l;
+		}
+
+	for ( const auto& fi : fixed_layout )
+		if ( ! fi.fields.empty() &&
+		     fi.type->AsRecordType()->NumFields() != int(fi.fields.size()) )
+			// Keys for the extended record come from the generic method.
+			return nullptr;
+
+	if ( hk.Size() != fixed_size )
+		reporter->InternalError("bad key size in CompositeHash::RecoverVals");
+
+	for ( const auto& fi : fixed_layout )
+		{
+		if ( fi.fields.empty() )
+			{
+			l->Append(read_fixed_val(key + fi.offset, fi.type));
+			continue;
+			}
+
+		auto rt = fi.type->AsRecordType();
+		auto rv = make_intrusive<RecordVal>(IntrusivePtr{NewRef{}, rt});
+
+		for ( auto j = 0u; j < fi.fields.size(); ++j )
+			{
+			const auto& ff = fi.fields[j];
+			rv->Assign(j, read_fixed_val(key + ff.offset, ff.type));
+			}
+
+		l->Append(std::move(rv));
+		}
+
+	return l;
 	}
 
 std::unique_ptr<HashKey> CompositeHash::MakeHashKey(const Val& argv, bool type_check) const
 	{
+	if ( key_kind != KEY_GENERIC )
+		{
+		bool handled;
+		auto res = MakeSpecializedHashKey(argv, type_check, handled);
+
+		if ( handled )
+			return res;
+		}
+
 	auto res = std::make_unique<HashKey>();
 	const auto& tl = type->GetTypes();
 
@@ -117,6 +539,12 @@ std::unique_ptr<HashKey> CompositeHash::MakeHashKey(const Val& argv, bool type_c
 
 ListValPtr CompositeHash::RecoverVals(const HashKey& hk) const
 	{
+	if ( key_kind != KEY_GENERIC )
+		{
+		if ( auto l = RecoverSpecializedVals(hk) )
+			return l;
+		}
+
 	auto l = make_intrusive<ListVal>(TYPE_ANY);
 	const auto& tl = type->GetTypes();
 
@@ -312,13 +740,14 @@ bool CompositeHash::RecoverOneVal(const HashKey& hk, Type* t, ValPtr* pval, bool
 					texts[1] = static_cast<const char*>(hk.KeyAtRead());
 					hk.SkipRead("pattern-string2", strlen(texts[1]) + 1);
 
-					RE_Matcher* re = new RE_Matcher(texts[0], texts[1]);
+					bool compiled;
+					auto re = cached_RE_Matcher(texts[0], texts[1], &compiled);
 
-					if ( ! re->Compile() )
+					if ( ! compiled )
 						reporter->InternalError("failed compiling table/set key pattern: %s",
 						                        re->PatternText());
 
-					*pval = make_intrusive<PatternVal>(re);
+					*pval = make_intrusive<PatternVal>(std::move(re));
 					}
 					break;
 
@@ -54,6 +54,21 @@ protected:
 
 	bool EnsureTypeReserve(HashKey& hk, const Val* v, Type* bt, bool type_check) const;
 
+	// Determines whether our index type qualifies for one of the
+	// specialized key layouts below, and if so sets it up.
+	void SelectKeyKind();
+
+	// Builds the key for a key_kind other than KEY_GENERIC without
+	// a sizing pass.  Sets "handled" to false if the value isn't of
+	// the shape the layout assumes, in which case the caller needs
+	// to fall back to the generic method.
+	std::unique_ptr<HashKey> MakeSpecializedHashKey(const Val& v, bool type_check,
+	                                                bool& handled) const;
+
+	// The inverse of MakeSpecializedHashKey().  Returns nil if the
+	// generic method needs to be used instead.
+	ListValPtr RecoverSpecializedVals(const HashKey& k) const;
+
 	// The following are for allowing hashing of function values.
 	// These can occur, for example, in sets of predicates that get
 	// iterated over.  We use pointers in order to keep storage
@@ -68,6 +83,41 @@ protected:
 
 	TypeListPtr type;
 	bool is_singleton = false; // if just one type in index
+
+	// Most tables are indexed by a single atomic value, or by a few
+	// addresses and ports.  For those, the layout of the key is the
+	// same for every value, and we can write it directly.  The layout
+	// is byte-for-byte identical to what the generic method produces.
+	enum KeyKind
+		{
+		KEY_GENERIC, // anything else
+		KEY_INT, // singletons stored within the HashKey itself ...
+		KEY_UNSIGNED,
+		KEY_DOUBLE,
+		KEY_STRING, // ... a singleton string, which is just its bytes ...
+		KEY_FIXED, // ... and fixed-size atomic values, or records of them
+		};
+
+	KeyKind key_kind = KEY_GENERIC;
+
+	// Where the atomic values of a fixed-size key live.  Indices of
+	// record type have one field entry per record field.
+	struct FixedKeyField
+		{
+		Type* type;
+		size_t offset;
+		};
+
+	struct FixedKeyIndex
+		{
+		Type* type;
+		size_t offset;
+		std::vector<FixedKeyField> fields;
+		};
+
+	std::vector<FixedKeyIndex> fixed_layout;
+	size_t fixed_size = 0;
+	bool fixed_padded = false; // if the layout has alignment gaps
 	};
 
 	} // namespace zeek::detail
@@ -4,15 +4,88 @@
 
 #include "zeek/zeek-config.h"
 
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
 #include "zeek/Desc.h"
 #include "zeek/EquivClass.h"
 #include "zeek/Hash.h"
+#include "zeek/telemetry/Manager.h"
 
 namespace zeek::detail
 	{
 
 unsigned int DFA_State::transition_counter = 0;
 
+uint64_t DFA_Machine::memory_budget = 0;
+uint64_t DFA_Machine::evict_threshold = 0;
+std::atomic<uint64_t> DFA_Machine::total_memory = 0;
+uint64_t DFA_Machine::clock = 0;
+
+// All existing machines, for evicting states across them. Machines may get
+// built on multiple threads at startup (see Specific_RE_Matcher::BuildSetDFA()),
+// hence the mutex. Intentionally never freed, as machines may get destroyed
+// during static destruction.
+struct DFA_Machines
+	{
+	std::mutex mutex;
+	std::set<DFA_Machine*> machines;
+	};
+
+static DFA_Machines& all_machines()
+	{
+	static auto* machines = new DFA_Machines;
+	return *machines;
+	}
+
+// Telemetry shared by all state caches with the same label.
+struct DFA_Metrics
+	{
+	telemetry::IntGauge states;
+	telemetry::IntGauge memory;
+	telemetry::IntCounter hits;
+	telemetry::IntCounter misses;
+	telemetry::IntCounter evictions;
+	};
+
+static DFA_Metrics* get_metrics(const std::string& label)
+	{
+	if ( ! telemetry_mgr )
+		return nullptr;
+
+	static std::mutex metrics_mutex;
+	static std::map<std::string, std::unique_ptr<DFA_Metrics>> all_metrics;
+
+	std::lock_guard<std::mutex> lock(metrics_mutex);
+
+	auto it = all_metrics.find(label);
+
+	if ( it != all_metrics.end() )
+		return it->second.get();
+
+	auto states_family = telemetry_mgr->GaugeFamily("zeek", "dfa-states", {"matcher"},
+	                                                "Number of cached DFA states");
+	auto memory_family = telemetry_mgr->GaugeFamily("zeek", "dfa-memory", {"matcher"},
+	                                                "Memory used by cached DFA states", "bytes");
+	auto hits_family = telemetry_mgr->CounterFamily("zeek", "dfa-cache-hits", {"matcher"},
+	                                                "DFA state cache hits", "1", true);
+	auto misses_family = telemetry_mgr->CounterFamily("zeek", "dfa-cache-misses", {"matcher"},
+	                                                  "DFA state cache misses", "1", true);
+	auto evictions_family = telemetry_mgr->CounterFamily(
+		"zeek", "dfa-cache-evictions", {"matcher"}, "Evicted DFA states", "1", true);
+
+	auto m = std::make_unique<DFA_Metrics>(DFA_Metrics{
+		states_family.GetOrAdd({{"matcher", label}}), memory_family.GetOrAdd({{"matcher", label}}),
+		hits_family.GetOrAdd({{"matcher", label}}), misses_family.GetOrAdd({{"matcher", label}}),
+		evictions_family.GetOrAdd({{"matcher", label}})});
+
+	auto rval = m.get();
+	all_metrics.emplace(label, std::move(m));
+	return rval;
+	}
+
 DFA_State::DFA_State(int arg_state_num, const EquivClass* ec, NFA_state_list* arg_nfa_states,
                      AcceptingSet* arg_accept)
 	{
@@ -21,6 +94,15 @@ DFA_State::DFA_State(int arg_state_num, const EquivClass* ec, NFA_state_list* ar
 	nfa_states = arg_nfa_states;
 	accept = arg_accept;
 	mark = nullptr;
+	loop_exits = nullptr;
+	loop_exit_byte = -1;
+	num_self_loops = 0;
+	loop_exits_checked = false;
+	dense = nullptr;
+	num_visits = 0;
+	last_use = DFA_Machine::Clock();
+	referenced = false;
+	last_step = 0;
 
 	SymPartition(ec);
 
@@ -33,6 +115,8 @@ DFA_State::DFA_State(int arg_state_num, const EquivClass* ec, NFA_state_list* ar
 DFA_State::~DFA_State()
 	{
 	delete[] xtions;
+	delete[] loop_exits;
+	delete dense;
 	delete nfa_states;
 	delete accept;
 	delete meta_ec;
@@ -78,10 +162,16 @@ void DFA_State::SymPartition(const EquivClass* ec)
 
 DFA_State* DFA_State::ComputeXtion(int sym, DFA_Machine* machine)
 	{
+	Touch();
+
 	int equiv_sym = meta_ec->EquivRep(sym);
 	if ( xtions[equiv_sym] != DFA_UNCOMPUTED_STATE_PTR )
 		{
 		AddXtion(sym, xtions[equiv_sym]);
+
+		if ( dense )
+			UpdateDenseXtions(machine);
+
 		return xtions[sym];
 		}
 
@@ -106,9 +196,87 @@ DFA_State* DFA_State::ComputeXtion(int sym, DFA_Machine* machine)
 	if ( sym != equiv_sym )
 		AddXtion(sym, next_d);
 
+	if ( next_d )
+		next_d->Touch();
+
+	if ( dense )
+		UpdateDenseXtions(machine);
+
 	return xtions[sym];
 	}
 
+bool DFA_State::ComputeLoopExits(DFA_Machine* machine)
+	{
+	loop_exits_checked = true;
+
+	// This computes all of the state's transitions. We only get here for
+	// states that keep looping back onto themselves, such as the ones for
+	// a ".*" prefix that sit in front of the patterns' first literals.
+	const int* ecs = machine->EC()->EquivClasses();
+	u_char* exits = new u_char[256];
+	int num_exits = 0;
+
+	for ( int c = 0; c < 256; ++c )
+		{
+		exits[c] = (Xtion(ecs[c], machine) != this);
+
+		if ( exits[c] )
+			{
+			loop_exit_byte = c;
+			++num_exits;
+			}
+		}
+
+	if ( num_exits > DFA_LOOP_EXITS_MAX )
+		{
+		delete[] exits;
+		loop_exit_byte = -1;
+		return false;
+		}
+
+	if ( num_exits != 1 )
+		loop_exit_byte = -1;
+
+	loop_exits = exits;
+	machine->Cache()->AddMemory(256);
+
+	// Skipping beats stepping through the dense table.
+	if ( dense )
+		{
+		delete dense;
+		dense = nullptr;
+		machine->Cache()->AddMemory(-static_cast<int64_t>(sizeof(DFA_Dense_Xtions)));
+		}
+
+	return true;
+	}
+
+void DFA_State::BuildDenseXtions(DFA_Machine* machine)
+	{
+	// States we skip through don't need a table.
+	if ( loop_exits )
+		return;
+
+	dense = new DFA_Dense_Xtions;
+	UpdateDenseXtions(machine);
+	machine->Cache()->AddMemory(sizeof(DFA_Dense_Xtions));
+	}
+
+void DFA_State::UpdateDenseXtions(DFA_Machine* machine)
+	{
+	const int* ecs = machine->EC()->EquivClasses();
+
+	for ( int i = 0; i < 256; ++i )
+		{
+		DFA_State* next = xtions[ecs[i]];
+
+		if ( next == DFA_UNCOMPUTED_STATE_PTR || (next && next->accept) )
+			next = nullptr;
+
+		dense->xtions[i] = next;
+		}
+	}
+
 void DFA_State::AppendIfNew(int sym, int_list* sym_list)
 	{
 	for ( auto value : *sym_list )
@@ -286,16 +454,24 @@ unsigned int DFA_State::Size()
 	return sizeof(*this) + util::pad_size(sizeof(DFA_State*) * num_sym) +
 	       (accept ? util::pad_size(sizeof(int) * accept->size()) : 0) +
 	       (nfa_states ? util::pad_size(sizeof(NFA_State*) * nfa_states->length()) : 0) +
-	       (meta_ec ? meta_ec->Size() : 0);
+	       (meta_ec ? meta_ec->Size() : 0) + (loop_exits ? 256 : 0) +
+	       (dense ? sizeof(DFA_Dense_Xtions) : 0);
 	}
 
 DFA_State_Cache::DFA_State_Cache()
 	{
-	hits = misses = 0;
+	hits = misses = evictions = 0;
+	mem = 0;
+	metrics = get_metrics("pattern");
 	}
 
 DFA_State_Cache::~DFA_State_Cache()
 	{
+	if ( metrics && telemetry_mgr )
+		metrics->states.Dec(states.size());
+
+	UpdateMemory(-static_cast<int64_t>(mem));
+
 	for ( auto& entry : states )
 		{
 		assert(entry.second);
@@ -340,10 +516,17 @@ DFA_State* DFA_State_Cache::Lookup(const NFA_state_list& nfas, DigestStr* digest
 	if ( entry == states.end() )
 		{
 		++misses;
+
+		if ( metrics && telemetry_mgr )
+			metrics->misses.Inc();
+
 		return nullptr;
 		}
 	++hits;
 
+	if ( metrics && telemetry_mgr )
+		metrics->hits.Inc();
+
 	digest->clear();
 
 	return entry->second;
@@ -352,9 +535,91 @@ DFA_State* DFA_State_Cache::Lookup(const NFA_state_list& nfas, DigestStr* digest
 DFA_State* DFA_State_Cache::Insert(DFA_State* state, DigestStr digest)
 	{
 	states.emplace(std::move(digest), state);
+
+	if ( metrics && telemetry_mgr )
+		metrics->states.Inc();
+
+	UpdateMemory(util::pad_size(state->Size()) + padded_sizeof(*state));
 	return state;
 	}
 
+void DFA_State_Cache::AddMemory(int64_t bytes)
+	{
+	UpdateMemory(bytes);
+	}
+
+void DFA_State_Cache::UpdateMemory(int64_t delta)
+	{
+	mem += delta;
+	DFA_Machine::total_memory += delta;
+
+	if ( metrics && telemetry_mgr )
+		metrics->memory.Inc(delta);
+	}
+
+void DFA_State_Cache::SetMetricsLabel(const std::string& label)
+	{
+	DFA_Metrics* new_metrics = get_metrics(label);
+
+	if ( new_metrics == metrics || ! telemetry_mgr )
+		return;
+
+	// Move what we've accounted for so far over to the new label.
+	if ( metrics )
+		{
+		metrics->states.Dec(states.size());
+		metrics->memory.Dec(mem);
+		}
+
+	metrics = new_metrics;
+	metrics->states.Inc(states.size());
+	metrics->memory.Inc(mem);
+	}
+
+void DFA_State_Cache::Evict(const std::set<DFA_State*>& evict)
+	{
+	// Reset transitions leading into the evicted states first.
+	for ( const auto& entry : states )
+		{
+		DFA_State* d = entry.second;
+
+		if ( evict.count(d) )
+			continue;
+
+		for ( int sym = 0; sym < d->num_sym; ++sym )
+			if ( evict.count(d->xtions[sym]) )
+				d->xtions[sym] = DFA_UNCOMPUTED_STATE_PTR;
+
+		if ( d->dense )
+			for ( auto& next : d->dense->xtions )
+				if ( evict.count(next) )
+					next = nullptr;
+		}
+
+	for ( auto it = states.begin(); it != states.end(); )
+		{
+		DFA_State* d = it->second;
+
+		if ( ! evict.count(d) )
+			{
+			++it;
+			continue;
+			}
+
+		UpdateMemory(-static_cast<int64_t>(util::pad_size(d->Size()) + padded_sizeof(*d)));
+		++evictions;
+
+		if ( metrics && telemetry_mgr )
+			{
+			metrics->states.Dec();
+			metrics->evictions.Inc();
+			}
+
+		it = states.erase(it);
+		Unref(d);
+		}
+	}
+
 void DFA_State_Cache::GetStats(Stats* s)
 	{
 	s->dfa_states = 0;
@@ -364,6 +629,7 @@ void DFA_State_Cache::GetStats(Stats* s)
 	s->mem = 0;
 	s->hits = hits;
 	s->misses = misses;
+	s->evictions = evictions;
 
 	for ( const auto& state : states )
 		{
@@ -386,6 +652,12 @@ DFA_Machine::DFA_Machine(NFA_Machine* n, EquivClass* arg_ec)
 
 	dfa_state_cache = new DFA_State_Cache();
 
+		{
+		auto& all = all_machines();
+		std::lock_guard<std::mutex> lock(all.mutex);
+		all.machines.insert(this);
+		}
+
 	NFA_state_list* ns = new NFA_state_list;
 	ns->push_back(n->FirstState());
 
@@ -403,6 +675,12 @@ DFA_Machine::DFA_Machine(NFA_Machine* n, EquivClass* arg_ec)
 
 DFA_Machine::~DFA_Machine()
 	{
+		{
+		auto& all = all_machines();
+		std::lock_guard<std::mutex> lock(all.mutex);
+		all.machines.erase(this);
+		}
+
 	delete dfa_state_cache;
 	Unref(nfa);
 	}
@@ -458,4 +736,116 @@ int DFA_Machine::Rep(int sym)
 	return -1;
 	}
 
+void DFA_Machine::EvictStates()
+	{
+	// Candidates are all states not currently held by a matcher, except
+	// for the start states.
+	std::vector<std::tuple<uint64_t, DFA_Machine*, DFA_State*>> candidates;
+	auto& all = all_machines();
+	std::lock_guard<std::mutex> lock(all.mutex);
+
+	for ( auto* m : all.machines )
+		for ( const auto& entry : m->dfa_state_cache->states )
+			{
+			DFA_State* d = entry.second;
+
+			// States reached since the last eviction count as used
+			// now.
+			if ( d->referenced )
+				{
+				d->last_use = clock;
+				d->referenced = false;
+				}
+
+			if ( d != m->start_state && d->RefCnt() == 1 )
+				candidates.emplace_back(d->last_use, m, d);
+			}
+
+	std::sort(candidates.begin(), candidates.end(),
+	          [](const auto& a, const auto& b) { return std::get<0>(a) < std::get<0>(b); });
+
+	// Evict down to 3/4 of the budget so that we don't need to come back
+	// here right away.
+	uint64_t target = memory_budget / 4 * 3;
+	uint64_t mem = total_memory;
+	std::map<DFA_Machine*, std::set<DFA_State*>> evict;
+
+	for ( const auto& [last_use, m, d] : candidates )
+		{
+		if ( mem <= target )
+			break;
+
+		evict[m].insert(d);
+		mem -= std::min<uint64_t>(mem, util::pad_size(d->Size()) + padded_sizeof(*d));
+		}
+
+	for ( const auto& [m, states] : evict )
+		m->dfa_state_cache->Evict(states);
+
+	// Back off if we ran out of candidates before reaching the target.
+	if ( total_memory > target )
+		evict_threshold = total_memory + memory_budget / 4;
+	else
+		evict_threshold = 0;
+	}
+
+void DFA_Machine::RecordXtions(std::vector<uint32_t>* xtions)
+	{
+	if ( ! start_state )
+		return;
+
+	std::vector<DFA_State*> states = {start_state};
+	std::map<DFA_State*, uint32_t> state_idx = {{start_state, 0}};
+
+	for ( size_t i = 0; i < states.size(); ++i )
+		{
+		DFA_State* d = states[i];
+
+		for ( int sym = 0; sym < d->num_sym; ++sym )
+			{
+			DFA_State* next = d->xtions[sym];
+
+			if ( next == DFA_UNCOMPUTED_STATE_PTR )
+				continue;
+
+			xtions->push_back(i);
+			xtions->push_back(sym);
+
+			if ( next && state_idx.find(next) == state_idx.end() )
+				{
+				state_idx[next] = states.size();
+				states.push_back(next);
+				}
+			}
+		}
+	}
+
+bool DFA_Machine::ReplayXtions(const uint32_t* xtions, size_t n)
+	{
+	if ( ! start_state )
+		return n == 0;
+
+	std::vector<DFA_State*> states = {start_state};
+	std::map<DFA_State*, uint32_t> state_idx = {{start_state, 0}};
+
+	for ( size_t i = 0; i < n; ++i )
+		{
+		uint32_t idx = xtions[2 * i];
+		uint32_t sym = xtions[2 * i + 1];
+
+		if ( idx >= states.size() || sym >= static_cast<uint32_t>(states[idx]->num_sym) )
+			return false;
+
+		DFA_State* next = states[idx]->Xtion(sym, this);
+
+		if ( next && state_idx.find(next) == state_idx.end() )
+			{
+			state_idx[next] = states.size();
+			states.push_back(next);
+			}
+		}
+
+	return true;
+	}
+
 	} // namespace zeek::detail
@@ -3,9 +3,14 @@
 #pragma once
 
 #include <sys/types.h> // for u_char
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstring>
 #include <map>
+#include <set>
 #include <string>
+#include <vector>
 
 #include "zeek/NFA.h"
 #include "zeek/Obj.h"
@@ -22,6 +27,26 @@ class DFA_Machine;
 #define DFA_UNCOMPUTED_STATE -2
 #define DFA_UNCOMPUTED_STATE_PTR ((DFA_State*)DFA_UNCOMPUTED_STATE)
 
+// Number of times a state has to loop back onto itself before we compute
+// the table of bytes leaving it (see DFA_State::HasLoopExits()).
+#define DFA_LOOP_EXITS_THRESHOLD 16
+
+// States left by more bytes than this aren't worth skipping ahead in.
+#define DFA_LOOP_EXITS_MAX 128
+
+// Number of times a state has to be stepped through byte by byte before we
+// build its dense transition table (see DFA_State::Visit()).
+#define DFA_DENSE_THRESHOLD 64
+
+// Transitions of a frequently visited state, indexed directly by input byte
+// rather than by equivalence class. Only transitions that have already been
+// computed and that lead into non-accepting states are present; all others
+// are nil and need to go through DFA_State::Xtion().
+struct alignas(64) DFA_Dense_Xtions
+	{
+	DFA_State* xtions[256];
+	};
+
 class DFA_State : public Obj
 	{
 public:
@@ -35,6 +60,29 @@ public:
 
 	inline DFA_State* Xtion(int sym, DFA_Machine* machine);
 
+	// Returns true if the state loops back onto itself on enough input
+	// bytes to make skipping ahead with SkipLoop() worthwhile. To be
+	// called when the state has just transitioned to itself; the check
+	// is only done once the state has done so repeatedly.
+	inline bool HasLoopExits(DFA_Machine* machine);
+
+	// Returns the number of bytes at the beginning of data on which the
+	// state transitions back to itself. Requires HasLoopExits().
+	inline int SkipLoop(const u_char* data, int len) const;
+
+	// Counts a byte-by-byte step through the state, building its dense
+	// transition table once the state has proven to be hot.
+	inline void Visit(DFA_Machine* machine);
+
+	bool HasDenseXtions() const { return dense != nullptr; }
+
+	// Follows dense transitions from *state for as many bytes of data as
+	// possible, stopping at the first byte that leads into an accepting,
+	// dead, or not yet computed state, or into one without a dense table
+	// of its own. Returns the number of bytes consumed and updates *state
+	// to the state reached. Requires HasDenseXtions() for *state.
+	static inline int StepDense(DFA_State** state, const u_char* data, int len);
+
 	const AcceptingSet* Accept() const { return accept; }
 	void SymPartition(const EquivClass* ec);
 
@@ -53,10 +101,33 @@ public:
 	void Stats(unsigned int* computed, unsigned int* uncomputed);
 	unsigned int Size();
 
+	// Marks the state as recently used, for DFA_Machine's eviction.
+	// Following an already computed transition only sets the state's
+	// "referenced" flag, which the next eviction turns into a use at
+	// that time.
+	inline void Touch();
+
+	// Records that the state was reached during the given step of a
+	// multi-run scan (see Specific_RE_Matcher::LongestMatches()).
+	// Returns false if it already was.  Steps must be unique and
+	// non-zero across scans.
+	bool StampStep(uint64_t step)
+		{
+		if ( last_step == step )
+			return false;
+
+		last_step = step;
+		return true;
+		}
+
 protected:
 	friend class DFA_State_Cache;
+	friend class DFA_Machine;
 
 	DFA_State* ComputeXtion(int sym, DFA_Machine* machine);
+	bool ComputeLoopExits(DFA_Machine* machine);
+	void BuildDenseXtions(DFA_Machine* machine);
+	void UpdateDenseXtions(DFA_Machine* machine);
 	void AppendIfNew(int sym, int_list* sym_list);
 
 	int state_num;
@@ -69,11 +140,26 @@ protected:
 	EquivClass* meta_ec; // which ec's make same transition
 	DFA_State* mark;
 
+	// Flags the bytes leaving this state, or nil if not computed (yet).
+	u_char* loop_exits;
+	int loop_exit_byte; // the only byte leaving the state, or -1
+	unsigned int num_self_loops;
+	bool loop_exits_checked;
+
+	DFA_Dense_Xtions* dense; // nil if not built (yet)
+	unsigned int num_visits;
+
+	uint64_t last_use; // DFA_Machine::Clock() when last used
+	bool referenced; // reached since the last eviction
+	uint64_t last_step; // see StampStep()
+
 	static unsigned int transition_counter; // see Xtion()
 	};
 
 using DigestStr = std::basic_string<u_char>;
 
+struct DFA_Metrics;
+
 class DFA_State_Cache
 	{
 public:
@@ -88,6 +174,17 @@ public:
 
 	int NumEntries() const { return states.size(); }
 
+	// Returns the number of bytes used by the cached states.
+	uint64_t Memory() const { return mem; }
+
+	// Accounts for memory allocated (or, if negative, released) by one
+	// of the states.
+	void AddMemory(int64_t bytes);
+
+	// Sets the label under which the cache reports its telemetry. All
+	// caches with the same label share their metrics.
+	void SetMetricsLabel(const std::string& label);
+
 	struct Stats
 		{
 		// Sum of all NFA states
@@ -98,13 +195,28 @@ public:
 		unsigned int mem;
 		unsigned int hits;
 		unsigned int misses;
+		unsigned int evictions;
 		};
 
 	void GetStats(Stats* s);
 
 private:
+	friend class DFA_Machine;
+
+	// Removes the given states from the cache and releases them. Any
+	// transitions of the remaining states into them are reset so that
+	// they get recomputed on demand.
+	void Evict(const std::set<DFA_State*>& evict);
+
+	// Adjusts the memory accounting by the given (signed) amount.
+	void UpdateMemory(int64_t delta);
+
 	int hits; // Statistics
 	int misses;
+	int evictions;
+	uint64_t mem;
+
+	DFA_Metrics* metrics;
 
 	// Hash indexed by NFA states (MD5s of them, actually).
 	std::map<DigestStr, DFA_State*> states;
@@ -122,8 +234,54 @@ public:
 
 	DFA_State_Cache* Cache() { return dfa_state_cache; }
 
+	// Sets the label under which the machine reports its state cache
+	// metrics through the telemetry framework.
+	void SetMetricsLabel(const std::string& label) { dfa_state_cache->SetMetricsLabel(label); }
+
 	int Rep(int sym);
 
+	// Limits the memory used by the DFA states of all machines to roughly
+	// the given number of bytes, with 0 meaning no limit. Once exceeded,
+	// the least recently used states are evicted by the next call to
+	// CheckMemoryBudget(). Their transitions get recomputed on demand.
+	static void SetMemoryBudget(uint64_t bytes)
+		{
+		memory_budget = bytes;
+		evict_threshold = 0;
+		}
+
+	// Returns the memory used by the DFA states of all machines.
+	static uint64_t TotalMemory() { return total_memory; }
+
+	// Advances the clock used for tracking state usage and evicts states
+	// if we're above the memory budget. Must only be called while no
+	// DFA_State pointers are held other than those Ref()'d by the holder.
+	//
+	// If states that can't be evicted keep us above the budget, we don't
+	// try again until memory has grown by another quarter of the budget,
+	// rather than scanning all states on every call without result.
+	static void CheckMemoryBudget()
+		{
+		++clock;
+
+		if ( memory_budget && total_memory > std::max(memory_budget, evict_threshold) )
+			EvictStates();
+		}
+
+	static uint64_t Clock() { return clock; }
+
+	// Appends all transitions computed so far to xtions, as pairs of
+	// state index and equivalence class. States are numbered in the
+	// order in which they are first reached, starting with the start
+	// state, so that ReplayXtions() can recreate them on another
+	// machine built from the same patterns.
+	void RecordXtions(std::vector<uint32_t>* xtions);
+
+	// Computes the transitions recorded by RecordXtions(); n is the
+	// number of pairs. Returns false if they don't fit this machine, in
+	// which case any transitions computed so far remain valid.
+	bool ReplayXtions(const uint32_t* xtions, size_t n);
+
 	void Describe(ODesc* d) const override;
 	void Dump(FILE* f);
 
@@ -142,14 +300,93 @@ protected:
 	DFA_State_Cache* dfa_state_cache;
 
 	NFA_Machine* nfa;
+
+private:
+	// Evicts least recently used states across all machines until we're
+	// sufficiently below the memory budget.
+	static void EvictStates();
+
+	static uint64_t memory_budget;
+	static uint64_t evict_threshold; // 0 while eviction reaches its target
+	static std::atomic<uint64_t> total_memory; // machines may get built concurrently
+	static uint64_t clock;
 	};
 
+inline void DFA_State::Touch()
+	{
+	last_use = DFA_Machine::Clock();
+	}
+
 inline DFA_State* DFA_State::Xtion(int sym, DFA_Machine* machine)
 	{
-	if ( xtions[sym] == DFA_UNCOMPUTED_STATE_PTR )
+	DFA_State* next = xtions[sym];
+
+	if ( next == DFA_UNCOMPUTED_STATE_PTR )
 		return ComputeXtion(sym, machine);
-	else
-		return xtions[sym];
+
+	if ( next )
+		next->referenced = true;
+
+	return next;
+	}
+
+inline bool DFA_State::HasLoopExits(DFA_Machine* machine)
+	{
+	if ( loop_exits_checked )
+		return loop_exits != nullptr;
+
+	if ( ++num_self_loops < DFA_LOOP_EXITS_THRESHOLD )
+		return false;
+
+	return ComputeLoopExits(machine);
+	}
+
+inline int DFA_State::SkipLoop(const u_char* data, int len) const
+	{
+	if ( loop_exit_byte >= 0 )
+		{
+		const void* p = memchr(data, loop_exit_byte, len);
+		return p ? static_cast<const u_char*>(p) - data : len;
+		}
+
+	int i = 0;
+
+	while ( i < len && ! loop_exits[data[i]] )
+		++i;
+
+	return i;
+	}
+
+inline void DFA_State::Visit(DFA_Machine* machine)
+	{
+	if ( ! dense && ++num_visits == DFA_DENSE_THRESHOLD )
+		BuildDenseXtions(machine);
+	}
+
+inline int DFA_State::StepDense(DFA_State** state, const u_char* data, int len)
+	{
+	DFA_State* s = *state;
+	int i = 0;
+
+	// Accepting states never show up in the tables, so there's nothing
+	// to check per byte beyond following the transition.
+	while ( i < len )
+		{
+		DFA_State* next = s->dense->xtions[data[i]];
+
+		if ( ! next )
+			break;
+
+		s = next;
+		s->referenced = true;
+		++i;
+
+		if ( ! s->dense )
+			break;
+		}
+
+	*state = s;
+	return i;
 	}
 
 	} // namespace zeek::detail
@@ -453,6 +453,60 @@ TEST_CASE("dict iterator invalidation")
 	delete key3;
 	}
 
+TEST_CASE("dict many keys")
+	{
+	PDict<uint32_t> dict;
+
+	// Enough entries for several resizes, with keys both short enough to
+	// be stored inline and longer ones.
+	constexpr int num_keys = 3000;
+	std::vector<uint32_t> vals(num_keys);
+
+	auto make_key = [](uint32_t i)
+	{
+		uint32_t k[6] = {i, i * 7, i * 13, i * 31, i * 61, i * 127};
+		size_t n = (i % 3 == 0) ? 1 : ((i % 3 == 1) ? 4 : 6);
+		return detail::HashKey(static_cast<const void*>(k), n * sizeof(k[0]));
+	};
+
+	for ( int i = 0; i < num_keys; ++i )
+		{
+		vals[i] = i;
+		auto key = make_key(i);
+		dict.Insert(&key, &vals[i]);
+
+		// Look up an earlier key while the table may be mid-remap.
+		auto prev = make_key(i / 2);
+		auto v = dict.Lookup(&prev);
+		REQUIRE(v);
+		CHECK(*v == uint32_t(i / 2));
+		}
+
+	CHECK(dict.Length() == num_keys);
+
+	for ( int i = 0; i < num_keys; i += 2 )
+		{
+		auto key = make_key(i);
+		CHECK(dict.Remove(&key) == &vals[i]);
+		}
+
+	CHECK(dict.Length() == num_keys / 2);
+
+	for ( int i = 0; i < num_keys; ++i )
+		{
+		auto key = make_key(i);
+		auto v = dict.Lookup(&key);
+
+		if ( i % 2 == 0 )
+			CHECK(v == nullptr);
+		else
+			{
+			REQUIRE(v);
+			CHECK(*v == uint32_t(i));
+			}
+		}
+	}
+
 // private
 void generic_delete_func(void* v)
 	{
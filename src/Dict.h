@@ -5,10 +5,15 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <memory>
 #include <vector>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "zeek/Hash.h"
 #include "zeek/Reporter.h"
 
@@ -66,6 +71,41 @@ constexpr uint8_t DICT_THRESHOLD_BITS = 3;
 // bucket at which to start looking for the next value to return.
 constexpr uint16_t TOO_FAR_TO_REACH = 0xFFFF;
 
+// Keys up to this size are stored directly in their DictEntry rather than
+// in a separate allocation.  This covers addresses, the most common keys
+// for large tables.
+constexpr int DICT_INLINE_KEY_SIZE = 16;
+
+// Alongside the table, the dictionary keeps one control byte per slot:
+// DICT_CTRL_EMPTY for an empty slot, or else the top 7 bits of the
+// entry's hash.  Lookups compare a whole group of control bytes against
+// the fragment of the hash they're looking for at once, and only look at
+// the entries whose fragment matches.
+constexpr uint8_t DICT_CTRL_EMPTY = 0x80;
+constexpr int DICT_CTRL_GROUP = 16;
+
+inline uint8_t DictCtrlFragment(hash_t h)
+	{
+	return static_cast<uint8_t>((h & HASH_MASK) >> 25);
+	}
+
+// Returns a mask with bit i set if ctrl[i] equals b, for each of the
+// DICT_CTRL_GROUP control bytes starting at ctrl.
+inline uint32_t DictCtrlMatch(const uint8_t* ctrl, uint8_t b)
+	{
+#ifdef __SSE2__
+	auto group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+	auto eq = _mm_cmpeq_epi8(group, _mm_set1_epi8(static_cast<char>(b)));
+	return static_cast<uint32_t>(_mm_movemask_epi8(eq));
+#else
+	uint32_t mask = 0;
+	for ( int i = 0; i < DICT_CTRL_GROUP; ++i )
+		if ( ctrl[i] == b )
+			mask |= 1U << i;
+	return mask;
+#endif
+	}
+
 /**
  * An entry stored in the dictionary.
  */
@@ -79,8 +119,8 @@ public:
 	// Distance from the expected position in the table. 0xFFFF means that the entry is empty.
 	uint16_t distance = TOO_FAR_TO_REACH;
 
-	// The size of the key. Less than 8 bytes we'll store directly in the entry, otherwise we'll
-	// store it as a pointer. This avoids extra allocations if we can help it.
+	// The size of the key. Up to DICT_INLINE_KEY_SIZE bytes we'll store directly in the entry,
+	// otherwise we'll store it as a pointer. This avoids extra allocations if we can help it.
 	uint16_t key_size = 0;
 
 	// Lower 4 bytes of the 8-byte hash, which is used to calculate the position in the table.
@@ -88,7 +128,7 @@ public:
 
 	T* value = nullptr;
 		union {
-		char key_here[8]; // hold key len<=8. when over 8, it's a pointer to real keys.
+		char key_here[DICT_INLINE_KEY_SIZE]; // holds short keys, otherwise use the pointer.
 		char* key;
 		};
 
@@ -99,7 +139,7 @@ public:
 		if ( ! arg_key )
 			return;
 
-		if ( key_size <= 8 )
+		if ( key_size <= DICT_INLINE_KEY_SIZE )
 			{
 			memcpy(key_here, arg_key, key_size);
 			if ( ! copy_key )
@@ -135,12 +175,12 @@ public:
 
 	void Clear()
 		{
-		if ( key_size > 8 )
+		if ( key_size > DICT_INLINE_KEY_SIZE )
 			delete[] key;
 		SetEmpty();
 		}
 
-	const char* GetKey() const { return key_size <= 8 ? key_here : key; }
+	const char* GetKey() const { return key_size <= DICT_INLINE_KEY_SIZE ? key_here : key; }
 	std::unique_ptr<detail::HashKey> GetHashKey() const
 		{
 		return std::make_unique<detail::HashKey>(GetKey(), key_size, hash);
@@ -514,6 +554,12 @@ private:
  * The dictionary is effectively a hashmap from hashed keys to values. The dictionary owns
  * the keys but not the values. The dictionary size will be bounded at around 100K. 1M
  * entries is the absolute limit. Only Connections use that many entries, and that is rare.
+ *
+ * In addition to the table of entries, the dictionary keeps an array of control bytes, one
+ * per slot, holding a fragment of each entry's hash (see DictCtrlMatch()). Lookups use these
+ * to check a group of slots at once, SwissTable-style, so that they only need to touch the
+ * entries that likely match. The layout of the entries themselves, and thus iteration, is
+ * unaffected.
  */
 template <typename T> class Dictionary
 	{
@@ -780,6 +826,8 @@ public:
 				}
 			free(table);
 			table = nullptr;
+			free(ctrl);
+			ctrl = nullptr;
 			}
 
 		if ( order )
@@ -1171,6 +1219,25 @@ private:
 		table = (detail::DictEntry<T>*)malloc(sizeof(detail::DictEntry<T>) * ExpectedCapacity());
 		for ( int i = Capacity() - 1; i >= 0; i-- )
 			table[i].SetEmpty();
+
+		// The control bytes extend a group past the end of the table, so
+		// lookups can always load a full group.
+		ctrl = (uint8_t*)malloc(ExpectedCapacity() + detail::DICT_CTRL_GROUP);
+		memset(ctrl, detail::DICT_CTRL_EMPTY, ExpectedCapacity() + detail::DICT_CTRL_GROUP);
+		}
+
+	// Places an entry at the given position, updating its control byte.
+	void SetEntry(int position, const detail::DictEntry<T>& entry)
+		{
+		table[position] = entry;
+		ctrl[position] = detail::DictCtrlFragment(entry.hash);
+		}
+
+	// Empties the given position, updating its control byte.
+	void SetEmptyAt(int position)
+		{
+		table[position].SetEmpty();
+		ctrl[position] = detail::DICT_CTRL_EMPTY;
 		}
 
 	// Lookup
@@ -1245,12 +1312,46 @@ private:
 	                int* insert_position = nullptr, int* insert_distance = nullptr)
 		{
 		ASSERT(begin >= 0 && begin < Buckets());
+
+		// Look for the key a group of slots at a time.  Its cluster can't
+		// extend past the first empty slot, nor past an entry of a later
+		// bucket, as buckets never decrease across consecutive entries.
+		auto fragment = detail::DictCtrlFragment(hash);
+
+		for ( int g = begin; g < end; g += detail::DICT_CTRL_GROUP )
+			{
+			int n = std::min(end - g, int(detail::DICT_CTRL_GROUP));
+			uint32_t in_range = (1U << n) - 1;
+			uint32_t empties = detail::DictCtrlMatch(ctrl + g, detail::DICT_CTRL_EMPTY) & in_range;
+
+			if ( empties )
+				// Lowest empty slot onwards is out of range.
+				in_range &= (empties & -empties) - 1;
+
+			uint32_t matches = detail::DictCtrlMatch(ctrl + g, fragment) & in_range;
+
+			while ( matches )
+				{
+				int i = g + __builtin_ctz(matches);
+				if ( BucketByPosition(i) == begin && table[i].Equal((char*)key, key_size, hash) )
+					return i;
+
+				matches &= matches - 1;
+				}
+
+			if ( empties || n < detail::DICT_CTRL_GROUP ||
+			     BucketByPosition(g + detail::DICT_CTRL_GROUP - 1) > begin )
+				break;
+			}
+
+		if ( ! insert_position && ! insert_distance )
+			return -1;
+
+		// Not found; locate where it would go.
 		int i = begin;
-		for ( ; i < end && ! table[i].Empty() && BucketByPosition(i) <= begin; i++ )
-			if ( BucketByPosition(i) == begin && table[i].Equal((char*)key, key_size, hash) )
-				return i;
+		while ( i < end && ! table[i].Empty() && BucketByPosition(i) <= begin )
+			i++;
 
-		// no such cluster, or not found in the cluster.
 		if ( insert_position )
 			*insert_position = i;
 
@@ -1301,14 +1402,14 @@ private:
 				ASSERT(insert_position == Capacity());
 				SizeUp(); // copied all the items to new table. as it's just copying without
 				          // remapping, insert_position is now empty.
-				table[insert_position] = entry;
+				SetEntry(insert_position, entry);
 				if ( last_affected_position )
 					*last_affected_position = insert_position;
 				return;
 				}
 			if ( table[insert_position].Empty() )
 				{ // the condition to end the loop.
-				table[insert_position] = entry;
+				SetEntry(insert_position, entry);
 				if ( last_affected_position )
 					*last_affected_position = insert_position;
 				return;
@@ -1320,7 +1421,7 @@ private:
 			t.distance += next - insert_position;
 
 			// swap
-			table[insert_position] = entry;
+			SetEntry(insert_position, entry);
 			entry = t;
 			insert_position = next; // append to the end of the current cluster.
 			}
@@ -1379,13 +1480,13 @@ private:
 				{
 				// no next cluster to fill, or next position is empty or next position is already in
 				// perfect bucket.
-				table[position].SetEmpty();
+				SetEmptyAt(position);
 				if ( last_affected_position )
 					*last_affected_position = position;
 				return entry;
 				}
 			int next = TailOfClusterByPosition(position + 1);
-			table[position] = table[next];
+			SetEntry(position, table[next]);
 			table[position].distance -= next - position; // distance improved for the item.
 			position = next;
 			}
@@ -1496,6 +1597,10 @@ private:
 		for ( int i = prev_capacity; i < capacity; i++ )
 			table[i].SetEmpty();
 
+		ctrl = (uint8_t*)realloc(ctrl, capacity + detail::DICT_CTRL_GROUP);
+		memset(ctrl + prev_capacity, detail::DICT_CTRL_EMPTY,
+		       capacity - prev_capacity + detail::DICT_CTRL_GROUP);
+
 		// REmap from last to first in reverse order. SizeUp can be triggered by 2 conditions, one
 		// of which is that the last space in the table is occupied and there's nowhere to put new
 		// items. In this case, the table doubles in capacity and the item is put at the
@@ -1651,6 +1756,9 @@ private:
 
 	dict_delete_func delete_func = nullptr;
 	detail::DictEntry<T>* table = nullptr;
+
+	// Control bytes parallel to the table, see DictCtrlMatch().
+	uint8_t* ctrl = nullptr;
 	std::vector<RobustDictIterator<T>*>* iterators = nullptr;
 
 	// Ordered dictionaries keep the order based on some criteria, by default the order of
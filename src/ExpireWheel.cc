@@ -0,0 +1,193 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/ExpireWheel.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail
+	{
+
+ExpireWheel::ExpireWheel(double arg_base, double arg_granularity)
+	: base(arg_base), granularity(arg_granularity)
+	{
+	}
+
+int64_t ExpireWheel::TickAfter(double t) const
+	{
+	double ticks = std::floor((t - base) / granularity) + 1;
+
+	// Far enough in the future to not matter.
+	constexpr double max_ticks = double(std::numeric_limits<int64_t>::max() / 2);
+
+	if ( ticks > max_ticks )
+		return int64_t(max_ticks);
+
+	if ( ticks < 0 )
+		return 0;
+
+	return int64_t(ticks);
+	}
+
+int64_t ExpireWheel::Add(const void* key, int key_size, hash_t hash, int64_t tick)
+	{
+	int64_t earliest = have_draining ? cur_tick + 1 : cur_tick;
+
+	if ( tick < earliest )
+		tick = earliest;
+
+	AddRecord(key, key_size, hash, tick);
+	++num_keys;
+
+	return tick;
+	}
+
+void ExpireWheel::AddRecord(const void* key, int key_size, hash_t hash, int64_t tick)
+	{
+	auto& slot = slots[tick % NUM_SLOTS];
+	auto offset = slot.size();
+	slot.resize(offset + RecordSize(key_size));
+
+	Record r{tick, static_cast<uint32_t>(hash), static_cast<uint32_t>(key_size)};
+	memcpy(slot.data() + offset, &r, sizeof(r));
+	memcpy(slot.data() + offset + sizeof(r), key, key_size);
+	}
+
+bool ExpireWheel::Next(double t, const void*& key, int& key_size, hash_t& hash, int64_t& tick)
+	{
+	while ( true )
+		{
+		if ( ! have_draining )
+			{
+			if ( base + cur_tick * granularity > t )
+				// Nothing's due yet.
+				return false;
+
+			// If we've fallen more than a revolution behind, every
+			// slot is due.  Rather than visiting them repeatedly,
+			// just go through the latest revolution, which covers
+			// all of them.
+			auto latest = TickAfter(t) - 1;
+			if ( latest - cur_tick >= NUM_SLOTS )
+				cur_tick = latest - NUM_SLOTS + 1;
+
+			// The buffer of the previous tick, now empty, moves
+			// into the slot.  So that a burst's worth of capacity
+			// doesn't keep circulating among the slots, drop it
+			// once it's well beyond what the slot held.
+			auto& slot = slots[cur_tick % NUM_SLOTS];
+
+			if ( draining.capacity() > MAX_IDLE_CAPACITY &&
+			     draining.capacity() > 2 * slot.size() )
+				std::vector<char>().swap(draining);
+
+			draining.swap(slot);
+			drain_pos = 0;
+			have_draining = true;
+			}
+
+		while ( drain_pos < draining.size() )
+			{
+			Record r;
+			memcpy(&r, draining.data() + drain_pos, sizeof(r));
+
+			const char* k = draining.data() + drain_pos + sizeof(r);
+			drain_pos += RecordSize(r.key_size);
+
+			if ( r.tick > cur_tick )
+				{
+				// Belongs to a later revolution.
+				AddRecord(k, r.key_size, r.hash, r.tick);
+				continue;
+				}
+
+			--num_keys;
+
+			key = k;
+			key_size = r.key_size;
+			hash = r.hash;
+			tick = r.tick;
+
+			return true;
+			}
+
+		draining.clear();
+		have_draining = false;
+		++cur_tick;
+		}
+	}
+
+void ExpireWheel::Clear()
+	{
+	for ( auto& s : slots )
+		{
+		s.clear();
+		s.shrink_to_fit();
+		}
+
+	draining.clear();
+	drain_pos = 0;
+	have_draining = false;
+	num_keys = 0;
+	}
+
+TEST_CASE("expire wheel")
+	{
+	ExpireWheel w(100.0, 10.0);
+
+	CHECK(w.TickAfter(100.0) == 1);
+	CHECK(w.TickAfter(109.9) == 1);
+	CHECK(w.TickAfter(110.0) == 2);
+	CHECK(w.TickAfter(50.0) == 0);
+
+	uint32_t k1 = 1, k2 = 2, k3 = 3;
+	w.Add(&k1, sizeof(k1), 11, w.TickAfter(105.0));
+	w.Add(&k2, sizeof(k2), 22, w.TickAfter(125.0));
+
+	// Lands in the same slot as k1, one revolution later.
+	w.Add(&k3, sizeof(k3), 33, w.TickAfter(105.0 + ExpireWheel::NUM_SLOTS * 10.0));
+
+	CHECK(w.Size() == 3);
+
+	const void* key;
+	int key_size;
+	hash_t hash;
+	int64_t tick;
+
+	// Nothing's started by then.
+	CHECK(! w.Next(105.0, key, key_size, hash, tick));
+
+	REQUIRE(w.Next(110.0, key, key_size, hash, tick));
+	CHECK(key_size == sizeof(k1));
+	CHECK(memcmp(key, &k1, sizeof(k1)) == 0);
+	CHECK(hash == 11);
+	CHECK(tick == 1);
+	CHECK(! w.Next(110.0, key, key_size, hash, tick));
+
+	// Rescheduling while draining goes to a later tick.
+	CHECK(w.Add(&k1, sizeof(k1), 11, 0) > 1);
+
+	REQUIRE(w.Next(140.0, key, key_size, hash, tick));
+	CHECK(memcmp(key, &k1, sizeof(k1)) == 0);
+	REQUIRE(w.Next(140.0, key, key_size, hash, tick));
+	CHECK(memcmp(key, &k2, sizeof(k2)) == 0);
+	CHECK(tick == 3);
+	CHECK(! w.Next(140.0, key, key_size, hash, tick));
+	CHECK(w.Size() == 1);
+
+	// Far ahead, the wheel catches up in one revolution.
+	REQUIRE(w.Next(1e9, key, key_size, hash, tick));
+	CHECK(memcmp(key, &k3, sizeof(k3)) == 0);
+	CHECK(! w.Next(1e9, key, key_size, hash, tick));
+	CHECK(w.Size() == 0);
+
+	w.Add(&k1, sizeof(k1), 11, w.TickAfter(2e9));
+	w.Clear();
+	CHECK(w.Size() == 0);
+	CHECK(! w.Next(3e9, key, key_size, hash, tick));
+	}
+
+	} // namespace zeek::detail
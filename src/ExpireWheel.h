@@ -0,0 +1,103 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// A hashed timing wheel of table keys, bucketed by the time at which the
+// corresponding entries might expire.  TableVal uses it so that expiration
+// only needs to look at entries that are (possibly) due, rather than at
+// every entry of the table.
+//
+// The wheel has a fixed number of slots, each covering "granularity"
+// seconds of a revolution.  Keys scheduled more than one revolution ahead
+// share their slot with earlier ones and are passed over until their
+// revolution comes around.
+//
+// Keys never get removed from the wheel other than by Next().  The wheel
+// thus can hold keys whose table entries have since been deleted, or
+// rescheduled for a different tick.  It's up to the caller to tell those
+// apart, for which Next() returns the tick for which it scheduled the key.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "zeek/Hash.h"
+
+namespace zeek::detail
+	{
+
+class ExpireWheel
+	{
+public:
+	static constexpr int NUM_SLOTS = 256;
+
+	// "base" is the time at which tick 0 starts.
+	ExpireWheel(double base, double granularity);
+
+	double Granularity() const { return granularity; }
+
+	// Returns the time at which the next tick that Next() hasn't yet
+	// started working on begins.
+	double NextTickStart() const
+		{
+		return base + (have_draining ? cur_tick + 1 : cur_tick) * granularity;
+		}
+
+	// Returns the first tick starting after time t, i.e., the one at
+	// which something due at t should be looked at.
+	int64_t TickAfter(double t) const;
+
+	// Schedules the given key for the given tick, though no earlier than
+	// the one after the tick Next() is currently working on.  Returns the
+	// tick actually used.
+	int64_t Add(const void* key, int key_size, hash_t hash, int64_t tick);
+
+	// Returns the next key scheduled for a tick that has started by time
+	// t, if any.  Otherwise returns false, and the next call starts from
+	// where this one left off.  The returned key remains valid until the
+	// next call to Next() or Clear().
+	bool Next(double t, const void*& key, int& key_size, hash_t& hash, int64_t& tick);
+
+	// Removes all keys.
+	void Clear();
+
+	// The number of keys in the wheel, including stale ones.
+	size_t Size() const { return num_keys; }
+
+private:
+	struct Record
+		{
+		int64_t tick;
+		uint32_t hash; // dictionaries only use the lower 32 bits
+		uint32_t key_size;
+		// The key follows, padded to keep records aligned.
+		};
+
+	// Emptied slot buffers up to this capacity get reused regardless of
+	// how much their next slot needs.
+	static constexpr size_t MAX_IDLE_CAPACITY = 4096;
+
+	static size_t RecordSize(int key_size)
+		{
+		return sizeof(Record) + ((key_size + 7) & ~7);
+		}
+
+	void AddRecord(const void* key, int key_size, hash_t hash, int64_t tick);
+
+	double base;
+	double granularity;
+
+	// Each slot holds its records back-to-back.
+	std::vector<char> slots[NUM_SLOTS];
+
+	// The tick Next() is currently working on, and the records of its
+	// slot, which it moved out of the slot so that rescheduling can add
+	// to it safely.
+	int64_t cur_tick = 0;
+	std::vector<char> draining;
+	size_t drain_pos = 0;
+	bool have_draining = false;
+
+	size_t num_keys = 0;
+	};
+
+	} // namespace zeek::detail
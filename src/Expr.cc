@@ -1088,10 +1088,10 @@ ValPtr BinaryExpr::PatternFold(Val* v1, Val* v2) const
 	if ( tag != EXPR_AND && tag != EXPR_OR )
 		BadTag("BinaryExpr::PatternFold");
 
-	RE_Matcher* res = tag == EXPR_AND ? RE_Matcher_conjunction(re1, re2)
-	                                  : RE_Matcher_disjunction(re1, re2);
+	auto res = tag == EXPR_AND ? cached_RE_Matcher_conjunction(re1, re2)
+	                           : cached_RE_Matcher_disjunction(re1, re2);
 
-	return make_intrusive<PatternVal>(res);
+	return make_intrusive<PatternVal>(std::move(res));
 	}
 
 ValPtr BinaryExpr::SetFold(Val* v1, Val* v2) const
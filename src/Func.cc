@@ -968,6 +968,7 @@ void init_primary_bifs()
 	ProcStats = id::find_type<RecordType>("ProcStats");
 	NetStats = id::find_type<RecordType>("NetStats");
 	MatcherStats = id::find_type<RecordType>("MatcherStats");
+	PatternCacheStats = id::find_type<RecordType>("PatternCacheStats");
 	ConnStats = id::find_type<RecordType>("ConnStats");
 	ReassemblerStats = id::find_type<RecordType>("ReassemblerStats");
 	DNSStats = id::find_type<RecordType>("DNSStats");
@@ -0,0 +1,437 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/LiteralPrefilter.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail
+	{
+
+// Parses the escape sequence following a backslash, advancing s beyond
+// it.  Returns -1 for sequences the pattern scanner may read differently
+// than we would.
+static int parse_escape(const char*& s)
+	{
+	char c = *s;
+
+	if ( c == 'x' )
+		{
+		if ( ! isxdigit(static_cast<u_char>(s[1])) || ! isxdigit(static_cast<u_char>(s[2])) )
+			return -1;
+
+		int val = std::stoi(std::string(s + 1, 2), nullptr, 16);
+		s += 3;
+		return val;
+		}
+
+	if ( c >= '0' && c <= '7' )
+		{
+		int val = 0;
+		int n = 0;
+
+		while ( s[n] >= '0' && s[n] <= '7' )
+			val = val * 8 + (s[n++] - '0');
+
+		// The scanner takes all the digits, but only interprets three.
+		if ( n > 3 || val > 255 )
+			return -1;
+
+		s += n;
+		return val;
+		}
+
+	int val;
+
+	switch ( c )
+		{
+		case 'a':
+			val = '\a';
+			break;
+		case 'b':
+			val = '\b';
+			break;
+		case 'f':
+			val = '\f';
+			break;
+		case 'n':
+			val = '\n';
+			break;
+		case 'r':
+			val = '\r';
+			break;
+		case 't':
+			val = '\t';
+			break;
+		case 'v':
+			val = '\v';
+			break;
+
+		default:
+			// Escaped punctuation stands for itself.
+			if ( ! c || c == '\n' || isalnum(static_cast<u_char>(c)) )
+				return -1;
+
+			val = c;
+			break;
+		}
+
+	++s;
+	return val;
+	}
+
+// Returns a pointer to the closing quote of the string starting at s, or
+// nil if there's none.
+static const char* skip_quoted(const char* s)
+	{
+	for ( ; *s && *s != '"'; ++s )
+		if ( *s == '\\' && s[1] )
+			++s;
+
+	return *s ? s : nullptr;
+	}
+
+// Returns a pointer to the closing bracket of the character class whose
+// contents start at s, or nil if there's none.
+static const char* skip_ccl(const char* s)
+	{
+	if ( *s == '^' )
+		++s;
+
+	if ( *s == ']' )
+		++s;
+
+	for ( ; *s && *s != ']'; ++s )
+		{
+		if ( *s == '\\' && s[1] )
+			++s;
+
+		else if ( s[0] == '[' && s[1] == ':' )
+			{
+			const char* end = strstr(s, ":]");
+
+			if ( ! end )
+				return nullptr;
+
+			s = end + 1;
+			}
+		}
+
+	return *s ? s : nullptr;
+	}
+
+bool LiteralPrefilter::LeadingLiteral(const char* pattern, std::string* literal, bool* nocase)
+	{
+	const char* s = pattern;
+
+	// Signatures with the "i" flag come wrapped into such a group.
+	*nocase = strncmp(s, "(?i:", 4) == 0;
+
+	if ( *nocase )
+		s += 4;
+
+	if ( *s == '^' )
+		++s;
+
+	if ( strncmp(s, ".*", 2) != 0 )
+		return false;
+
+	s += 2;
+	literal->clear();
+
+	while ( *s )
+		{
+		size_t item_start = literal->size();
+
+		if ( *s == '"' )
+			{
+			const char* end = skip_quoted(s + 1);
+
+			if ( ! end )
+				return false;
+
+			for ( ++s; s < end; )
+				{
+				int c = *s == '\\' ? parse_escape(++s) : static_cast<u_char>(*s++);
+
+				if ( c < 0 )
+					{
+					// Whatever follows the string may apply to all
+					// of it, so we can't keep a part.
+					literal->resize(item_start);
+					s = end;
+					break;
+					}
+
+				literal->push_back(static_cast<char>(c));
+				}
+
+			if ( *s != '"' || literal->size() == item_start )
+				break;
+
+			++s;
+			}
+
+		else if ( *s == '\\' )
+			{
+			int c = parse_escape(++s);
+
+			if ( c < 0 )
+				break;
+
+			literal->push_back(static_cast<char>(c));
+			}
+
+		else if ( strchr("^\"{$[|*+?.()}", *s) )
+			break;
+
+		else
+			literal->push_back(*s++);
+
+		// These may match the item zero times.  A "{" might start a
+		// named definition rather than a repeat count, but dropping
+		// the item is fine either way.
+		if ( *s == '*' || *s == '?' || *s == '{' )
+			{
+			literal->resize(item_start);
+			break;
+			}
+		}
+
+	if ( literal->empty() )
+		return false;
+
+	// An alternative on the top level would allow matches without the
+	// literal.
+	int depth = 0;
+
+	for ( ; *s; ++s )
+		{
+		switch ( *s )
+			{
+			case '\\':
+				if ( s[1] )
+					++s;
+				break;
+
+			case '"':
+				s = skip_quoted(s + 1);
+				if ( ! s )
+					return false;
+				break;
+
+			case '[':
+				s = skip_ccl(s + 1);
+				if ( ! s )
+					return false;
+				break;
+
+			case '(':
+				++depth;
+				break;
+
+			case ')':
+				--depth;
+				break;
+
+			case '|':
+				if ( depth <= 0 )
+					return false;
+				break;
+			}
+		}
+
+	return true;
+	}
+
+template <typename F> void LiteralPrefilter::ForEachHash(const u_char* block, F f) const
+	{
+	u_char variant[2];
+
+	for ( int c0 = 0; c0 < 256; ++c0 )
+		{
+		if ( fold[c0] != block[0] )
+			continue;
+
+		variant[0] = c0;
+
+		if ( block_size == 1 )
+			{
+			f(Hash(variant));
+			continue;
+			}
+
+		for ( int c1 = 0; c1 < 256; ++c1 )
+			{
+			if ( fold[c1] != block[1] )
+				continue;
+
+			variant[1] = c1;
+			f(Hash(variant));
+			}
+		}
+	}
+
+LiteralPrefilter::LiteralPrefilter(const std::vector<std::string>& arg_literals, bool nocase)
+	: literals(arg_literals)
+	{
+	for ( int c = 0; c < 256; ++c )
+		{
+		fold[c] = nocase ? tolower(c) : c;
+		first_bytes[c] = false;
+		}
+
+	// Beyond this, longer windows hardly skip more.
+	min_len = 32;
+
+	for ( auto& l : literals )
+		{
+		for ( auto& c : l )
+			c = static_cast<char>(fold[static_cast<u_char>(c)]);
+
+		min_len = std::min(min_len, static_cast<int>(l.size()));
+		}
+
+	for ( int c = 0; c < 256; ++c )
+		for ( const auto& l : literals )
+			if ( fold[c] == static_cast<u_char>(l[0]) )
+				first_bytes[c] = true;
+
+	block_size = std::min(2, min_len);
+	shift.assign(1 << HASH_BITS, min_len - block_size + 1);
+
+	for ( uint32_t i = 0; i < literals.size(); ++i )
+		{
+		auto l = reinterpret_cast<const u_char*>(literals[i].data());
+
+		for ( int j = block_size - 1; j < min_len; ++j )
+			ForEachHash(l + j - block_size + 1,
+			            [this, j](uint16_t h)
+			            {
+				            shift[h] = std::min(shift[h], static_cast<uint8_t>(min_len - 1 - j));
+			            });
+
+		ForEachHash(l + min_len - block_size,
+		            [this, i](uint16_t h) { candidates.emplace_back(h, i); });
+		}
+
+	std::sort(candidates.begin(), candidates.end());
+	candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+	}
+
+bool LiteralPrefilter::Verify(uint16_t h, const u_char* data, int len) const
+	{
+	auto it = std::lower_bound(candidates.begin(), candidates.end(), std::make_pair(h, uint32_t(0)));
+
+	for ( ; it != candidates.end() && it->first == h; ++it )
+		{
+		const auto& l = literals[it->second];
+		int n = std::min(len, static_cast<int>(l.size()));
+		int i = 0;
+
+		while ( i < n && fold[data[i]] == static_cast<u_char>(l[i]) )
+			++i;
+
+		if ( i == n )
+			return true;
+		}
+
+	return false;
+	}
+
+int LiteralPrefilter::Skip(const u_char* data, int len) const
+	{
+	int pos = 0;
+
+	while ( pos + min_len <= len )
+		{
+		uint16_t h = Hash(data + pos + min_len - block_size);
+
+		if ( int s = shift[h] )
+			{
+			pos += s;
+			continue;
+			}
+
+		if ( Verify(h, data + pos, len - pos) )
+			return pos;
+
+		++pos;
+		}
+
+	// Literals starting in the last few bytes may continue in the next
+	// chunk.  We don't bother verifying these.
+	while ( pos < len && ! first_bytes[data[pos]] )
+		++pos;
+
+	return pos;
+	}
+
+TEST_CASE("literal prefilter leading literal")
+	{
+	std::string l;
+	bool nocase;
+
+	CHECK(LiteralPrefilter::LeadingLiteral(".*foo", &l, &nocase));
+	CHECK(l == "foo");
+	CHECK_FALSE(nocase);
+
+	CHECK(LiteralPrefilter::LeadingLiteral("^.*GET /index[0-9]+\\.html", &l, &nocase));
+	CHECK(l == "GET /index");
+
+	CHECK(LiteralPrefilter::LeadingLiteral("(?i:.*\\x16\\x03\\.ab?c)", &l, &nocase));
+	CHECK(l == "\x16\x03.a");
+	CHECK(nocase);
+
+	CHECK(LiteralPrefilter::LeadingLiteral(".*\"a|b\"c(d|e)", &l, &nocase));
+	CHECK(l == "a|bc");
+
+	CHECK(LiteralPrefilter::LeadingLiteral(".*ab+", &l, &nocase));
+	CHECK(l == "ab");
+
+	CHECK(LiteralPrefilter::LeadingLiteral(".*ab[|]", &l, &nocase));
+	CHECK(l == "ab");
+
+	CHECK_FALSE(LiteralPrefilter::LeadingLiteral("foo", &l, &nocase));
+	CHECK_FALSE(LiteralPrefilter::LeadingLiteral(".*a*bc", &l, &nocase));
+	CHECK_FALSE(LiteralPrefilter::LeadingLiteral(".*\"ab\"?", &l, &nocase));
+	CHECK_FALSE(LiteralPrefilter::LeadingLiteral(".*foo|bar", &l, &nocase));
+	CHECK_FALSE(LiteralPrefilter::LeadingLiteral("(?i:.*foo|bar)", &l, &nocase));
+	CHECK_FALSE(LiteralPrefilter::LeadingLiteral(".*\\1234", &l, &nocase));
+	CHECK_FALSE(LiteralPrefilter::LeadingLiteral(".*(foo)", &l, &nocase));
+	}
+
+TEST_CASE("literal prefilter skip")
+	{
+	LiteralPrefilter f({"foobar", "bazq", "xyz"}, false);
+
+	auto skip = [&f](const char* s)
+	{
+		return f.Skip(reinterpret_cast<const u_char*>(s), strlen(s));
+	};
+
+	CHECK(skip("") == 0);
+	CHECK(skip("aaaaaaaaaaaaaaaa") == 16);
+	CHECK(skip("aaaaaaaaxyzaaaaa") == 8);
+	CHECK(skip("aaaafoobaaabazqa") == 11);
+	CHECK(skip("xybazq") == 2);
+
+	// Literals cut off at the end of the data may continue in the next
+	// chunk.
+	CHECK(skip("aaaaaaaafoob") == 8);
+	CHECK(skip("aaaaaaaaaaab") == 11);
+	CHECK(skip("aaaaaaaaaaax") == 11);
+	CHECK(skip("aaaaaaaaaaaa") == 12);
+
+	LiteralPrefilter nc({"Abc", "d"}, true);
+	CHECK(nc.MayStartWith('a'));
+	CHECK(nc.MayStartWith('D'));
+	CHECK(nc.Skip(reinterpret_cast<const u_char*>("xxaBC"), 5) == 2);
+	CHECK(nc.Skip(reinterpret_cast<const u_char*>("xxxxD"), 5) == 4);
+	CHECK(nc.Skip(reinterpret_cast<const u_char*>("xxxxx"), 5) == 5);
+	}
+
+	} // namespace zeek::detail
@@ -0,0 +1,90 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// A multi-literal search used to skip input that can't advance a DFA.
+//
+// Most signature patterns look like ".*<literal>...": while none of their
+// literals has started, the DFA merely cycles through the state for the
+// leading ".*".  The signature engine extracts each pattern's literal with
+// LeadingLiteral() and, for sets of patterns that all have one, lets the
+// RE_Match_State jump over bytes at which none of them can begin.
+//
+// The search is a Wu-Manber scan: a table indexed by (a hash of) the two
+// bytes at the end of a window as long as the shortest literal tells how
+// far the window may advance without missing any literal's start, so
+// skipping typically moves several bytes per lookup.  Windows that can't
+// be advanced get verified against the literals ending in that block.
+
+#pragma once
+
+#include <sys/types.h> // for u_char
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace zeek::detail
+	{
+
+class LiteralPrefilter
+	{
+public:
+	// Sets *literal to a string that all matches of the given signature
+	// pattern contain right after an unrestricted prefix, i.e., for a
+	// pattern of the form ".*<literal>...".  Sets *nocase if the literal
+	// is to be matched case-insensitively.  Returns false if there's no
+	// such literal, or if the pattern is too complex to tell.
+	static bool LeadingLiteral(const char* pattern, std::string* literal, bool* nocase);
+
+	// The literals must not be empty.  With nocase, they all match
+	// case-insensitively.
+	LiteralPrefilter(const std::vector<std::string>& literals, bool nocase);
+
+	// Returns true if one of the literals starts with the given byte.
+	bool MayStartWith(u_char c) const { return first_bytes[c]; }
+
+	// Returns the number of bytes at the beginning of data at none of
+	// which one of the literals starts.  Also stops at the beginning of
+	// a literal only partially contained in the data, as it may continue
+	// in the next chunk.
+	int Skip(const u_char* data, int len) const;
+
+	size_t NumLiterals() const { return literals.size(); }
+
+private:
+	static constexpr int HASH_BITS = 12;
+
+	// Hashes the input as is; with nocase, the tables hold entries for
+	// all case variants instead.
+	uint16_t Hash(const u_char* block) const
+		{
+		if ( block_size == 1 )
+			return block[0];
+
+		return ((block[0] << 4) ^ block[1]) & ((1 << HASH_BITS) - 1);
+		}
+
+	// Calls f with the hashes of all variants of the given (folded)
+	// block that compare equal to it.
+	template <typename F> void ForEachHash(const u_char* block, F f) const;
+
+	// Returns true if one of the literals whose shortest-length prefix
+	// ends in a block with hash h starts at data, possibly continuing
+	// beyond its end.
+	bool Verify(uint16_t h, const u_char* data, int len) const;
+
+	std::vector<std::string> literals; // folded if nocase
+	u_char fold[256]; // maps bytes to the case they are compared in
+	bool first_bytes[256];
+
+	int min_len; // of the literals
+	int block_size; // 2, or 1 if there's a literal of length 1
+
+	// Per block hash, how far the window may advance.  Zero for blocks
+	// that end a literal's prefix of min_len bytes.
+	std::vector<uint8_t> shift;
+
+	// The literals by the hash of the block ending that prefix, sorted.
+	std::vector<std::pair<uint16_t, uint32_t>> candidates;
+	};
+
+	} // namespace zeek::detail
@@ -326,8 +326,8 @@ NFA_Machine* make_alternate(NFA_Machine* m1, NFA_Machine* m2)
 
 NFA_state_list* epsilon_closure(NFA_state_list* states)
 	{
-	// We just keep one of this as it may get quite large.
-	static IntSet closuremap;
+	// We just keep one of this (per thread) as it may get quite large.
+	static thread_local IntSet closuremap;
 	closuremap.Clear();
 
 	NFA_state_list* closure = new NFA_state_list;
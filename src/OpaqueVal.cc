@@ -1024,6 +1024,39 @@ VectorValPtr ParaglobVal::Get(StringVal*& pattern)
 	return rval;
 	}
 
+VectorValPtr ParaglobVal::GetBatch(const VectorVal* inputs)
+	{
+	static auto string_vec_vec = id::find_type<VectorType>("string_vec_vec");
+	auto rval = make_intrusive<VectorVal>(string_vec_vec);
+
+	// Batches tend to repeat inputs (think popular DNS names), so look up
+	// each distinct string only once.  The results still get their own
+	// vectors, since script-land may modify them independently.
+	std::unordered_map<std::string, std::vector<std::string>> results;
+
+	for ( unsigned int i = 0; i < inputs->Size(); ++i )
+		{
+		auto matches = make_intrusive<VectorVal>(id::string_vec);
+
+		if ( inputs->Has(i) )
+			{
+			const String* s = inputs->StringAt(i);
+			std::string input(reinterpret_cast<const char*>(s->Bytes()), s->Len());
+
+			auto it = results.find(input);
+			if ( it == results.end() )
+				it = results.emplace(input, internal_paraglob->get(input)).first;
+
+			for ( const auto& m : it->second )
+				matches->Assign(matches->Size(), make_intrusive<StringVal>(m));
+			}
+
+		rval->Assign(i, std::move(matches));
+		}
+
+	return rval;
+	}
+
 bool ParaglobVal::operator==(const ParaglobVal& other) const
 	{
 	return *(this->internal_paraglob) == *(other.internal_paraglob);
@@ -397,6 +397,11 @@ class ParaglobVal : public OpaqueVal
 public:
 	explicit ParaglobVal(std::unique_ptr<paraglob::Paraglob> p);
 	VectorValPtr Get(StringVal*& pattern);
+
+	// Matches each string of a string_vec, returning a vector holding the
+	// matching patterns for each input in turn.  Holes in the input yield
+	// empty results.
+	VectorValPtr GetBatch(const VectorVal* inputs);
 	ValPtr DoClone(CloneState* state) override;
 	bool operator==(const ParaglobVal& other) const;
 
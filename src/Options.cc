@@ -204,6 +204,7 @@ static void print_analysis_help()
 	fprintf(stderr,
 	        "    profile-ZAM	generate to stdout a ZAM execution profile; implies -O ZAM\n");
 	fprintf(stderr, "    report-recursive	report on recursive functions and exit\n");
+	fprintf(stderr, "    report-ZAM-cache	report bodies loaded from/saved to ZEEK_ZAM_CACHE\n");
 	fprintf(stderr, "    xform	transform scripts to \"reduced\" form\n");
 
 	fprintf(stderr, "\n--optimize options when generating C++:\n");
@@ -260,6 +261,8 @@ static void set_analysis_option(const char* opt, Options& opts)
 		a_o.activate = a_o.gen_ZAM_code = a_o.profile_ZAM = true;
 	else if ( util::streq(opt, "report-C++") )
 		a_o.report_CPP = true;
+	else if ( util::streq(opt, "report-ZAM-cache") )
+		a_o.report_ZAM_cache = true;
 	else if ( util::streq(opt, "report-recursive") )
 		a_o.inliner = a_o.report_recursive = true;
 	else if ( util::streq(opt, "report-uncompilable") )
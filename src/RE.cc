@@ -12,6 +12,7 @@
 #include "zeek/DFA.h"
 #include "zeek/EquivClass.h"
 #include "zeek/Reporter.h"
+#include "zeek/RunState.h"
 #include "zeek/ZeekString.h"
 
 zeek::detail::CCL* zeek::detail::curr_ccl = nullptr;
@@ -34,9 +35,11 @@ Specific_RE_Matcher::Specific_RE_Matcher(match_type arg_mt, bool arg_multiline)
 	{
 	any_ccl = nullptr;
 	single_line_ccl = nullptr;
+	set_nfa = nullptr;
 	dfa = nullptr;
 	ecs = nullptr;
 	accepted = new AcceptingSet();
+	prefilter_state = nullptr;
 	}
 
 Specific_RE_Matcher::~Specific_RE_Matcher()
@@ -44,6 +47,8 @@ Specific_RE_Matcher::~Specific_RE_Matcher()
 	for ( int i = 0; i < ccl_list.length(); ++i )
 		delete ccl_list[i];
 
+	Unref(set_nfa);
+	Unref(prefilter_state);
 	Unref(dfa);
 	delete accepted;
 	}
@@ -142,6 +147,12 @@ bool Specific_RE_Matcher::Compile(bool lazy)
 
 	dfa = new DFA_Machine(nfa, EC());
 
+	// Keep the patterns of the scripts apart from those built at
+	// run-time, which share the default label.  Labels must not carry
+	// the patterns themselves, of which there's no bound.
+	if ( run_state::is_parsing )
+		dfa->SetMetricsLabel("script-patterns");
+
 	Unref(nfa);
 	nfa = nullptr;
 
@@ -151,13 +162,22 @@ bool Specific_RE_Matcher::Compile(bool lazy)
 	}
 
 bool Specific_RE_Matcher::CompileSet(const string_list& set, const int_list& idx)
+	{
+	if ( ! ParseSet(set, idx) )
+		return false;
+
+	BuildSetDFA();
+	return true;
+	}
+
+bool Specific_RE_Matcher::ParseSet(const string_list& set, const int_list& idx)
 	{
 	if ( (size_t)set.length() != idx.size() )
 		reporter->InternalError("compileset: lengths of sets differ");
 
 	rem = this;
 
-	NFA_Machine* set_nfa = nullptr;
+	NFA_Machine* alt_nfa = nullptr;
 
 	loop_over_list(set, i)
 		{
@@ -169,8 +189,8 @@ bool Specific_RE_Matcher::CompileSet(const string_list& set, const int_list& idx
 			{
 			reporter->Error("error compiling pattern /%s/", set[i]);
 
-			if ( set_nfa && set_nfa != nfa )
-				Unref(set_nfa);
+			if ( alt_nfa && alt_nfa != nfa )
+				Unref(alt_nfa);
 			else
 				Unref(nfa);
 
@@ -179,22 +199,66 @@ bool Specific_RE_Matcher::CompileSet(const string_list& set, const int_list& idx
 			}
 
 		nfa->FinalState()->SetAccept(idx[i]);
-		set_nfa = set_nfa ? make_alternate(nfa, set_nfa) : nfa;
+		alt_nfa = alt_nfa ? make_alternate(nfa, alt_nfa) : nfa;
 		}
 
 	// Prefix the expression with a "^?".
 	nfa = new NFA_Machine(new NFA_State(SYM_BOL, rem->EC()));
 	nfa->MakeOptional();
-	if ( set_nfa )
-		nfa->AppendMachine(set_nfa);
+	if ( alt_nfa )
+		nfa->AppendMachine(alt_nfa);
+
+	Unref(set_nfa);
+	set_nfa = nfa;
+	nfa = nullptr;
+
+	return true;
+	}
+
+void Specific_RE_Matcher::BuildSetDFA()
+	{
+	if ( ! set_nfa )
+		return;
 
 	EC()->BuildECs();
 	ConvertCCLs();
 
-	dfa = new DFA_Machine(nfa, EC());
+	dfa = new DFA_Machine(set_nfa, EC());
 	ecs = EC()->EquivClasses();
 
-	return true;
+	Unref(set_nfa);
+	set_nfa = nullptr;
+
+	if ( prefilter )
+		InitPrefilter();
+	}
+
+void Specific_RE_Matcher::InitPrefilter()
+	{
+	// With each expression starting with ".*" and a literal, any byte
+	// that doesn't start a literal leads into the state in which the DFA
+	// merely cycles through those leading ".*"s.
+	int c = 0;
+
+	while ( c < 256 && prefilter->MayStartWith(c) )
+		++c;
+
+	DFA_State* d = dfa->StartState();
+
+	if ( d )
+		d = d->Xtion(ecs[SYM_BOL], dfa);
+
+	if ( d && c < 256 )
+		d = d->Xtion(ecs[c], dfa);
+
+	if ( ! d || c == 256 || d->Accept() || d->Xtion(ecs[c], dfa) != d )
+		{
+		prefilter.reset();
+		return;
+		}
+
+	Ref(d);
+	prefilter_state = d;
 	}
 
 std::string Specific_RE_Matcher::LookupDef(const std::string& def)
@@ -244,14 +308,32 @@ bool Specific_RE_Matcher::MatchAll(const u_char* bv, int n)
 		// matched is empty.
 		return n == 0;
 
+	return MatchAllSet(bv, n) != nullptr;
+	}
+
+const AcceptingSet* Specific_RE_Matcher::MatchAllSet(const u_char* bv, int n)
+	{
+	if ( ! dfa )
+		return nullptr;
+
+	DFA_Machine::CheckMemoryBudget();
+
 	DFA_State* d = dfa->StartState();
 	d = d->Xtion(ecs[SYM_BOL], dfa);
 
 	while ( d )
 		{
+		if ( n > 0 && d->HasDenseXtions() )
+			{
+			int k = DFA_State::StepDense(&d, bv, n);
+			bv += k;
+			n -= k;
+			}
+
 		if ( --n < 0 )
 			break;
 
+		d->Visit(dfa);
 		int ec = ecs[*(bv++)];
 		d = d->Xtion(ec, dfa);
 		}
@@ -259,7 +341,7 @@ bool Specific_RE_Matcher::MatchAll(const u_char* bv, int n)
 	if ( d )
 		d = d->Xtion(ecs[SYM_EOL], dfa);
 
-	return d && d->Accept() != nullptr;
+	return d ? d->Accept() : nullptr;
 	}
 
 int Specific_RE_Matcher::Match(const u_char* bv, int n)
@@ -268,6 +350,8 @@ int Specific_RE_Matcher::Match(const u_char* bv, int n)
 		// An empty pattern matches anything.
 		return 1;
 
+	DFA_Machine::CheckMemoryBudget();
+
 	DFA_State* d = dfa->StartState();
 
 	d = d->Xtion(ecs[SYM_BOL], dfa);
@@ -276,6 +360,14 @@ int Specific_RE_Matcher::Match(const u_char* bv, int n)
 
 	for ( int i = 0; i < n; ++i )
 		{
+		if ( d->HasDenseXtions() )
+			{
+			i += DFA_State::StepDense(&d, bv + i, n - i);
+			if ( i == n )
+				break;
+			}
+
+		d->Visit(dfa);
 		int ec = ecs[bv[i]];
 		d = d->Xtion(ec, dfa);
 		if ( ! d )
@@ -308,8 +400,41 @@ inline void RE_Match_State::AddMatches(const AcceptingSet& as, MatchPos position
 		accepted_matches.insert(am_idx(*it, position));
 	}
 
+RE_Match_State::~RE_Match_State()
+	{
+	Unref(current_state);
+	}
+
+void RE_Match_State::Clear()
+	{
+	current_pos = -1;
+	Unref(current_state);
+	current_state = nullptr;
+	accepted_matches.clear();
+	}
+
+void RE_Match_State::HoldCurrentState(DFA_State* prev_state)
+	{
+	if ( current_state )
+		{
+		current_state->Touch();
+
+		if ( current_state != prev_state )
+			Ref(current_state);
+		}
+
+	if ( prev_state != current_state )
+		Unref(prev_state);
+	}
+
 bool RE_Match_State::Match(const u_char* bv, int n, bool bol, bool eol, bool clear)
 	{
+	// The state we're holding on to is Ref()'d, so it's safe to evict
+	// others here.
+	DFA_Machine::CheckMemoryBudget();
+
+	DFA_State* prev_state = current_state;
+
 	if ( current_pos == -1 )
 		{
 		// First call to Match().
@@ -330,7 +455,10 @@ bool RE_Match_State::Match(const u_char* bv, int n, bool bol, bool eol, bool cle
 		current_state = dfa->StartState();
 
 	if ( ! current_state )
+		{
+		HoldCurrentState(prev_state);
 		return false;
+		}
 
 	current_pos = 0;
 
@@ -347,7 +475,43 @@ bool RE_Match_State::Match(const u_char* bv, int n, bool bol, bool eol, bool cle
 		else if ( m == -1 )
 			ec = ecs[SYM_EOL];
 		else
+			{
+			if ( current_state == prefilter_state )
+				{
+				// Until one of the literals starts, no expression can
+				// advance beyond its leading ".*".  Threads started
+				// on a partial literal that we skip die anyway, as the
+				// literal doesn't start there after all.
+				int k = prefilter->Skip(bv, m + 1);
+
+				if ( k > 0 )
+					{
+					bv += k;
+					current_pos += k;
+					m -= k - 1;
+					continue;
+					}
+				}
+
+			if ( current_state->HasDenseXtions() )
+				{
+				// Run through the hot part of the DFA without any
+				// per-byte bookkeeping; none of the states passed
+				// are accepting.
+				int k = DFA_State::StepDense(&current_state, bv, m + 1);
+
+				if ( k > 0 )
+					{
+					bv += k;
+					current_pos += k;
+					m -= k - 1;
+					continue;
+					}
+				}
+
+			current_state->Visit(dfa);
 			ec = ecs[*(bv++)];
+			}
 
 		DFA_State* next_state = current_state->Xtion(ec, dfa);
 
@@ -364,9 +528,24 @@ bool RE_Match_State::Match(const u_char* bv, int n, bool bol, bool eol, bool cle
 
 		++current_pos;
 
+		// If we're stuck in a state looping onto itself (typically one
+		// waiting for literals that the prefilter doesn't know about),
+		// skip ahead to the next byte leaving it. The skipped bytes can neither change
+		// the state nor add matches beyond those recorded above.
+		if ( next_state == current_state && m > 0 && next_state != prefilter_state &&
+		     next_state->HasLoopExits(dfa) )
+			{
+			int skip = next_state->SkipLoop(bv, m);
+			bv += skip;
+			m -= skip;
+			current_pos += skip;
+			}
+
 		current_state = next_state;
 		}
 
+	HoldCurrentState(prev_state);
+
 	return accepted_matches.size() != old_matches;
 	}
 
@@ -376,6 +555,8 @@ int Specific_RE_Matcher::LongestMatch(const u_char* bv, int n)
 		// An empty pattern matches anything.
 		return 0;
 
+	DFA_Machine::CheckMemoryBudget();
+
 	// Use -1 to indicate no match.
 	int last_accept = -1;
 	DFA_State* d = dfa->StartState();
@@ -389,6 +570,14 @@ int Specific_RE_Matcher::LongestMatch(const u_char* bv, int n)
 
 	for ( int i = 0; i < n; ++i )
 		{
+		if ( d->HasDenseXtions() )
+			{
+			i += DFA_State::StepDense(&d, bv + i, n - i);
+			if ( i == n )
+				break;
+			}
+
+		d->Visit(dfa);
 		int ec = ecs[bv[i]];
 		d = d->Xtion(ec, dfa);
 
@@ -409,15 +598,160 @@ int Specific_RE_Matcher::LongestMatch(const u_char* bv, int n)
 	return last_accept;
 	}
 
-static RE_Matcher* matcher_merge(const RE_Matcher* re1, const RE_Matcher* re2, const char* merge_op)
+void Specific_RE_Matcher::LongestMatches(const u_char* bv, int n,
+                                         std::vector<std::pair<int, int>>* matches,
+                                         size_t max_matches)
+	{
+	if ( ! dfa )
+		// An empty pattern only matches empty strings.
+		return;
+
+	DFA_Machine::CheckMemoryBudget();
+
+	DFA_State* bol = dfa->StartState()->Xtion(ecs[SYM_BOL], dfa);
+	if ( ! bol )
+		return;
+
+	// Rather than running LongestMatch() from each offset, we advance the
+	// DFA runs for all candidate offsets in lockstep, ordered by where they
+	// started.  Runs that reach the same state share their future, so only
+	// the one that started first needs to be kept.  That bounds the work per
+	// input byte by the number of DFA states rather than the number of
+	// candidate offsets.
+	struct Run
+		{
+		DFA_State* state;
+		int start;
+		};
+
+	std::vector<Run> runs;
+	std::vector<Run> next_runs;
+
+	// Tells which states a run has reached during the current step.
+	static uint64_t step = 0;
+
+	int pos = 0;
+
+	while ( pos < n && (max_matches == 0 || matches->size() < max_matches) )
+		{
+		int best_start = -1;
+		int best_end = -1;
+		int i = pos;
+
+		runs.clear();
+
+		for ( ; i < n; ++i )
+			{
+			// Once there's a match, only runs that started earlier can
+			// still produce a better one.
+			if ( best_start < 0 )
+				runs.push_back({bol, i});
+
+			int ec = ecs[bv[i]];
+			next_runs.clear();
+			++step;
+
+			for ( const auto& r : runs )
+				{
+				r.state->Visit(dfa);
+				DFA_State* d = r.state->Xtion(ec, dfa);
+
+				if ( ! d || ! d->StampStep(step) )
+					continue;
+
+				if ( d->Accept() && (best_start < 0 || r.start <= best_start) )
+					{
+					best_start = r.start;
+					best_end = i + 1;
+					}
+
+				next_runs.push_back({d, r.start});
+				}
+
+			if ( best_start >= 0 )
+				while ( ! next_runs.empty() && next_runs.back().start > best_start )
+					next_runs.pop_back();
+
+			runs.swap(next_runs);
+
+			if ( best_start >= 0 && runs.empty() )
+				break;
+			}
+
+		if ( i == n )
+			{
+			// Runs reaching the end of the input may match an end-of-line
+			// anchor there.  The first one to do so started leftmost.
+			for ( const auto& r : runs )
+				{
+				DFA_State* d = r.state->Xtion(ecs[SYM_EOL], dfa);
+				if ( d && d->Accept() )
+					{
+					if ( best_start < 0 || r.start <= best_start )
+						{
+						best_start = r.start;
+						best_end = n;
+						}
+					break;
+					}
+				}
+			}
+
+		if ( best_start < 0 )
+			break;
+
+		matches->emplace_back(best_start, best_end);
+		pos = best_end;
+		}
+	}
+
+RE_Set_Matcher::RE_Set_Matcher(const std::vector<std::string>& patterns, bool arg_exact)
+	: re(MATCH_EXACTLY), exact(arg_exact)
 	{
-	const char* text1 = re1->PatternText();
-	const char* text2 = re2->PatternText();
+	string_list texts;
+	int_list ids;
 
-	size_t n = strlen(text1) + strlen(text2) + strlen(merge_op) + 32 /* slop */;
+	// Accept indices must not be zero.
+	for ( size_t i = 0; i < patterns.size(); ++i )
+		{
+		texts.push_back(const_cast<char*>(patterns[i].c_str()));
+		ids.push_back(i + 1);
+		}
+
+	valid = ! patterns.empty() && re.CompileSet(texts, ids);
+	}
 
-	std::string merge_text = util::fmt("(%s)%s(%s)", text1, merge_op, text2);
-	RE_Matcher* merge = new RE_Matcher(merge_text.c_str());
+void RE_Set_Matcher::Match(const u_char* bv, int n, std::vector<int>* matches)
+	{
+	if ( ! valid )
+		return;
+
+	if ( exact )
+		{
+		// The state reached at the end accepts exactly those patterns
+		// that match the input as a whole.
+		if ( const AcceptingSet* as = re.MatchAllSet(bv, n) )
+			for ( auto idx : *as )
+				matches->push_back(idx - 1);
+
+		return;
+		}
+
+	RE_Match_State state(&re);
+	state.Match(bv, n, true, true, false);
+
+	for ( const auto& m : state.AcceptedMatches() )
+		matches->push_back(m.first - 1);
+	}
+
+static std::string merge_text(const RE_Matcher* re1, const RE_Matcher* re2, const char* merge_op)
+	{
+	return util::fmt("(%s)%s(%s)", re1->PatternText(), merge_op, re2->PatternText());
+	}
+
+static RE_Matcher* matcher_merge(const RE_Matcher* re1, const RE_Matcher* re2, const char* merge_op)
+	{
+	RE_Matcher* merge = new RE_Matcher(merge_text(re1, re2, merge_op).c_str());
 
 	merge->Compile();
 
@@ -434,6 +768,99 @@ RE_Matcher* RE_Matcher_disjunction(const RE_Matcher* re1, const RE_Matcher* re2)
 	return matcher_merge(re1, re2, "|");
 	}
 
+std::shared_ptr<RE_Matcher> RE_Matcher_Cache::Lookup(const std::string& key,
+                                                     const std::function<RE_Matcher*()>& make,
+                                                     bool* compiled)
+	{
+	if ( auto it = index.find(key); it != index.end() )
+		{
+		++hits;
+		lru.splice(lru.begin(), lru, it->second);
+
+		if ( compiled )
+			*compiled = true;
+
+		return it->second->second;
+		}
+
+	++misses;
+
+	std::shared_ptr<RE_Matcher> re(make());
+	bool ok = re->Compile();
+
+	if ( compiled )
+		*compiled = ok;
+
+	if ( ok && capacity > 0 )
+		{
+		lru.emplace_front(key, re);
+		index[key] = lru.begin();
+		SetCapacity(capacity);
+		}
+
+	return re;
+	}
+
+void RE_Matcher_Cache::SetCapacity(size_t n)
+	{
+	capacity = n;
+
+	while ( lru.size() > capacity )
+		{
+		// PatternVals still using the matcher keep it alive.
+		index.erase(lru.back().first);
+		lru.pop_back();
+		++evictions;
+		}
+	}
+
+void RE_Matcher_Cache::GetStats(Stats* stats) const
+	{
+	stats->entries = lru.size();
+	stats->hits = hits;
+	stats->misses = misses;
+	stats->evictions = evictions;
+	}
+
+RE_Matcher_Cache& re_matcher_cache()
+	{
+	// Intentionally leaked so that cached matchers outlive any PatternVal
+	// released during static destruction.
+	static auto* cache = new RE_Matcher_Cache();
+	return *cache;
+	}
+
+// The leading character of a cache key tells apart the ways of building a
+// matcher: "p" for a single pattern, "x" for given exact and anywhere texts,
+// and "+" for PatternVal::AddTo().
+
+std::shared_ptr<RE_Matcher> cached_RE_Matcher(const char* pat, bool* compiled)
+	{
+	return re_matcher_cache().Lookup(
+		std::string("p") + pat, [pat]() { return new RE_Matcher(pat); }, compiled);
+	}
+
+std::shared_ptr<RE_Matcher> cached_RE_Matcher(const char* exact_pat, const char* anywhere_pat,
+                                              bool* compiled)
+	{
+	std::string key = std::string("x") + exact_pat + '\0' + anywhere_pat;
+	return re_matcher_cache().Lookup(
+		key, [exact_pat, anywhere_pat]() { return new RE_Matcher(exact_pat, anywhere_pat); },
+		compiled);
+	}
+
+std::shared_ptr<RE_Matcher> cached_RE_Matcher_conjunction(const RE_Matcher* re1,
+                                                          const RE_Matcher* re2)
+	{
+	return cached_RE_Matcher(merge_text(re1, re2, "").c_str());
+	}
+
+std::shared_ptr<RE_Matcher> cached_RE_Matcher_disjunction(const RE_Matcher* re1,
+                                                          const RE_Matcher* re2)
+	{
+	return cached_RE_Matcher(merge_text(re1, re2, "|").c_str());
+	}
+
 	} // namespace detail
 
 RE_Matcher::RE_Matcher()
@@ -594,6 +1021,304 @@ TEST_SUITE("re_matcher")
 		CHECK(dj->MatchExactly("def"));
 		delete dj;
 		}
+
+	TEST_CASE("longest_matches")
+		{
+		const char* patterns[] = {"foo",    "a+",         "ab|abcd|c", "^x",   "y$",
+		                          "[0-9]*", "(a|b)*c",    "a.*b",      "",     "\\n+"};
+		const char* inputs[] = {"",           "foo",          "xfoofoo fo",   "aaabaaa",
+		                        "abcdabc",    "xyxy",         "12a345",       "aabbcbac",
+		                        "aaaaaaaaab", "line\n\nnext\n"};
+
+		for ( auto pat : patterns )
+			for ( auto input : inputs )
+				{
+				RE_Matcher re(pat);
+				re.Compile();
+
+				const auto* s = reinterpret_cast<const u_char*>(input);
+				int n = strlen(input);
+
+				// What the string BiFs used to do: probe every offset.
+				std::vector<std::pair<int, int>> expected;
+				for ( int i = 0; i < n; )
+					{
+					int len = re.MatchPrefix(s + i, n - i);
+					if ( len > 0 )
+						{
+						expected.emplace_back(i, i + len);
+						i += len;
+						}
+					else
+						++i;
+					}
+
+				std::vector<std::pair<int, int>> found;
+				re.FindAll(s, n, &found);
+				CHECK_MESSAGE(found == expected, pat << " on " << input);
+
+				found.clear();
+				re.FindAll(s, n, &found, 1);
+				CHECK(found.size() == std::min<size_t>(expected.size(), 1));
+				}
+		}
+
+	TEST_CASE("matcher_cache")
+		{
+		detail::RE_Matcher_Cache cache;
+		detail::RE_Matcher_Cache::Stats stats;
+		int built = 0;
+
+		auto make = [&built](const char* pat)
+		{
+			return [&built, pat]()
+			{
+				++built;
+				return new RE_Matcher(pat);
+			};
+		};
+
+		auto foo1 = cache.Lookup("foo", make("foo"));
+		auto foo2 = cache.Lookup("foo", make("foo"));
+		CHECK(foo1 == foo2);
+		CHECK(built == 1);
+		CHECK(foo1->MatchExactly("foo"));
+
+		cache.SetCapacity(1);
+		auto bar = cache.Lookup("bar", make("bar"));
+		CHECK(built == 2);
+
+		// "foo" got evicted, but the matcher lives on with its users.
+		CHECK(foo1->MatchExactly("foo"));
+		CHECK(cache.Lookup("foo", make("foo")) != foo1);
+		CHECK(built == 3);
+
+		cache.GetStats(&stats);
+		CHECK(stats.entries == 1);
+		CHECK(stats.hits == 1);
+		CHECK(stats.misses == 3);
+		CHECK(stats.evictions == 2);
+		}
+
+	TEST_CASE("match_state_skips_loops")
+		{
+		detail::Specific_RE_Matcher set(detail::MATCH_EXACTLY, true);
+		detail::string_list pats;
+		pats.push_back(const_cast<char*>(".*foo"));
+		pats.push_back(const_cast<char*>(".*bar"));
+		detail::int_list ids = {1, 2};
+		REQUIRE(set.CompileSet(pats, ids));
+
+		detail::RE_Match_State state(&set);
+		std::string filler(1000, 'x');
+
+		// Feed enough data for the looping state to start skipping.
+		for ( int i = 0; i < 4; ++i )
+			CHECK_FALSE(state.Match(reinterpret_cast<const u_char*>(filler.data()), filler.size(),
+			                        i == 0, false, false));
+
+		std::string data = filler + "bar" + filler + "fo";
+		CHECK(state.Match(reinterpret_cast<const u_char*>(data.data()), data.size(), false, false,
+		                  false));
+		CHECK(state.AcceptedMatches().size() == 1);
+		CHECK(state.AcceptedMatches().at(2) == 1002);
+
+		// A literal split across chunks must still be found.
+		CHECK(state.Match(reinterpret_cast<const u_char*>("o"), 1, false, false, false));
+		CHECK(state.AcceptedMatches().at(1) == 0);
+		}
+
+	TEST_CASE("match_state_prefilter")
+		{
+		detail::Specific_RE_Matcher set(detail::MATCH_EXACTLY, true);
+		detail::string_list pats;
+		pats.push_back(const_cast<char*>(".*foobar"));
+		pats.push_back(const_cast<char*>("(?i:.*bazq)"));
+		detail::int_list ids = {1, 2};
+		set.SetPrefilter(std::make_unique<detail::LiteralPrefilter>(
+			std::vector<std::string>{"foobar", "bazq"}, true));
+		REQUIRE(set.CompileSet(pats, ids));
+		REQUIRE(set.PrefilterState());
+
+		detail::RE_Match_State state(&set);
+		std::string filler(1000, 'x');
+		std::string data = filler + "fooba" + filler.substr(0, 100) + "BaZq" + "xfoo";
+		CHECK(state.Match(reinterpret_cast<const u_char*>(data.data()), data.size(), true, false,
+		                  false));
+		CHECK(state.AcceptedMatches().size() == 1);
+		CHECK(state.AcceptedMatches().at(2) == 1108);
+
+		// The literal cut off at the end of the chunk continues here.
+		CHECK(state.Match(reinterpret_cast<const u_char*>("bar"), 3, false, false, false));
+		CHECK(state.AcceptedMatches().at(1) == 2);
+
+		// Sets whose DFA doesn't wait for the literals drop the prefilter.
+		detail::Specific_RE_Matcher anchored(detail::MATCH_EXACTLY, true);
+		detail::string_list apats;
+		apats.push_back(const_cast<char*>("foo"));
+		detail::int_list aids = {1};
+		anchored.SetPrefilter(
+			std::make_unique<detail::LiteralPrefilter>(std::vector<std::string>{"foo"}, false));
+		REQUIRE(anchored.CompileSet(apats, aids));
+		CHECK_FALSE(anchored.Prefilter());
+		}
+
+	TEST_CASE("set_matcher")
+		{
+		RE_Matcher foo("foo");
+		RE_Matcher digits("[0-9]+");
+		RE_Matcher bar("^bar");
+		foo.Compile();
+		digits.Compile();
+		bar.Compile();
+
+		std::vector<std::string> anywhere = {foo.AnywherePatternText(),
+		                                     digits.AnywherePatternText(),
+		                                     bar.AnywherePatternText()};
+		std::vector<std::string> exact = {foo.PatternText(), digits.PatternText(),
+		                                  bar.PatternText()};
+
+		detail::RE_Set_Matcher any_set(anywhere, false);
+		detail::RE_Set_Matcher exact_set(exact, true);
+		REQUIRE(any_set.IsValid());
+		REQUIRE(exact_set.IsValid());
+
+		std::vector<int> matches;
+		any_set.Match(reinterpret_cast<const u_char*>("barfoo42"), 8, &matches);
+		CHECK(matches.size() == 3);
+
+		matches.clear();
+		any_set.Match(reinterpret_cast<const u_char*>("xbar"), 4, &matches);
+		CHECK(matches.empty());
+
+		matches.clear();
+		exact_set.Match(reinterpret_cast<const u_char*>("42"), 2, &matches);
+		REQUIRE(matches.size() == 1);
+		CHECK(matches[0] == 1);
+
+		matches.clear();
+		exact_set.Match(reinterpret_cast<const u_char*>("foo42"), 5, &matches);
+		CHECK(matches.empty());
+		}
+
+	TEST_CASE("dense_xtions")
+		{
+		RE_Matcher match("(ab|cd)+e");
+		match.Compile();
+
+		std::string hot;
+		for ( int i = 0; i < 50; ++i )
+			hot += "abcd";
+
+		std::string miss = hot + "ce";
+		std::string anywhere = "xyz" + hot + "e";
+
+		// Results must not change once the states went dense.
+		for ( int i = 0; i < 4; ++i )
+			{
+			CHECK(match.MatchExactly((hot + "e").c_str()));
+			CHECK_FALSE(match.MatchExactly(hot.c_str()));
+			CHECK_FALSE(match.MatchExactly(miss.c_str()));
+			CHECK(match.MatchAnywhere(anywhere.c_str()) == static_cast<int>(anywhere.size()));
+			CHECK(match.MatchAnywhere(hot.c_str()) == 0);
+			}
+		}
+
+	TEST_CASE("dfa_memory_budget_evicts_states")
+		{
+		detail::Specific_RE_Matcher set(detail::MATCH_EXACTLY, true);
+		detail::string_list pats;
+		pats.push_back(const_cast<char*>(".*foobar"));
+		pats.push_back(const_cast<char*>(".*bazqux"));
+		detail::int_list ids = {1, 2};
+		REQUIRE(set.CompileSet(pats, ids));
+
+		detail::RE_Match_State state(&set);
+		std::string data = "foobazfoobarbazqu";
+		CHECK(state.Match(reinterpret_cast<const u_char*>(data.data()), data.size(), true, false,
+		                  false));
+
+		detail::DFA_State_Cache::Stats stats;
+		set.DFA()->Cache()->GetStats(&stats);
+		int states = stats.dfa_states;
+		REQUIRE(states > 2);
+
+		// Squeeze everything but the start state and the one the match
+		// state holds on to out of the cache.
+		detail::DFA_Machine::SetMemoryBudget(1);
+		detail::DFA_Machine::CheckMemoryBudget();
+		detail::DFA_Machine::SetMemoryBudget(0);
+
+		set.DFA()->Cache()->GetStats(&stats);
+		CHECK(stats.dfa_states == 2);
+		CHECK(stats.evictions == states - 2);
+
+		// Matching continues where it left off, recomputing states.
+		CHECK(state.Match(reinterpret_cast<const u_char*>("x"), 1, false, false, false));
+		CHECK(state.AcceptedMatches().size() == 2);
+		CHECK(set.Match(reinterpret_cast<const u_char*>("xxfoobar"), 8) == 8);
+		}
+
+	TEST_CASE("dfa_eviction_keeps_hot_states")
+		{
+		detail::Specific_RE_Matcher hot(detail::MATCH_EXACTLY);
+		hot.SetPat("(ab|cd)+e");
+		REQUIRE(hot.Compile());
+
+		// Its DFA has a state for each combination of the last eleven
+		// bytes, so random input keeps creating new ones.
+		detail::Specific_RE_Matcher cold(detail::MATCH_EXACTLY);
+		cold.SetPat("(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)");
+		REQUIRE(cold.Compile());
+
+		std::string hot_data;
+		for ( int i = 0; i < 50; ++i )
+			hot_data += "abcd";
+		hot_data += "e";
+
+		auto match_hot = [&]()
+		{
+			return hot.Match(reinterpret_cast<const u_char*>(hot_data.data()), hot_data.size());
+		};
+
+		// Warm up until the hot states go dense, after which matching
+		// doesn't compute transitions anymore.
+		for ( int i = 0; i < 4; ++i )
+			REQUIRE(match_hot());
+
+		detail::DFA_State_Cache::Stats hot_stats;
+		hot.DFA()->Cache()->GetStats(&hot_stats);
+		auto hot_states = hot_stats.dfa_states;
+
+		// Leave room for eviction to get below its target without
+		// touching the memory in use so far.
+		uint64_t base = detail::DFA_Machine::TotalMemory();
+		detail::DFA_Machine::SetMemoryBudget(base + base / 2 + 16 * 1024);
+
+		detail::DFA_State_Cache::Stats cold_stats;
+		uint32_t rnd = 1;
+		std::string cold_data(40, 'a');
+
+		for ( int i = 0; i < 5000; ++i )
+			{
+			for ( auto& c : cold_data )
+				{
+				rnd = rnd * 1103515245 + 12345;
+				c = (rnd >> 16) & 1 ? 'a' : 'b';
+				}
+
+			cold.Match(reinterpret_cast<const u_char*>(cold_data.data()), cold_data.size());
+			CHECK(match_hot());
+			}
+
+		detail::DFA_Machine::SetMemoryBudget(0);
+
+		cold.DFA()->Cache()->GetStats(&cold_stats);
+		hot.DFA()->Cache()->GetStats(&hot_stats);
+		REQUIRE(cold_stats.evictions > 0);
+		CHECK(hot_stats.evictions == 0);
+		CHECK(hot_stats.dfa_states == hot_states);
+		}
 	}
 
 	} // namespace zeek
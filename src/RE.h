@@ -4,13 +4,19 @@
 
 #include <sys/types.h> // for u_char
 #include <cctype>
+#include <functional>
+#include <list>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "zeek/CCL.h"
 #include "zeek/EquivClass.h"
 #include "zeek/List.h"
+#include "zeek/LiteralPrefilter.h"
 
 using cce_func = int (*)(int);
 
@@ -99,12 +105,39 @@ public:
 	bool MatchAll(const char* s);
 	bool MatchAll(const String* s);
 
+	// Like MatchAll(), but returns the accepting set of the state reached
+	// at the end of the input, or nil if there's none. For matchers built
+	// with CompileSet(), these are the indices of all expressions matching
+	// the input as a whole. The set remains valid only until the next
+	// call to any of the matching methods.
+	const AcceptingSet* MatchAllSet(const u_char* bv, int n);
+
 	// Compiles a set of regular expressions simultaniously.
 	// 'idx' contains indizes associated with the expressions.
 	// On matching, the set of indizes is returned which correspond
 	// to the matching expressions.  (idx must not contain zeros).
 	bool CompileSet(const string_list& set, const int_list& idx);
 
+	// The two halves of CompileSet(). ParseSet() must run on the main
+	// thread as the pattern parser isn't reentrant. BuildSetDFA() only
+	// touches the matcher itself, so it may run concurrently for
+	// different matchers.
+	bool ParseSet(const string_list& set, const int_list& idx);
+	void BuildSetDFA();
+
+	// Lets matching skip input at which none of the given literals starts
+	// while the DFA waits for one of them.  Each expression of the set
+	// must be of the form LiteralPrefilter::LeadingLiteral() extracts a
+	// literal from.  To be called before BuildSetDFA(), which drops the
+	// prefilter if the DFA doesn't have the expected shape.
+	void SetPrefilter(std::unique_ptr<LiteralPrefilter> p) { prefilter = std::move(p); }
+
+	const LiteralPrefilter* Prefilter() const { return prefilter.get(); }
+
+	// Returns the DFA state waiting for the prefilter's literals, or nil
+	// if there's no prefilter.
+	DFA_State* PrefilterState() const { return prefilter_state; }
+
 	// Returns the position in s just beyond where the first match
 	// occurs, or 0 if there is no such position in s.  Note that
 	// if the pattern matches empty strings, matching continues
@@ -117,6 +150,18 @@ public:
 	int LongestMatch(const String* s);
 	int LongestMatch(const u_char* bv, int n);
 
+	// Appends the [start, end) offsets of the leftmost-longest,
+	// non-overlapping, non-empty matches in bv to matches, stopping after
+	// max_matches of them unless that's zero.  This yields the same as
+	// calling LongestMatch() at successive offsets and skipping past each
+	// non-empty match, but advances all candidate offsets up to a match
+	// together rather than rescanning the input from each of them.  Input
+	// past a match that got looked at in search of a longer one does get
+	// scanned again for the next match, though, so patterns such as
+	// /a|a.*z/ can still take quadratic time.
+	void LongestMatches(const u_char* bv, int n, std::vector<std::pair<int, int>>* matches,
+	                    size_t max_matches = 0);
+
 	EquivClass* EC() { return &equiv_class; }
 
 	const char* PatternText() const { return pattern_text.c_str(); }
@@ -136,6 +181,10 @@ protected:
 
 	bool MatchAll(const u_char* bv, int n);
 
+	// Finds the state for PrefilterState(), dropping the prefilter if
+	// there's none.
+	void InitPrefilter();
+
 	match_type mt;
 	bool multiline;
 
@@ -147,9 +196,13 @@ protected:
 	PList<CCL> ccl_list;
 	EquivClass equiv_class;
 	int* ecs;
+	NFA_Machine* set_nfa; // parsed by ParseSet(), awaiting BuildSetDFA()
 	DFA_Machine* dfa;
 	AcceptingSet* accepted;
 
+	std::unique_ptr<LiteralPrefilter> prefilter;
+	DFA_State* prefilter_state; // Ref()'d so that it doesn't get evicted
+
 	CCL* any_ccl;
 	CCL* single_line_ccl;
 	};
@@ -161,10 +214,14 @@ public:
 		{
 		dfa = matcher->DFA() ? matcher->DFA() : nullptr;
 		ecs = matcher->EC()->EquivClasses();
+		prefilter = matcher->Prefilter();
+		prefilter_state = matcher->PrefilterState();
 		current_pos = -1;
 		current_state = nullptr;
 		}
 
+	~RE_Match_State();
+
 	const AcceptingMatchSet& AcceptedMatches() const { return accepted_matches; }
 
 	// Returns the number of bytes feeded into the matcher so far
@@ -174,24 +231,49 @@ public:
 	// If clear is true, starts matching over.
 	bool Match(const u_char* bv, int n, bool bol, bool eol, bool clear);
 
-	void Clear()
-		{
-		current_pos = -1;
-		current_state = nullptr;
-		accepted_matches.clear();
-		}
+	void Clear();
 
 	void AddMatches(const AcceptingSet& as, MatchPos position);
 
 protected:
+	// Refs the current state so that it survives DFA state eviction
+	// between calls, releasing the previously held one.
+	void HoldCurrentState(DFA_State* prev_state);
+
 	DFA_Machine* dfa;
 	int* ecs;
+	const LiteralPrefilter* prefilter;
+	DFA_State* prefilter_state;
 
 	AcceptingMatchSet accepted_matches;
 	DFA_State* current_state;
 	int current_pos;
 	};
 
+// Matches input against many patterns in a single pass by compiling them
+// into one DFA, reporting all the patterns that match.
+class RE_Set_Matcher
+	{
+public:
+	// The patterns are given in the form returned by RE_Matcher's
+	// PatternText() (if exact) or AnywherePatternText() (if not). With
+	// exact, a pattern needs to match the input as a whole, as with
+	// "p == s"; otherwise it may match anywhere, as with "p in s".
+	RE_Set_Matcher(const std::vector<std::string>& patterns, bool exact);
+
+	// Returns false if the patterns failed to compile.
+	bool IsValid() const { return valid; }
+
+	// Appends the indices (into the vector given to the constructor) of
+	// all patterns matching the input to matches, in ascending order.
+	void Match(const u_char* bv, int n, std::vector<int>* matches);
+
+protected:
+	Specific_RE_Matcher re;
+	bool exact;
+	bool valid;
+	};
+
 extern RE_Matcher* RE_Matcher_conjunction(const RE_Matcher* re1, const RE_Matcher* re2);
 extern RE_Matcher* RE_Matcher_disjunction(const RE_Matcher* re1, const RE_Matcher* re2);
 
@@ -233,6 +315,16 @@ public:
 	int MatchPrefix(const String* s) { return re_exact->LongestMatch(s); }
 	int MatchPrefix(const u_char* s, int n) { return re_exact->LongestMatch(s, n); }
 
+	// Finds the successive non-overlapping, non-empty matches in s, each
+	// starting at the leftmost offset where MatchPrefix() would return a
+	// non-zero length and extending over that length.  See
+	// Specific_RE_Matcher::LongestMatches().
+	void FindAll(const u_char* s, int n, std::vector<std::pair<int, int>>* matches,
+	             size_t max_matches = 0)
+		{
+		re_exact->LongestMatches(s, n, matches, max_matches);
+		}
+
 	bool Match(const u_char* s, int n) { return re_anywhere->Match(s, n); }
 
 	const char* PatternText() const { return re_exact->PatternText(); }
@@ -252,4 +344,61 @@ protected:
 	bool is_single_line = false;
 	};
 
+namespace detail
+	{
+
+// A bounded cache of compiled matchers for patterns that scripts build at
+// run-time, keyed on the text they're built from.  Compiled matchers don't
+// change anymore, so all PatternVals built from the same text can share one.
+// Least recently used entries get dropped once the cache is full.
+class RE_Matcher_Cache
+	{
+public:
+	struct Stats
+		{
+		uint64_t entries;
+		uint64_t hits;
+		uint64_t misses;
+		uint64_t evictions;
+		};
+
+	// Returns the matcher cached under key.  On a miss, make() builds an
+	// uncompiled matcher, which then gets compiled and, if that succeeds,
+	// cached.  If compiled is given, it receives whether compilation
+	// succeeded; a failed matcher is still returned, as before caching.
+	std::shared_ptr<RE_Matcher> Lookup(const std::string& key,
+	                                   const std::function<RE_Matcher*()>& make,
+	                                   bool* compiled = nullptr);
+
+	// Sets the maximum number of cached matchers.  Zero disables caching.
+	void SetCapacity(size_t n);
+
+	void GetStats(Stats* stats) const;
+
+private:
+	using Entry = std::pair<std::string, std::shared_ptr<RE_Matcher>>;
+
+	std::list<Entry> lru; // most recently used first
+	std::unordered_map<std::string, std::list<Entry>::iterator> index;
+	size_t capacity = 1000;
+
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	uint64_t evictions = 0;
+	};
+
+extern RE_Matcher_Cache& re_matcher_cache();
+
+// Cached counterparts of "new RE_Matcher(...)" followed by Compile(), and of
+// RE_Matcher_conjunction()/RE_Matcher_disjunction().
+extern std::shared_ptr<RE_Matcher> cached_RE_Matcher(const char* pat, bool* compiled = nullptr);
+extern std::shared_ptr<RE_Matcher> cached_RE_Matcher(const char* exact_pat, const char* anywhere_pat,
+                                                     bool* compiled = nullptr);
+extern std::shared_ptr<RE_Matcher> cached_RE_Matcher_conjunction(const RE_Matcher* re1,
+                                                                 const RE_Matcher* re2);
+extern std::shared_ptr<RE_Matcher> cached_RE_Matcher_disjunction(const RE_Matcher* re1,
+                                                                 const RE_Matcher* re2);
+
+	} // namespace detail
+
 	} // namespace zeek
@@ -3,17 +3,25 @@
 
 #include "zeek/zeek-config.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <functional>
 
 #include "zeek/DFA.h"
 #include "zeek/DebugLogger.h"
 #include "zeek/File.h"
+#include "zeek/Hash.h"
 #include "zeek/ID.h"
 #include "zeek/IP.h"
 #include "zeek/IPAddr.h"
 #include "zeek/IntSet.h"
 #include "zeek/IntrusivePtr.h"
+#include "zeek/LiteralPrefilter.h"
 #include "zeek/NetVar.h"
 #include "zeek/Reporter.h"
 #include "zeek/RuleAction.h"
@@ -357,6 +365,7 @@ bool RuleMatcher::ReadFiles(const std::vector<SignatureFile>& files)
 	string_list exprs[Rule::TYPES];
 	int_list ids[Rule::TYPES];
 	BuildRegEx(root, exprs, ids);
+	BuildPatternSetDFAs();
 
 	return ! parse_error;
 	}
@@ -472,7 +481,7 @@ void RuleMatcher::BuildRegEx(RuleHdrTest* hdr_test, string_list* exprs, int_list
 		{
 		for ( int i = 0; i < Rule::TYPES; ++i )
 			if ( exprs[i].length() )
-				BuildPatternSets(&hdr_test->psets[i], exprs[i], ids[i]);
+				BuildPatternSets(&hdr_test->psets[i], (Rule::PatternType)i, exprs[i], ids[i]);
 		}
 
 	// Get the patterns on all of our children.
@@ -499,45 +508,107 @@ void RuleMatcher::BuildRegEx(RuleHdrTest* hdr_test, string_list* exprs, int_list
 		{
 		for ( int i = 0; i < Rule::TYPES; ++i )
 			if ( exprs[i].length() )
-				BuildPatternSets(&hdr_test->psets[i], exprs[i], ids[i]);
+				BuildPatternSets(&hdr_test->psets[i], (Rule::PatternType)i, exprs[i], ids[i]);
 		}
 
 	// If we're below the RE_level, the regexprs remains empty.
 	}
 
-void RuleMatcher::BuildPatternSets(RuleHdrTest::pattern_set_list* dst, const string_list& exprs,
-                                   const int_list& ids)
+void RuleMatcher::BuildPatternSets(RuleHdrTest::pattern_set_list* dst, Rule::PatternType type,
+                                   const string_list& exprs, const int_list& ids)
 	{
 	assert(static_cast<size_t>(exprs.length()) == ids.size());
 
+	// Most patterns start with ".*" and a literal. Matching can skip
+	// over input in which none of a set's literals start if all of its
+	// patterns are like that, so we group these together, longest
+	// literals first to make the skips long.
+	struct Literal
+		{
+		std::string text; // empty if there's none
+		bool nocase;
+		};
+
+	std::vector<Literal> literals(exprs.length());
+	std::vector<int> order(exprs.length());
+
+	loop_over_list(exprs, i)
+		{
+		if ( ! LiteralPrefilter::LeadingLiteral(exprs[i], &literals[i].text, &literals[i].nocase) )
+			literals[i].text.clear();
+
+		order[i] = i;
+		}
+
+	std::stable_sort(order.begin(), order.end(), [&literals](int a, int b)
+	                 { return literals[a].text.size() > literals[b].text.size(); });
+
 	// We build groups of at most sig_max_group_size regexps.
 
 	string_list group_exprs;
 	int_list group_ids;
+	std::vector<std::string> group_literals;
+	bool group_nocase = false;
 
 	for ( int i = 0; i < exprs.length() + 1 /* sic! */; i++ )
 		{
 		if ( i < exprs.length() )
 			{
-			group_exprs.push_back(exprs[i]);
-			group_ids.push_back(ids[i]);
+			const auto& l = literals[order[i]];
+			group_exprs.push_back(exprs[order[i]]);
+			group_ids.push_back(ids[order[i]]);
+
+			if ( ! l.text.empty() )
+				{
+				group_literals.push_back(l.text);
+				group_nocase = group_nocase || l.nocase;
+				}
 			}
 
 		if ( group_exprs.length() > sig_max_group_size || i == exprs.length() )
 			{
 			RuleHdrTest::PatternSet* set = new RuleHdrTest::PatternSet;
 			set->re = new Specific_RE_Matcher(MATCH_EXACTLY, true);
-			set->re->CompileSet(group_exprs, group_ids);
+			set->re->ParseSet(group_exprs, group_ids);
 			set->patterns = group_exprs;
 			set->ids = group_ids;
 			dst->push_back(set);
 
+			if ( ! group_literals.empty() &&
+			     group_literals.size() == static_cast<size_t>(group_exprs.length()) )
+				set->re->SetPrefilter(
+					std::make_unique<LiteralPrefilter>(group_literals, group_nocase));
+
+			// Each pattern ends up in exactly one set, so the
+			// signature of the set's first one identifies it.
+			const char* first_sig = group_ids.empty() ? "none"
+			                                          : Rule::rule_table[group_ids[0] - 1]->ID();
+			unbuilt_sets.emplace_back(set, util::fmt("signatures:%s:%s+%zu",
+			                                         Rule::TypeToString(type), first_sig,
+			                                         group_ids.empty() ? 0 : group_ids.size() - 1));
+
 			group_exprs.clear();
 			group_ids.clear();
+			group_literals.clear();
+			group_nocase = false;
 			}
 		}
 	}
 
+void RuleMatcher::BuildPatternSetDFAs()
+	{
+	// Parsing the patterns had to happen on the main thread, but building
+	// the initial DFAs only touches each set's own matcher.
+	util::detail::run_parallel(unbuilt_sets.size(), BifConst::signature_compile_threads,
+	                           [this](size_t i) { unbuilt_sets[i].first->re->BuildSetDFA(); });
+
+	for ( const auto& [set, label] : unbuilt_sets )
+		if ( set->re->DFA() )
+			set->re->DFA()->SetMetricsLabel(label);
+
+	unbuilt_sets.clear();
+	}
+
 // Get a 8/16/32-bit value from the given position in the packet header
 static inline uint32_t getval(const u_char* data, int size)
 	{
@@ -1254,6 +1325,7 @@ void RuleMatcher::GetStats(Stats* stats, RuleHdrTest* hdr_test)
 		stats->mem = 0;
 		stats->hits = 0;
 		stats->misses = 0;
+		stats->evictions = 0;
 		stats->nfa_states = 0;
 		hdr_test = root;
 		}
@@ -1274,6 +1346,7 @@ void RuleMatcher::GetStats(Stats* stats, RuleHdrTest* hdr_test)
 			stats->mem += cstats.mem;
 			stats->hits += cstats.hits;
 			stats->misses += cstats.misses;
+			stats->evictions += cstats.evictions;
 			stats->nfa_states += cstats.nfa_states;
 			}
 		}
@@ -1291,8 +1364,8 @@ void RuleMatcher::DumpStats(File* f)
 	                   "computed trans. = %d; matchers = %d; mem = %d\n",
 	                   run_state::network_time, stats.dfa_states, stats.computed, stats.matchers,
 	                   stats.mem));
-	f->Write(util::fmt("%.6f DFA cache hits = %d; misses = %d\n", run_state::network_time,
-	                   stats.hits, stats.misses));
+	f->Write(util::fmt("%.6f DFA cache hits = %d; misses = %d; evictions = %d\n",
+	                   run_state::network_time, stats.hits, stats.misses, stats.evictions));
 
 	DumpStateStats(f, root);
 	}
@@ -1327,6 +1400,223 @@ void RuleMatcher::DumpStateStats(File* f, RuleHdrTest* hdr_test)
 		DumpStateStats(f, h);
 	}
 
+// The DFA cache file starts with this magic, followed by the number of
+// entries. Each entry consists of a 16-byte pattern set digest, the number
+// of transitions, and the transitions as recorded by
+// DFA_Machine::RecordXtions(). All integers are 32-bit in host byte order.
+static const char dfa_cache_magic[8] = {'Z', 'E', 'E', 'K', 'D', 'F', 'A', '1'};
+
+void RuleMatcher::GetPatternSets(RuleHdrTest* hdr_test,
+                                 std::multimap<std::string, RuleHdrTest::PatternSet*>* sets)
+	{
+	for ( int i = 0; i < Rule::TYPES; ++i )
+		{
+		for ( const auto& set : hdr_test->psets[i] )
+			{
+			assert(set->re);
+
+			std::string key = std::to_string(i);
+
+			loop_over_list(set->patterns, j)
+				{
+				key += '\0';
+				key += set->patterns[j];
+				key += '\0';
+				key += std::to_string(set->ids[j]);
+				}
+
+			hash128_t digest;
+			KeyedHash::StaticHash128(key.data(), key.size(), &digest);
+			sets->emplace(std::string(reinterpret_cast<const char*>(digest), sizeof(digest)),
+			              set);
+			}
+		}
+
+	for ( RuleHdrTest* h = hdr_test->child; h; h = h->sibling )
+		GetPatternSets(h, sets);
+	}
+
+bool RuleMatcher::LoadDFACache(const char* file)
+	{
+	int fd = open(file, O_RDONLY);
+
+	if ( fd < 0 )
+		{
+		// Not having a cache yet is fine.
+		if ( errno != ENOENT )
+			reporter->Warning("can't open DFA cache %s: %s", file, strerror(errno));
+
+		return false;
+		}
+
+	struct stat st;
+
+	if ( fstat(fd, &st) < 0 || st.st_size < static_cast<off_t>(sizeof(dfa_cache_magic) + 4) )
+		{
+		close(fd);
+		reporter->Warning("ignoring invalid DFA cache %s", file);
+		return false;
+		}
+
+	size_t size = st.st_size;
+	void* mem = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if ( mem == MAP_FAILED )
+		{
+		reporter->Warning("can't map DFA cache %s: %s", file, strerror(errno));
+		return false;
+		}
+
+	std::multimap<std::string, RuleHdrTest::PatternSet*> sets;
+	GetPatternSets(root, &sets);
+
+	const u_char* p = static_cast<const u_char*>(mem);
+	const u_char* end = p + size;
+	bool valid = memcmp(p, dfa_cache_magic, sizeof(dfa_cache_magic)) == 0;
+	p += sizeof(dfa_cache_magic);
+
+	uint32_t num_entries;
+	memcpy(&num_entries, p, sizeof(num_entries));
+	p += sizeof(num_entries);
+
+	// Replaying computes DFA states, which is independent per set. So we
+	// first collect the transitions for each set and then replay them in
+	// parallel.
+	std::vector<RuleHdrTest::PatternSet*> replay_sets;
+	std::vector<std::vector<std::vector<uint32_t>>> replay_xtions;
+	std::map<RuleHdrTest::PatternSet*, size_t> replay_idx;
+
+	for ( uint32_t i = 0; valid && i < num_entries; ++i )
+		{
+		uint32_t num_xtions;
+
+		if ( end - p < static_cast<ptrdiff_t>(sizeof(hash128_t) + sizeof(num_xtions)) )
+			{
+			valid = false;
+			break;
+			}
+
+		std::string digest(reinterpret_cast<const char*>(p), sizeof(hash128_t));
+		p += sizeof(hash128_t);
+		memcpy(&num_xtions, p, sizeof(num_xtions));
+		p += sizeof(num_xtions);
+
+		size_t xtions_size = size_t(num_xtions) * 2 * sizeof(uint32_t);
+
+		if ( static_cast<size_t>(end - p) < xtions_size )
+			{
+			valid = false;
+			break;
+			}
+
+		auto [first, last] = sets.equal_range(digest);
+
+		for ( auto it = first; it != last; ++it )
+			{
+			auto [ri, added] = replay_idx.emplace(it->second, replay_sets.size());
+
+			if ( added )
+				{
+				replay_sets.push_back(it->second);
+				replay_xtions.emplace_back();
+				}
+
+			// The entries aren't necessarily aligned within the file.
+			auto& xtions = replay_xtions[ri->second].emplace_back(2 * num_xtions);
+			memcpy(xtions.data(), p, xtions_size);
+			}
+
+		p += xtions_size;
+		}
+
+	munmap(mem, size);
+
+	std::vector<char> replayed(replay_sets.size(), 1);
+
+	auto replay = [&](size_t i)
+	{
+		auto dfa = replay_sets[i]->re->DFA();
+
+		for ( const auto& xtions : replay_xtions[i] )
+			if ( ! dfa->ReplayXtions(xtions.data(), xtions.size() / 2) )
+				replayed[i] = 0;
+	};
+
+	if ( valid )
+		util::detail::run_parallel(replay_sets.size(), BifConst::signature_compile_threads, replay);
+
+	int warmed = 0;
+
+	for ( auto r : replayed )
+		{
+		if ( r )
+			++warmed;
+		else
+			valid = false;
+		}
+
+	if ( ! valid )
+		{
+		reporter->Warning("ignoring invalid DFA cache %s", file);
+		return false;
+		}
+
+	DBG_LOG(DBG_RULES, "warmed %d of %zu pattern sets from DFA cache %s", warmed, sets.size(),
+	        file);
+	return true;
+	}
+
+bool RuleMatcher::SaveDFACache(const char* file)
+	{
+	std::multimap<std::string, RuleHdrTest::PatternSet*> sets;
+	GetPatternSets(root, &sets);
+
+	// Write to a temporary file first so that concurrently starting
+	// processes never see a partially written cache.
+	std::string tmp = util::fmt("%s.%d.tmp", file, getpid());
+	FILE* f = fopen(tmp.c_str(), "wb");
+
+	if ( ! f )
+		{
+		reporter->Warning("can't write DFA cache %s: %s", tmp.c_str(), strerror(errno));
+		return false;
+		}
+
+	uint32_t num_entries = 0;
+
+	for ( auto it = sets.begin(); it != sets.end(); it = sets.upper_bound(it->first) )
+		++num_entries;
+
+	bool ok = fwrite(dfa_cache_magic, sizeof(dfa_cache_magic), 1, f) == 1 &&
+	          fwrite(&num_entries, sizeof(num_entries), 1, f) == 1;
+
+	// Pattern sets with identical patterns share an entry.
+	for ( auto it = sets.begin(); ok && it != sets.end(); it = sets.upper_bound(it->first) )
+		{
+		std::vector<uint32_t> xtions;
+		it->second->re->DFA()->RecordXtions(&xtions);
+		uint32_t num_xtions = xtions.size() / 2;
+
+		ok = fwrite(it->first.data(), it->first.size(), 1, f) == 1 &&
+		     fwrite(&num_xtions, sizeof(num_xtions), 1, f) == 1 &&
+		     (xtions.empty() ||
+		      fwrite(xtions.data(), sizeof(uint32_t), xtions.size(), f) == xtions.size());
+		}
+
+	if ( fclose(f) != 0 )
+		ok = false;
+
+	if ( ! ok || rename(tmp.c_str(), file) != 0 )
+		{
+		reporter->Warning("can't write DFA cache %s: %s", file, strerror(errno));
+		unlink(tmp.c_str());
+		return false;
+		}
+
+	return true;
+	}
+
 static Val* get_zeek_val(const char* label)
 	{
 	auto id = lookup_ID(label, GLOBAL_MODULE_NAME, false);
@@ -341,10 +341,21 @@ public:
 		// # cache hits (sampled, multiply by MOVE_TO_FRONT_SAMPLE_SIZE)
 		unsigned int hits;
 		unsigned int misses; // # cache misses
+		unsigned int evictions; // # DFA states evicted
 		};
 
 	Val* BuildRuleStateValue(const Rule* rule, const RuleEndpointState* state) const;
 
+	// Precomputes the DFA transitions of all pattern sets that were
+	// written to the given file by SaveDFACache() during a previous run.
+	// Entries are keyed by the patterns of each set, so sets whose
+	// signatures have changed since simply start out cold.
+	bool LoadDFACache(const char* file);
+
+	// Writes the DFA transitions computed so far for all pattern sets to
+	// the given file.
+	bool SaveDFACache(const char* file);
+
 	void GetStats(Stats* stats, RuleHdrTest* hdr_test = nullptr);
 	void DumpStats(File* f);
 
@@ -362,8 +373,12 @@ private:
 	void BuildRegEx(RuleHdrTest* hdr_test, string_list* exprs, int_list* ids);
 
 	// Build groups of regular epxressions.
-	void BuildPatternSets(RuleHdrTest::pattern_set_list* dst, const string_list& exprs,
-	                      const int_list& ids);
+	void BuildPatternSets(RuleHdrTest::pattern_set_list* dst, Rule::PatternType type,
+	                      const string_list& exprs, const int_list& ids);
+
+	// Builds the DFAs of the pattern sets parsed by BuildPatternSets(),
+	// spreading the work across signature_compile_threads threads.
+	void BuildPatternSetDFAs();
 
 	// Check an arbitrary rule if it's satisfied right now.
 	// eos signals end of stream
@@ -386,6 +401,11 @@ private:
 
 	void PrintTreeDebug(RuleHdrTest* node);
 
+	// Collects all pattern sets of the tree below hdr_test, keyed by a
+	// digest of their patterns (for the DFA cache).
+	void GetPatternSets(RuleHdrTest* hdr_test,
+	                    std::multimap<std::string, RuleHdrTest::PatternSet*>* sets);
+
 	void DumpStateStats(File* f, RuleHdrTest* hdr_test);
 
 	static bool AllRulePatternsMatched(const Rule* r, MatchPos matchpos,
@@ -397,6 +417,10 @@ private:
 	RuleHdrTest* root;
 	rule_list rules;
 	rule_dict rules_by_id;
+
+	// Pattern sets awaiting BuildPatternSetDFAs(), along with the
+	// labels for the metrics of their DFAs.
+	std::vector<std::pair<RuleHdrTest::PatternSet*, std::string>> unbuilt_sets;
 	};
 
 // Keeps bi-directional matching-state.
@@ -0,0 +1,91 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/SlabAllocator.h"
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail
+	{
+
+SlabAllocator slab_allocator;
+
+void SlabAllocator::NewSlab(SizeClass& c, size_t block_size)
+	{
+	auto slab = static_cast<char*>(::operator new(SLAB_SIZE));
+
+	// The first granule links to the previous slab.
+	*reinterpret_cast<void**>(slab) = slabs;
+	slabs = slab;
+
+	c.block_size = block_size;
+	c.bump = slab + GRANULARITY;
+	c.bump_end = c.bump + ((SLAB_SIZE - GRANULARITY) / block_size) * block_size;
+	++c.slabs;
+	}
+
+std::vector<SlabAllocator::Stats> SlabAllocator::GetStats() const
+	{
+	std::vector<Stats> rval;
+
+	for ( size_t i = 0; i < NUM_CLASSES; ++i )
+		{
+		const auto& c = classes[i];
+
+		if ( c.slabs > 0 )
+			rval.push_back({(i + 1) * GRANULARITY, c.allocs, c.in_use, c.num_free, c.slabs});
+		}
+
+	return rval;
+	}
+
+TEST_CASE("slab allocator")
+	{
+	SlabAllocator a;
+
+	void* p1 = a.Allocate(24);
+	void* p2 = a.Allocate(32);
+	void* p3 = a.Allocate(40);
+
+	CHECK(reinterpret_cast<uintptr_t>(p1) % SlabAllocator::GRANULARITY == 0);
+	CHECK(reinterpret_cast<uintptr_t>(p3) % SlabAllocator::GRANULARITY == 0);
+
+	// Large allocations bypass the slabs.
+	void* big = a.Allocate(SlabAllocator::MAX_SIZE + 1);
+	a.Free(big, SlabAllocator::MAX_SIZE + 1);
+	a.Free(nullptr, 24);
+
+#ifndef ZEEK_SLAB_PASSTHROUGH
+	auto stats = a.GetStats();
+	REQUIRE(stats.size() == 2);
+	CHECK(stats[0].size == 32);
+	CHECK(stats[0].in_use == 2);
+	CHECK(stats[1].size == 48);
+
+	// Sizes within the same class share freed blocks.
+	a.Free(p1, 24);
+	CHECK(a.Allocate(17) == p1);
+	a.Free(p2, 32);
+	CHECK(a.Allocate(32) == p2);
+
+	stats = a.GetStats();
+	CHECK(stats[0].allocs == 4);
+	CHECK(stats[0].in_use == 2);
+	CHECK(stats[0].free == 0);
+	CHECK(stats[0].slabs == 1);
+
+	// Filling up a slab moves on to the next one.
+	size_t per_slab = (SlabAllocator::SLAB_SIZE - SlabAllocator::GRANULARITY) / 48;
+	for ( size_t i = 0; i < per_slab; ++i )
+		a.Allocate(48);
+
+	stats = a.GetStats();
+	CHECK(stats[1].slabs == 2);
+	CHECK(stats[1].in_use == per_slab + 1);
+#endif
+
+	a.Free(p1, 24);
+	a.Free(p2, 32);
+	a.Free(p3, 40);
+	}
+
+	} // namespace zeek::detail
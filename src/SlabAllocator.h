@@ -0,0 +1,145 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// A size-class allocator for small, short-lived objects such as Vals and
+// Strings.  Blocks come out of large slabs and go onto a free list per
+// size class when released, from which later allocations of the same
+// class get served.  Slabs never get returned to the system, so memory
+// freed by a burst of allocations remains available for the next burst
+// instead of fragmenting the heap.
+//
+// Like reference counting of Vals, the allocator isn't thread-safe: it
+// must only be used from the main thread.  When running under a memory
+// checker, all allocations go straight to the system allocator so that
+// the checker keeps seeing them.
+
+#pragma once
+
+#include "zeek/zeek-config.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define ZEEK_SLAB_PASSTHROUGH
+#endif
+#endif
+
+#if defined(__SANITIZE_ADDRESS__) || defined(USE_PERFTOOLS_DEBUG)
+#define ZEEK_SLAB_PASSTHROUGH
+#endif
+
+namespace zeek::detail
+	{
+
+class SlabAllocator
+	{
+public:
+	// Sizes get rounded up to a multiple of the granularity, which also
+	// is the alignment of the blocks.  Larger objects bypass the slabs.
+	static constexpr size_t GRANULARITY = 16;
+	static constexpr size_t MAX_SIZE = 256;
+	static constexpr size_t NUM_CLASSES = MAX_SIZE / GRANULARITY;
+	static constexpr size_t SLAB_SIZE = 64 * 1024;
+
+	struct Stats
+		{
+		size_t size; // of the blocks of the class
+		uint64_t allocs; // total number of allocations
+		uint64_t in_use; // number of blocks currently allocated
+		uint64_t free; // number of blocks on the free list
+		uint64_t slabs; // number of slabs carved up for the class
+		};
+
+	void* Allocate(size_t n)
+		{
+#ifdef ZEEK_SLAB_PASSTHROUGH
+		return ::operator new(n);
+#else
+		if ( n == 0 || n > MAX_SIZE )
+			return ::operator new(n);
+
+		auto& c = classes[(n - 1) / GRANULARITY];
+		++c.allocs;
+		++c.in_use;
+
+		if ( auto b = c.free_list )
+			{
+			c.free_list = b->next;
+			--c.num_free;
+			return b;
+			}
+
+		if ( c.bump == c.bump_end )
+			NewSlab(c, (n + GRANULARITY - 1) & ~(GRANULARITY - 1));
+
+		auto b = c.bump;
+		c.bump += c.block_size;
+		return b;
+#endif
+		}
+
+	// The size must be the one passed to Allocate().
+	void Free(void* p, size_t n)
+		{
+		if ( ! p )
+			return;
+
+#ifdef ZEEK_SLAB_PASSTHROUGH
+		::operator delete(p);
+#else
+		if ( n == 0 || n > MAX_SIZE )
+			{
+			::operator delete(p);
+			return;
+			}
+
+		auto& c = classes[(n - 1) / GRANULARITY];
+		auto b = static_cast<Block*>(p);
+		b->next = c.free_list;
+		c.free_list = b;
+		++c.num_free;
+		--c.in_use;
+#endif
+		}
+
+	// Returns the statistics of the size classes that have slabs.
+	std::vector<Stats> GetStats() const;
+
+private:
+	struct Block
+		{
+		Block* next;
+		};
+
+	struct SizeClass
+		{
+		Block* free_list = nullptr;
+
+		// The part of the most recent slab not handed out yet.
+		char* bump = nullptr;
+		char* bump_end = nullptr;
+		size_t block_size = 0;
+
+		uint64_t allocs = 0;
+		uint64_t in_use = 0;
+		uint64_t num_free = 0;
+		uint64_t slabs = 0;
+		};
+
+	void NewSlab(SizeClass& c, size_t block_size);
+
+	SizeClass classes[NUM_CLASSES];
+
+	// All slabs, chained through their first bytes so that they
+	// remain reachable.
+	void* slabs = nullptr;
+	};
+
+// Used by Val, String and TableEntryVal.  Constant-initialized, so it's
+// available to objects created during static initialization, too.
+extern SlabAllocator slab_allocator;
+
+	} // namespace zeek::detail
@@ -10,6 +10,7 @@
 #include "zeek/RuleMatcher.h"
 #include "zeek/RunState.h"
 #include "zeek/Scope.h"
+#include "zeek/SlabAllocator.h"
 #include "zeek/Trigger.h"
 #include "zeek/broker/Manager.h"
 #include "zeek/input.h"
@@ -190,6 +191,13 @@ void ProfileLogger::Log()
 	file->Write(util::fmt("%.06f Triggers: total=%lu pending=%lu\n", run_state::network_time,
 	                      tstats.total, tstats.pending));
 
+	// Slabs of Vals, Strings and table entries, per size class.
+	for ( const auto& s : slab_allocator.GetStats() )
+		file->Write(util::fmt("%.06f Slabs: size=%zu allocs=%" PRIu64 " in_use=%" PRIu64
+		                      " free=%" PRIu64 " slabs=%" PRIu64 " mem=%" PRIu64 "K\n",
+		                      run_state::network_time, s.size, s.allocs, s.in_use, s.free,
+		                      s.slabs, s.slabs * SlabAllocator::SLAB_SIZE / 1024));
+
 	unsigned int* current_timers = TimerMgr::CurrentTimers();
 	for ( int i = 0; i < NUM_TIMER_TYPES; ++i )
 		{
@@ -0,0 +1,575 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/StringKernels.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define ZEEK_STRING_KERNELS_X86 1
+#include <immintrin.h>
+#define ZEEK_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail
+	{
+
+namespace
+	{
+
+struct Kernels
+	{
+	const char* isa;
+	void (*to_lower)(const u_char* src, u_char* dst, size_t n);
+	void (*to_upper)(const u_char* src, u_char* dst, size_t n);
+	size_t (*find_non_ascii)(const u_char* s, size_t n);
+	size_t (*find_escapable)(const u_char* s, size_t n, int flags);
+	ptrdiff_t (*find_substring)(const u_char* big, size_t big_len, const u_char* little,
+	                            size_t little_len);
+	void (*hex_encode)(const u_char* src, size_t n, char* dst);
+	};
+
+const char hex_digits[] = "0123456789abcdef";
+
+// ---- Portable versions.  These also handle the tails of the vector loops.
+
+void scalar_to_lower(const u_char* src, u_char* dst, size_t n)
+	{
+	for ( size_t i = 0; i < n; ++i )
+		{
+		u_char c = src[i];
+		dst[i] = static_cast<u_char>(c - 'A') < 26 ? c | 0x20 : c;
+		}
+	}
+
+void scalar_to_upper(const u_char* src, u_char* dst, size_t n)
+	{
+	for ( size_t i = 0; i < n; ++i )
+		{
+		u_char c = src[i];
+		dst[i] = static_cast<u_char>(c - 'a') < 26 ? c & ~0x20 : c;
+		}
+	}
+
+size_t scalar_find_non_ascii(const u_char* s, size_t n)
+	{
+	size_t i = 0;
+
+	// Check a word at a time before looking for the exact byte.
+	for ( ; i + 8 <= n; i += 8 )
+		{
+		uint64_t w;
+		memcpy(&w, s + i, sizeof(w));
+		if ( w & 0x8080808080808080ULL )
+			break;
+		}
+
+	for ( ; i < n; ++i )
+		if ( s[i] & 0x80 )
+			return i;
+
+	return n;
+	}
+
+inline bool is_escapable(u_char c, int flags)
+	{
+	if ( (flags & ESCAPE_UNPRINTABLE) && (c < 0x20 || c > 0x7e) )
+		return true;
+
+	if ( (flags & ESCAPE_BACKSLASH) && c == '\\' )
+		return true;
+
+	if ( (flags & ESCAPE_QUOTES) && (c == '\'' || c == '"') )
+		return true;
+
+	return false;
+	}
+
+size_t scalar_find_escapable(const u_char* s, size_t n, int flags)
+	{
+	for ( size_t i = 0; i < n; ++i )
+		if ( is_escapable(s[i], flags) )
+			return i;
+
+	return n;
+	}
+
+ptrdiff_t scalar_find_substring(const u_char* big, size_t big_len, const u_char* little,
+                                size_t little_len)
+	{
+	if ( little_len == 0 )
+		return 0;
+
+	if ( little_len > big_len )
+		return -1;
+
+	// memchr() is vectorized by any libc worth its salt, so let it find
+	// the candidates.
+	const u_char* p = big;
+	const u_char* last = big + big_len - little_len;
+
+	while ( p <= last )
+		{
+		p = static_cast<const u_char*>(memchr(p, little[0], last - p + 1));
+		if ( ! p )
+			break;
+
+		if ( memcmp(p + 1, little + 1, little_len - 1) == 0 )
+			return p - big;
+
+		++p;
+		}
+
+	return -1;
+	}
+
+void scalar_hex_encode(const u_char* src, size_t n, char* dst)
+	{
+	for ( size_t i = 0; i < n; ++i )
+		{
+		*dst++ = hex_digits[src[i] >> 4];
+		*dst++ = hex_digits[src[i] & 0x0f];
+		}
+	}
+
+constexpr Kernels scalar_kernels = {
+	"scalar",
+	scalar_to_lower,
+	scalar_to_upper,
+	scalar_find_non_ascii,
+	scalar_find_escapable,
+	scalar_find_substring,
+	scalar_hex_encode,
+};
+
+#ifdef ZEEK_STRING_KERNELS_X86
+
+// ---- SSE2, which every x86-64 CPU has.
+
+// Returns 0x20 in each lane whose byte lies within [lo, hi].  Bytes >= 0x80
+// compare as negative and so never match an ASCII range.
+inline __m128i sse2_case_bit(__m128i x, char lo, char hi)
+	{
+	__m128i in_range = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8(lo - 1)),
+	                                 _mm_cmpgt_epi8(_mm_set1_epi8(hi + 1), x));
+	return _mm_and_si128(in_range, _mm_set1_epi8(0x20));
+	}
+
+void sse2_to_lower(const u_char* src, u_char* dst, size_t n)
+	{
+	size_t i = 0;
+
+	for ( ; i + 16 <= n; i += 16 )
+		{
+		__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		x = _mm_or_si128(x, sse2_case_bit(x, 'A', 'Z'));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), x);
+		}
+
+	scalar_to_lower(src + i, dst + i, n - i);
+	}
+
+void sse2_to_upper(const u_char* src, u_char* dst, size_t n)
+	{
+	size_t i = 0;
+
+	for ( ; i + 16 <= n; i += 16 )
+		{
+		__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		x = _mm_xor_si128(x, sse2_case_bit(x, 'a', 'z'));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), x);
+		}
+
+	scalar_to_upper(src + i, dst + i, n - i);
+	}
+
+size_t sse2_find_non_ascii(const u_char* s, size_t n)
+	{
+	size_t i = 0;
+
+	for ( ; i + 16 <= n; i += 16 )
+		{
+		__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+		if ( int m = _mm_movemask_epi8(x) )
+			return i + __builtin_ctz(m);
+		}
+
+	return i + scalar_find_non_ascii(s + i, n - i);
+	}
+
+size_t sse2_find_escapable(const u_char* s, size_t n, int flags)
+	{
+	const bool unprintable = flags & ESCAPE_UNPRINTABLE;
+	const bool backslash = flags & ESCAPE_BACKSLASH;
+	const bool quotes = flags & ESCAPE_QUOTES;
+	size_t i = 0;
+
+	for ( ; i + 16 <= n; i += 16 )
+		{
+		__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+		__m128i m = _mm_setzero_si128();
+
+		// As a signed compare, "< 0x20" also catches everything >= 0x80.
+		if ( unprintable )
+			m = _mm_or_si128(_mm_cmpgt_epi8(_mm_set1_epi8(0x20), x),
+			                 _mm_cmpeq_epi8(x, _mm_set1_epi8(0x7f)));
+		if ( backslash )
+			m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('\\')));
+		if ( quotes )
+			m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\'')),
+			                                 _mm_cmpeq_epi8(x, _mm_set1_epi8('"'))));
+
+		if ( int bits = _mm_movemask_epi8(m) )
+			return i + __builtin_ctz(bits);
+		}
+
+	return i + scalar_find_escapable(s + i, n - i, flags);
+	}
+
+// Compares the first and last needle byte against 16 candidate positions at
+// once and only runs memcmp() where both match.
+ptrdiff_t sse2_find_substring(const u_char* big, size_t big_len, const u_char* little,
+                              size_t little_len)
+	{
+	if ( little_len < 2 || little_len > big_len )
+		return scalar_find_substring(big, big_len, little, little_len);
+
+	const __m128i first = _mm_set1_epi8(little[0]);
+	const __m128i last = _mm_set1_epi8(little[little_len - 1]);
+	size_t i = 0;
+
+	for ( ; i + little_len + 15 <= big_len; i += 16 )
+		{
+		__m128i bf = _mm_loadu_si128(reinterpret_cast<const __m128i*>(big + i));
+		__m128i bl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(big + i + little_len - 1));
+		unsigned m = _mm_movemask_epi8(
+			_mm_and_si128(_mm_cmpeq_epi8(bf, first), _mm_cmpeq_epi8(bl, last)));
+
+		while ( m )
+			{
+			unsigned bit = __builtin_ctz(m);
+			if ( memcmp(big + i + bit + 1, little + 1, little_len - 2) == 0 )
+				return i + bit;
+			m &= m - 1;
+			}
+		}
+
+	ptrdiff_t r = scalar_find_substring(big + i, big_len - i, little, little_len);
+	return r < 0 ? -1 : static_cast<ptrdiff_t>(i) + r;
+	}
+
+inline __m128i sse2_nibble_to_hex(__m128i v)
+	{
+	__m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(9)),
+	                              _mm_set1_epi8('a' - '0' - 10));
+	return _mm_add_epi8(_mm_add_epi8(v, _mm_set1_epi8('0')), alpha);
+	}
+
+void sse2_hex_encode(const u_char* src, size_t n, char* dst)
+	{
+	const __m128i low_nibble = _mm_set1_epi8(0x0f);
+	size_t i = 0;
+
+	for ( ; i + 16 <= n; i += 16 )
+		{
+		__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		__m128i hi = sse2_nibble_to_hex(_mm_and_si128(_mm_srli_epi16(x, 4), low_nibble));
+		__m128i lo = sse2_nibble_to_hex(_mm_and_si128(x, low_nibble));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i), _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i + 16),
+		                 _mm_unpackhi_epi8(hi, lo));
+		}
+
+	scalar_hex_encode(src + i, n - i, dst + 2 * i);
+	}
+
+constexpr Kernels sse2_kernels = {
+	"sse2",
+	sse2_to_lower,
+	sse2_to_upper,
+	sse2_find_non_ascii,
+	sse2_find_escapable,
+	sse2_find_substring,
+	sse2_hex_encode,
+};
+
+// ---- AVX2, used when the CPU reports it.  Hex encoding sticks with the
+// SSE2 version, since the AVX2 unpacks don't cross 128-bit lanes.
+
+ZEEK_TARGET_AVX2 inline __m256i avx2_case_bit(__m256i x, char lo, char hi)
+	{
+	__m256i in_range = _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8(lo - 1)),
+	                                    _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), x));
+	return _mm256_and_si256(in_range, _mm256_set1_epi8(0x20));
+	}
+
+ZEEK_TARGET_AVX2 void avx2_to_lower(const u_char* src, u_char* dst, size_t n)
+	{
+	size_t i = 0;
+
+	for ( ; i + 32 <= n; i += 32 )
+		{
+		__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+		x = _mm256_or_si256(x, avx2_case_bit(x, 'A', 'Z'));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), x);
+		}
+
+	sse2_to_lower(src + i, dst + i, n - i);
+	}
+
+ZEEK_TARGET_AVX2 void avx2_to_upper(const u_char* src, u_char* dst, size_t n)
+	{
+	size_t i = 0;
+
+	for ( ; i + 32 <= n; i += 32 )
+		{
+		__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+		x = _mm256_xor_si256(x, avx2_case_bit(x, 'a', 'z'));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), x);
+		}
+
+	sse2_to_upper(src + i, dst + i, n - i);
+	}
+
+ZEEK_TARGET_AVX2 size_t avx2_find_non_ascii(const u_char* s, size_t n)
+	{
+	size_t i = 0;
+
+	for ( ; i + 32 <= n; i += 32 )
+		{
+		__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+		if ( unsigned m = _mm256_movemask_epi8(x) )
+			return i + __builtin_ctz(m);
+		}
+
+	return i + sse2_find_non_ascii(s + i, n - i);
+	}
+
+ZEEK_TARGET_AVX2 size_t avx2_find_escapable(const u_char* s, size_t n, int flags)
+	{
+	const bool unprintable = flags & ESCAPE_UNPRINTABLE;
+	const bool backslash = flags & ESCAPE_BACKSLASH;
+	const bool quotes = flags & ESCAPE_QUOTES;
+	size_t i = 0;
+
+	for ( ; i + 32 <= n; i += 32 )
+		{
+		__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+		__m256i m = _mm256_setzero_si256();
+
+		if ( unprintable )
+			m = _mm256_or_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(0x20), x),
+			                    _mm256_cmpeq_epi8(x, _mm256_set1_epi8(0x7f)));
+		if ( backslash )
+			m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\\')));
+		if ( quotes )
+			m = _mm256_or_si256(m,
+			                    _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\'')),
+			                                    _mm256_cmpeq_epi8(x, _mm256_set1_epi8('"'))));
+
+		if ( unsigned bits = _mm256_movemask_epi8(m) )
+			return i + __builtin_ctz(bits);
+		}
+
+	return i + sse2_find_escapable(s + i, n - i, flags);
+	}
+
+ZEEK_TARGET_AVX2 ptrdiff_t avx2_find_substring(const u_char* big, size_t big_len,
+                                               const u_char* little, size_t little_len)
+	{
+	if ( little_len < 2 || little_len > big_len )
+		return scalar_find_substring(big, big_len, little, little_len);
+
+	const __m256i first = _mm256_set1_epi8(little[0]);
+	const __m256i last = _mm256_set1_epi8(little[little_len - 1]);
+	size_t i = 0;
+
+	for ( ; i + little_len + 31 <= big_len; i += 32 )
+		{
+		__m256i bf = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(big + i));
+		__m256i bl = _mm256_loadu_si256(
+			reinterpret_cast<const __m256i*>(big + i + little_len - 1));
+		unsigned m = _mm256_movemask_epi8(
+			_mm256_and_si256(_mm256_cmpeq_epi8(bf, first), _mm256_cmpeq_epi8(bl, last)));
+
+		while ( m )
+			{
+			unsigned bit = __builtin_ctz(m);
+			if ( memcmp(big + i + bit + 1, little + 1, little_len - 2) == 0 )
+				return i + bit;
+			m &= m - 1;
+			}
+		}
+
+	ptrdiff_t r = sse2_find_substring(big + i, big_len - i, little, little_len);
+	return r < 0 ? -1 : static_cast<ptrdiff_t>(i) + r;
+	}
+
+constexpr Kernels avx2_kernels = {
+	"avx2",
+	avx2_to_lower,
+	avx2_to_upper,
+	avx2_find_non_ascii,
+	avx2_find_escapable,
+	avx2_find_substring,
+	sse2_hex_encode,
+};
+
+#endif // ZEEK_STRING_KERNELS_X86
+
+const Kernels& select_kernels()
+	{
+#ifdef ZEEK_STRING_KERNELS_X86
+	__builtin_cpu_init();
+
+	if ( __builtin_cpu_supports("avx2") )
+		return avx2_kernels;
+
+	return sse2_kernels;
+#else
+	return scalar_kernels;
+#endif
+	}
+
+const Kernels& kernels()
+	{
+	static const Kernels& k = select_kernels();
+	return k;
+	}
+
+	} // namespace
+
+void ascii_to_lower(const u_char* src, u_char* dst, size_t n)
+	{
+	kernels().to_lower(src, dst, n);
+	}
+
+void ascii_to_upper(const u_char* src, u_char* dst, size_t n)
+	{
+	kernels().to_upper(src, dst, n);
+	}
+
+size_t find_non_ascii(const u_char* s, size_t n)
+	{
+	return kernels().find_non_ascii(s, n);
+	}
+
+size_t find_escapable(const u_char* s, size_t n, int flags)
+	{
+	return kernels().find_escapable(s, n, flags);
+	}
+
+ptrdiff_t find_substring(const u_char* big, size_t big_len, const u_char* little,
+                         size_t little_len)
+	{
+	return kernels().find_substring(big, big_len, little, little_len);
+	}
+
+void hex_encode(const u_char* src, size_t n, char* dst)
+	{
+	kernels().hex_encode(src, n, dst);
+	}
+
+const char* string_kernels_isa()
+	{
+	return kernels().isa;
+	}
+
+TEST_SUITE("string_kernels")
+	{
+
+// Checks a kernel variant against the scalar reference on every length up
+// to a few vector widths, so each of the loop tails gets exercised.
+static void check_against_scalar(const Kernels& k)
+	{
+	std::vector<u_char> buf(200);
+	for ( size_t i = 0; i < buf.size(); ++i )
+		buf[i] = static_cast<u_char>((i * 37 + 11) & 0x7f);
+
+	const char needle[] = "needle";
+	const auto* nb = reinterpret_cast<const u_char*>(needle);
+
+	for ( size_t n = 0; n <= 100; ++n )
+		{
+		std::vector<u_char> a(n + 1), b(n + 1);
+		scalar_to_lower(buf.data(), a.data(), n);
+		k.to_lower(buf.data(), b.data(), n);
+		CHECK(memcmp(a.data(), b.data(), n) == 0);
+
+		scalar_to_upper(buf.data(), a.data(), n);
+		k.to_upper(buf.data(), b.data(), n);
+		CHECK(memcmp(a.data(), b.data(), n) == 0);
+
+		CHECK_EQ(k.find_non_ascii(buf.data(), n), n);
+		CHECK_EQ(k.find_escapable(buf.data(), n, ESCAPE_QUOTES),
+		         scalar_find_escapable(buf.data(), n, ESCAPE_QUOTES));
+		CHECK_EQ(k.find_escapable(buf.data(), n, ESCAPE_UNPRINTABLE | ESCAPE_BACKSLASH),
+		         scalar_find_escapable(buf.data(), n, ESCAPE_UNPRINTABLE | ESCAPE_BACKSLASH));
+
+		std::string ha(2 * n, ' '), hb(2 * n, ' ');
+		scalar_hex_encode(buf.data(), n, &ha[0]);
+		k.hex_encode(buf.data(), n, &hb[0]);
+		CHECK_EQ(ha, hb);
+
+		// Plant the needle at the end and one byte of it past the end.
+		std::vector<u_char> hay(n + 6, 'n');
+		memcpy(hay.data() + n, needle, 6);
+		CHECK_EQ(k.find_substring(hay.data(), n + 6, nb, 6), static_cast<ptrdiff_t>(n));
+		CHECK_EQ(k.find_substring(hay.data(), n + 5, nb, 6), -1);
+		CHECK_EQ(k.find_substring(hay.data(), n + 6, nb, 1), 0);
+		CHECK_EQ(k.find_substring(hay.data(), n + 6, nb, 0), 0);
+
+		std::vector<u_char> hi(buf.begin(), buf.begin() + n);
+		if ( n > 0 )
+			{
+			hi[n - 1] = 0xe9;
+			CHECK_EQ(k.find_non_ascii(hi.data(), n), n - 1);
+			CHECK_EQ(k.find_escapable(hi.data(), n, ESCAPE_UNPRINTABLE),
+			         scalar_find_escapable(hi.data(), n, ESCAPE_UNPRINTABLE));
+			}
+		}
+	}
+
+TEST_CASE("scalar kernels")
+	{
+	const auto* s = reinterpret_cast<const u_char*>("Hello, \"World\"\\\x7f\xff");
+	u_char out[17];
+
+	scalar_to_lower(s, out, 17);
+	CHECK(memcmp(out, "hello, \"world\"\\\x7f\xff", 17) == 0);
+	scalar_to_upper(s, out, 17);
+	CHECK(memcmp(out, "HELLO, \"WORLD\"\\\x7f\xff", 17) == 0);
+
+	CHECK_EQ(scalar_find_non_ascii(s, 17), 16u);
+	CHECK_EQ(scalar_find_escapable(s, 17, ESCAPE_QUOTES), 7u);
+	CHECK_EQ(scalar_find_escapable(s, 17, ESCAPE_BACKSLASH), 14u);
+	CHECK_EQ(scalar_find_escapable(s, 17, ESCAPE_UNPRINTABLE), 15u);
+	CHECK_EQ(scalar_find_escapable(s, 14, ESCAPE_UNPRINTABLE), 14u);
+
+	char hex[6];
+	scalar_hex_encode(reinterpret_cast<const u_char*>("\x00\xab\x7f"), 3, hex);
+	CHECK(memcmp(hex, "00ab7f", 6) == 0);
+
+	CHECK_EQ(scalar_find_substring(s, 17, reinterpret_cast<const u_char*>("World"), 5), 8);
+	CHECK_EQ(scalar_find_substring(s, 17, reinterpret_cast<const u_char*>("world"), 5), -1);
+	}
+
+TEST_CASE("vector kernels match scalar")
+	{
+	check_against_scalar(kernels());
+
+#ifdef ZEEK_STRING_KERNELS_X86
+	check_against_scalar(sse2_kernels);
+
+	if ( __builtin_cpu_supports("avx2") )
+		check_against_scalar(avx2_kernels);
+#endif
+	}
+
+	}
+
+	} // namespace zeek::detail
@@ -0,0 +1,47 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Vectorized building blocks for the byte-oriented string BiFs.
+//
+// Each kernel has a portable scalar implementation plus SSE2 and AVX2
+// variants on x86-64.  The variant is picked once, at first use, based on
+// what the CPU supports, so callers never need to care.
+
+#pragma once
+
+#include <sys/types.h> // for u_char
+#include <cstddef>
+
+namespace zeek::detail
+	{
+
+// Byte classes for find_escapable().
+constexpr int ESCAPE_UNPRINTABLE = 0x1; // outside [0x20, 0x7e]
+constexpr int ESCAPE_BACKSLASH = 0x2; // '\'
+constexpr int ESCAPE_QUOTES = 0x4; // '\'' and '"'
+
+// Copies n bytes from src to dst, folding ASCII letters to lower (upper)
+// case.  Bytes outside [A-Z] ([a-z]) pass through unchanged.  src and dst
+// may be identical.
+extern void ascii_to_lower(const u_char* src, u_char* dst, size_t n);
+extern void ascii_to_upper(const u_char* src, u_char* dst, size_t n);
+
+// Returns the offset of the first byte > 127, or n if there is none.
+extern size_t find_non_ascii(const u_char* s, size_t n);
+
+// Returns the offset of the first byte that falls into one of the
+// ESCAPE_* classes given in flags, or n if there is none.
+extern size_t find_escapable(const u_char* s, size_t n, int flags);
+
+// Returns the offset of the first occurrence of little in big, or -1.
+// An empty needle matches at offset 0.
+extern ptrdiff_t find_substring(const u_char* big, size_t big_len, const u_char* little,
+                                size_t little_len);
+
+// Writes the lowercase hex encoding of the n bytes at src to dst, which
+// must have room for 2 * n characters.  No NUL is appended.
+extern void hex_encode(const u_char* src, size_t n, char* dst);
+
+// Returns the name of the kernel variant in use ("scalar", "sse2", "avx2").
+extern const char* string_kernels_isa();
+
+	} // namespace zeek::detail
@@ -0,0 +1,244 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/TableEviction.h"
+
+#include <cstring>
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail
+	{
+
+TableEvictionIndex::~TableEvictionIndex()
+	{
+	Clear();
+	}
+
+void TableEvictionIndex::Add(const HashKey& k, const TableEntryVal* entry)
+	{
+	auto n = new Node(k, entry);
+	nodes[entry] = n;
+
+	uint64_t count = policy == LFU ? 1 : 0;
+
+	if ( lowest && lowest->count == count )
+		Link(n, lowest);
+	else
+		Link(n, BucketAfter(nullptr, count));
+	}
+
+void TableEvictionIndex::Replace(const TableEntryVal* old_entry, const TableEntryVal* new_entry)
+	{
+	auto it = nodes.find(old_entry);
+	if ( it == nodes.end() )
+		return;
+
+	auto n = it->second;
+	nodes.erase(it);
+
+	n->entry = new_entry;
+	nodes[new_entry] = n;
+
+	Access(n);
+	}
+
+void TableEvictionIndex::Touch(const TableEntryVal* entry)
+	{
+	auto it = nodes.find(entry);
+	if ( it != nodes.end() )
+		Access(it->second);
+	}
+
+void TableEvictionIndex::Remove(const TableEntryVal* entry)
+	{
+	auto it = nodes.find(entry);
+	if ( it == nodes.end() )
+		return;
+
+	Unlink(it->second);
+	delete it->second;
+	nodes.erase(it);
+	}
+
+const HashKey* TableEvictionIndex::Victim(const TableEntryVal* exclude) const
+	{
+	// As only a single entry gets excluded, this looks at no more
+	// than two nodes.
+	for ( auto b = lowest; b; b = b->higher )
+		for ( auto n = b->oldest; n; n = n->newer )
+			if ( n->entry != exclude )
+				return &n->key;
+
+	return nullptr;
+	}
+
+void TableEvictionIndex::Clear()
+	{
+	for ( auto& n : nodes )
+		delete n.second;
+
+	nodes.clear();
+
+	while ( lowest )
+		{
+		auto b = lowest;
+		lowest = b->higher;
+		delete b;
+		}
+	}
+
+void TableEvictionIndex::Access(Node* n)
+	{
+	auto b = n->bucket;
+
+	if ( policy == LRU )
+		{
+		if ( b->newest != n )
+			{
+			// The bucket holds other nodes, so it stays put.
+			Unlink(n);
+			Link(n, b);
+			}
+
+		return;
+		}
+
+	auto count = b->count + 1;
+	auto target = (b->higher && b->higher->count == count) ? b->higher : BucketAfter(b, count);
+
+	Unlink(n);
+	Link(n, target);
+	}
+
+void TableEvictionIndex::Link(Node* n, Bucket* b)
+	{
+	n->bucket = b;
+	n->newer = nullptr;
+	n->older = b->newest;
+
+	if ( b->newest )
+		b->newest->newer = n;
+	else
+		b->oldest = n;
+
+	b->newest = n;
+	}
+
+void TableEvictionIndex::Unlink(Node* n)
+	{
+	auto b = n->bucket;
+
+	if ( n->newer )
+		n->newer->older = n->older;
+	else
+		b->newest = n->older;
+
+	if ( n->older )
+		n->older->newer = n->newer;
+	else
+		b->oldest = n->newer;
+
+	n->bucket = nullptr;
+	n->newer = n->older = nullptr;
+
+	if ( b->newest )
+		return;
+
+	if ( b->lower )
+		b->lower->higher = b->higher;
+	else
+		lowest = b->higher;
+
+	if ( b->higher )
+		b->higher->lower = b->lower;
+
+	delete b;
+	}
+
+TableEvictionIndex::Bucket* TableEvictionIndex::BucketAfter(Bucket* lower, uint64_t count)
+	{
+	auto b = new Bucket;
+	b->count = count;
+	b->lower = lower;
+	b->higher = lower ? lower->higher : lowest;
+
+	if ( b->higher )
+		b->higher->lower = b;
+
+	if ( lower )
+		lower->higher = b;
+	else
+		lowest = b;
+
+	return b;
+	}
+
+// The index never dereferences the entries, so any distinct pointers
+// will do.
+static char test_entries[4];
+
+static const TableEntryVal* test_entry(int i)
+	{
+	return reinterpret_cast<const TableEntryVal*>(&test_entries[i]);
+	}
+
+TEST_CASE("table eviction lru")
+	{
+	HashKey k0(zeek_int_t(0)), k1(zeek_int_t(1)), k2(zeek_int_t(2));
+	TableEvictionIndex idx(TableEvictionIndex::LRU);
+	CHECK(idx.Victim() == nullptr);
+
+	idx.Add(k0, test_entry(0));
+	idx.Add(k1, test_entry(1));
+	idx.Add(k2, test_entry(2));
+	CHECK(*idx.Victim() == k0);
+	CHECK(*idx.Victim(test_entry(0)) == k1);
+
+	idx.Touch(test_entry(0));
+	CHECK(*idx.Victim() == k1);
+
+	// A replacement keeps the key, but counts as an access.
+	idx.Replace(test_entry(1), test_entry(3));
+	CHECK(*idx.Victim() == k2);
+
+	idx.Remove(test_entry(2));
+	CHECK(*idx.Victim() == k0);
+	CHECK(idx.Size() == 2);
+
+	idx.Clear();
+	CHECK(idx.Size() == 0);
+	CHECK(idx.Victim() == nullptr);
+	}
+
+TEST_CASE("table eviction lfu")
+	{
+	HashKey k0(zeek_int_t(0)), k1(zeek_int_t(1)), k2(zeek_int_t(2));
+	TableEvictionIndex idx(TableEvictionIndex::LFU);
+
+	idx.Add(k0, test_entry(0));
+	idx.Add(k1, test_entry(1));
+	idx.Touch(test_entry(0));
+	idx.Touch(test_entry(0));
+	idx.Touch(test_entry(1));
+
+	// Fewer accesses lose, regardless of recency.
+	CHECK(*idx.Victim() == k1);
+
+	idx.Add(k2, test_entry(2));
+	CHECK(*idx.Victim() == k2);
+	CHECK(*idx.Victim(test_entry(2)) == k1);
+
+	// Ties go to the least recently used entry.
+	idx.Touch(test_entry(2));
+	CHECK(*idx.Victim() == k1);
+	idx.Touch(test_entry(1));
+	CHECK(*idx.Victim() == k2);
+
+	idx.Remove(test_entry(2));
+	idx.Remove(test_entry(1));
+	CHECK(*idx.Victim() == k0);
+	idx.Remove(test_entry(0));
+	CHECK(idx.Victim() == nullptr);
+	}
+
+	} // namespace zeek::detail
@@ -0,0 +1,120 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Bookkeeping for tables with a &max_size attribute, which decides which
+// entry to evict once such a table grows beyond its cap.
+//
+// The index tracks the table's entries by their TableEntryVal, along with
+// a copy of their key, ordered by how recently (LRU) or how often and then
+// how recently (LFU) they were accessed.  Entries with the same access
+// count live in a bucket of their own, ordered by recency, and the buckets
+// are ordered by count.  That way adding, removing and accessing entries,
+// as well as finding the next victim, all take constant time.
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+
+#include "zeek/Hash.h"
+
+namespace zeek
+	{
+
+class TableEntryVal;
+
+namespace detail
+	{
+
+class TableEvictionIndex
+	{
+public:
+	enum Policy
+		{
+		LRU,
+		LFU
+		};
+
+	explicit TableEvictionIndex(Policy p) : policy(p) { }
+	~TableEvictionIndex();
+
+	Policy GetPolicy() const { return policy; }
+
+	// Starts tracking the given entry, newly inserted with the given
+	// key.  The insertion counts as an access.
+	void Add(const HashKey& k, const TableEntryVal* entry);
+
+	// Replaces the tracked entry "old_entry" with "new_entry", which
+	// was assigned to the same key.  The assignment counts as an
+	// access.
+	void Replace(const TableEntryVal* old_entry, const TableEntryVal* new_entry);
+
+	// Records an access to the given entry, if it's tracked.
+	void Touch(const TableEntryVal* entry);
+
+	// Stops tracking the given entry, if it's tracked.
+	void Remove(const TableEntryVal* entry);
+
+	// Returns the key of the entry to evict next, not considering
+	// "exclude", or nil if there's none.  The key remains valid until
+	// its entry gets removed.
+	const HashKey* Victim(const TableEntryVal* exclude = nullptr) const;
+
+	// Stops tracking all entries.
+	void Clear();
+
+	size_t Size() const { return nodes.size(); }
+
+private:
+	struct Bucket;
+
+	struct Node
+		{
+		Node(const HashKey& k, const TableEntryVal* e)
+			: key(k.Key(), k.Size(), k.Hash()), entry(e)
+			{
+			}
+
+		HashKey key;
+		const TableEntryVal* entry;
+		Bucket* bucket = nullptr;
+
+		// Towards the more recently used nodes of the bucket, and
+		// towards the less recently used ones.
+		Node* newer = nullptr;
+		Node* older = nullptr;
+		};
+
+	struct Bucket
+		{
+		uint64_t count = 0;
+		Node* newest = nullptr;
+		Node* oldest = nullptr;
+
+		// Towards buckets with higher and lower access counts.
+		Bucket* higher = nullptr;
+		Bucket* lower = nullptr;
+		};
+
+	// Records an access to the given node.
+	void Access(Node* n);
+
+	// Makes n the most recently used node of bucket b.
+	void Link(Node* n, Bucket* b);
+
+	// Removes n from its bucket, deleting the bucket if it's then empty.
+	void Unlink(Node* n);
+
+	// Returns a bucket for the given count that comes right after
+	// "lower", which may be nil to denote the start of the list.
+	Bucket* BucketAfter(Bucket* lower, uint64_t count);
+
+	Policy policy;
+
+	std::unordered_map<const TableEntryVal*, Node*> nodes;
+
+	// The bucket with the lowest access count.  LRU uses a single one.
+	Bucket* lowest = nullptr;
+	};
+
+	} // namespace detail
+	} // namespace zeek
@@ -448,6 +448,14 @@ bool IndexType::IsSubNetIndex() const
 	return false;
 	}
 
+bool IndexType::IsPatternIndex() const
+	{
+	const auto& types = indices->GetTypes();
+	if ( types.size() == 1 && types[0]->Tag() == TYPE_PATTERN )
+		return true;
+	return false;
+	}
+
 detail::TraversalCode IndexType::Traverse(detail::TraversalCallback* cb) const
 	{
 	auto tc = cb->PreType(this);
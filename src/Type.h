@@ -377,6 +377,9 @@ public:
 	// Returns true if this table is solely indexed by subnet.
 	bool IsSubNetIndex() const;
 
+	// Returns true if this table is solely indexed by pattern.
+	bool IsPatternIndex() const;
+
 	detail::TraversalCode Traverse(detail::TraversalCallback* cb) const override;
 
 protected:
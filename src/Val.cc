@@ -19,6 +19,7 @@
 #include "zeek/Conn.h"
 #include "zeek/Desc.h"
 #include "zeek/Dict.h"
+#include "zeek/ExpireWheel.h"
 #include "zeek/Expr.h"
 #include "zeek/File.h"
 #include "zeek/Func.h"
@@ -32,6 +33,7 @@
 #include "zeek/Reporter.h"
 #include "zeek/RunState.h"
 #include "zeek/Scope.h"
+#include "zeek/TableEviction.h"
 #include "zeek/ZeekString.h"
 #include "zeek/broker/Data.h"
 #include "zeek/broker/Manager.h"
@@ -981,47 +983,17 @@ void StringVal::ValDescribe(ODesc* d) const
 StringValPtr StringVal::Replace(RE_Matcher* re, const String& repl, bool do_all)
 	{
 	const u_char* s = Bytes();
-	int offset = 0;
-	int n = Len();
 
 	// cut_points is a set of pairs of indices in str that should
 	// be removed/replaced.  A pair <x,y> means "delete starting
 	// at offset x, up to but not including offset y".
 	vector<std::pair<int, int>> cut_points;
+	re->FindAll(s, Len(), &cut_points, do_all ? 0 : 1);
 
-	int size = 0; // size of result
+	int size = Len(); // size of result
 
-	while ( n > 0 )
-		{
-		// Find next match offset.
-		int end_of_match;
-		while ( n > 0 && (end_of_match = re->MatchPrefix(&s[offset], n)) <= 0 )
-			{
-			// This character is going to be copied to the result.
-			++size;
-
-			// Move on to next character.
-			++offset;
-			--n;
-			}
-
-		if ( n <= 0 )
-			break;
-
-		// s[offset .. offset+end_of_match-1] matches re.
-		cut_points.push_back({offset, offset + end_of_match});
-
-		offset += end_of_match;
-		n -= end_of_match;
-
-		if ( ! do_all )
-			{
-			// We've now done the first substitution - finished.
-			// Include the remainder of the string in the result.
-			size += n;
-			break;
-			}
-		}
+	for ( const auto& point : cut_points )
+		size -= point.second - point.first;
 
 	// size now reflects amount of space copied.  Factor in amount
 	// of space for replacement text.
@@ -1128,14 +1100,16 @@ ValPtr FileVal::DoClone(CloneState* state)
 
 PatternVal::PatternVal(RE_Matcher* re) : Val(base_type(TYPE_PATTERN))
 	{
-	re_val = re;
+	re_val.reset(re);
 	}
 
-PatternVal::~PatternVal()
+PatternVal::PatternVal(std::shared_ptr<RE_Matcher> re)
+	: Val(base_type(TYPE_PATTERN)), re_val(std::move(re))
 	{
-	delete re_val;
 	}
 
+PatternVal::~PatternVal() { }
+
 bool PatternVal::AddTo(Val* v, bool /* is_first_init */) const
 	{
 	if ( v->GetType()->Tag() != TYPE_PATTERN )
@@ -1146,19 +1120,30 @@ bool PatternVal::AddTo(Val* v, bool /* is_first_init */) const
 
 	PatternVal* pv = v->AsPatternVal();
 
-	RE_Matcher* re = new RE_Matcher(AsPattern()->PatternText());
-	re->AddPat(pv->AsPattern()->PatternText());
-	re->Compile();
+	const char* text1 = AsPattern()->PatternText();
+	const char* text2 = pv->AsPattern()->PatternText();
+	std::string key = std::string("+") + text1 + '\0' + text2;
+
+	auto make = [text1, text2]()
+	{
+		auto re = new RE_Matcher(text1);
+		re->AddPat(text2);
+		return re;
+	};
 
-	pv->SetMatcher(re);
+	pv->SetMatcher(detail::re_matcher_cache().Lookup(key, make));
 
 	return true;
 	}
 
 void PatternVal::SetMatcher(RE_Matcher* re)
 	{
-	delete AsPattern();
-	re_val = re;
+	re_val.reset(re);
+	}
+
+void PatternVal::SetMatcher(std::shared_ptr<RE_Matcher> re)
+	{
+	re_val = std::move(re);
 	}
 
 bool PatternVal::MatchExactly(const String* s) const
@@ -1180,12 +1165,9 @@ void PatternVal::ValDescribe(ODesc* d) const
 
 ValPtr PatternVal::DoClone(CloneState* state)
 	{
-	// We could likely treat this type as immutable and return a reference
-	// instead of creating a new copy, but we first need to be careful and
-	// audit whether anything internal actually does mutate it.
-	auto re = new RE_Matcher(re_val->PatternText(), re_val->AnywherePatternText());
-	re->Compile();
-	return state->NewClone(this, make_intrusive<PatternVal>(re));
+	// Compiled matchers are never modified in place (see SetMatcher()),
+	// so the clone can share ours rather than compiling its own.
+	return state->NewClone(this, make_intrusive<PatternVal>(re_val));
 	}
 
 ListVal::ListVal(TypeTag t) : Val(make_intrusive<TypeList>(t == TYPE_ANY ? nullptr : base_type(t)))
@@ -1409,12 +1391,72 @@ TableVal::TableVal(TableTypePtr t, detail::AttributesPtr a) : Val(t)
 		}
 	}
 
+namespace detail
+	{
+
+// Matches strings against all the patterns of a set[pattern] or
+// table[pattern] at once. Built on first use and discarded whenever the
+// table changes.
+class TablePatternMatcher
+	{
+public:
+	explicit TablePatternMatcher(const TableVal* tbl)
+		{
+		const auto* th = tbl->GetTableHash();
+
+		for ( const auto& iter : *tbl->Get() )
+			keys.push_back(th->RecoverVals(*iter.GetHashKey())->Idx(0));
+		}
+
+	// Returns the keys of all patterns matching s.
+	std::vector<ValPtr> Lookup(const String* s, bool exact)
+		{
+		auto& m = matchers[exact];
+
+		if ( ! m )
+			{
+			std::vector<std::string> texts;
+			texts.reserve(keys.size());
+
+			for ( const auto& k : keys )
+				{
+				const RE_Matcher* re = k->AsPattern();
+				texts.emplace_back(exact ? re->PatternText() : re->AnywherePatternText());
+				}
+
+			m = std::make_unique<RE_Set_Matcher>(texts, exact);
+			}
+
+		std::vector<int> matches;
+		m->Match(s->Bytes(), s->Len(), &matches);
+
+		std::vector<ValPtr> rval;
+		rval.reserve(matches.size());
+
+		for ( auto idx : matches )
+			rval.push_back(keys[idx]);
+
+		return rval;
+		}
+
+private:
+	std::vector<ValPtr> keys;
+	std::unique_ptr<RE_Set_Matcher> matchers[2];
+	};
+
+	} // namespace detail
+
 void TableVal::Init(TableTypePtr t, bool ordered)
 	{
 	table_type = std::move(t);
 	expire_func = nullptr;
 	expire_time = nullptr;
 	expire_iterator = nullptr;
+	expire_wheel = nullptr;
+	expire_wheel_timeout = 0.0;
+	expire_wheel_seeded = false;
+	max_size = nullptr;
+	eviction_index = nullptr;
 	timer = nullptr;
 	def_val = nullptr;
 
@@ -1423,6 +1465,8 @@ void TableVal::Init(TableTypePtr t, bool ordered)
 	else
 		subnets = nullptr;
 
+	pattern_matcher = nullptr;
+
 	table_hash = new detail::CompositeHash(table_type->GetIndices());
 	if ( ordered )
 		table_val = new PDict<TableEntryVal>(DictOrder::ORDERED);
@@ -1440,13 +1484,30 @@ TableVal::~TableVal()
 	delete table_hash;
 	delete table_val;
 	delete subnets;
+	delete pattern_matcher;
 	delete expire_iterator;
+	delete expire_wheel;
+	delete eviction_index;
+	}
+
+void TableVal::ClearPatternMatcher()
+	{
+	delete pattern_matcher;
+	pattern_matcher = nullptr;
 	}
 
 void TableVal::RemoveAll()
 	{
 	delete expire_iterator;
 	expire_iterator = nullptr;
+
+	if ( expire_wheel )
+		expire_wheel->Clear();
+
+	if ( eviction_index )
+		eviction_index->Clear();
+
+	ClearPatternMatcher();
 	// Here we take the brute force approach.
 	delete table_val;
 	table_val = new PDict<TableEntryVal>;
@@ -1510,6 +1571,33 @@ void TableVal::SetAttrs(detail::AttributesPtr a)
 		broker_store = c->AsStringVal()->AsString()->CheckString();
 		broker_mgr->AddForwardedStore(broker_store, {NewRef{}, this});
 		}
+
+	const auto& ms = attrs->Find(detail::ATTR_MAX_SIZE);
+
+	if ( ms && ! eviction_index )
+		{
+		max_size = ms->GetExpr();
+
+		auto policy = detail::TableEvictionIndex::LRU;
+
+		if ( const auto& ev = attrs->Find(detail::ATTR_EVICTION) )
+			{
+			auto c = ev->GetExpr()->Eval(nullptr);
+
+			if ( ! c || ! same_type(c->GetType(), BifType::Enum::TableEviction) )
+				ev->GetExpr()->Error("&eviction must take a TableEviction enum argument");
+
+			else if ( c->AsEnum() == BifEnum::TableEviction::TABLE_EVICT_LFU )
+				policy = detail::TableEvictionIndex::LFU;
+			}
+
+		eviction_index = new detail::TableEvictionIndex(policy);
+
+		for ( const auto& tble : *table_val )
+			eviction_index->Add(*tble.GetHashKey(), tble.value);
+
+		EnforceMaxSize(nullptr);
+		}
 	}
 
 void TableVal::CheckExpireAttr(detail::AttrTag at)
@@ -1581,10 +1669,28 @@ bool TableVal::Assign(ValPtr index, std::unique_ptr<detail::HashKey> k, ValPtr n
 			subnets->Insert(index.get(), new_entry_val);
 		}
 
+	ClearPatternMatcher();
+
 	// Keep old expiration time if necessary.
 	if ( old_entry_val && attrs && attrs->Find(detail::ATTR_EXPIRE_CREATE) )
 		new_entry_val->SetExpireAccess(old_entry_val->ExpireAccessTime());
 
+	// A replacement inherits its predecessor's place in the expiration
+	// wheel, which rechecks the expiration time when it gets there.
+	if ( old_entry_val )
+		new_entry_val->expire_tick = old_entry_val->expire_tick;
+	else if ( expire_wheel )
+		ScheduleExpire(k_copy, new_entry_val,
+		               new_entry_val->ExpireAccessTime() + expire_wheel_timeout);
+
+	if ( eviction_index )
+		{
+		if ( old_entry_val )
+			eviction_index->Replace(old_entry_val, new_entry_val);
+		else
+			eviction_index->Add(k_copy, new_entry_val);
+		}
+
 	Modified();
 
 	if ( change_func || (broker_forward && ! broker_store.empty()) )
@@ -1602,6 +1708,10 @@ bool TableVal::Assign(ValPtr index, std::unique_ptr<detail::HashKey> k, ValPtr n
 			}
 		}
 
+	// Only new entries can push the table over its cap.
+	if ( eviction_index && ! old_entry_val )
+		EnforceMaxSize(new_entry_val);
+
 	delete old_entry_val;
 
 	return true;
@@ -1856,6 +1966,9 @@ const ValPtr& TableVal::Find(const ValPtr& index)
 			if ( attrs && attrs->Find(detail::ATTR_EXPIRE_READ) )
 				v->SetExpireAccess(run_state::network_time);
 
+			if ( eviction_index )
+				eviction_index->Touch(v);
+
 			if ( v->GetVal() )
 				return v->GetVal();
 
@@ -1870,20 +1983,28 @@ const ValPtr& TableVal::Find(const ValPtr& index)
 		auto k = MakeHashKey(*index);
 
 		if ( k )
-			{
-			TableEntryVal* v = table_val->Lookup(k.get());
+			return Find(*k);
+		}
 
-			if ( v )
-				{
-				if ( attrs && attrs->Find(detail::ATTR_EXPIRE_READ) )
-					v->SetExpireAccess(run_state::network_time);
+	return Val::nil;
+	}
 
-				if ( v->GetVal() )
-					return v->GetVal();
+const ValPtr& TableVal::Find(const detail::HashKey& k)
+	{
+	TableEntryVal* v = table_val->Lookup(&k);
 
-				return val_mgr->True();
-				}
-			}
+	if ( v )
+		{
+		if ( attrs && attrs->Find(detail::ATTR_EXPIRE_READ) )
+			v->SetExpireAccess(run_state::network_time);
+
+		if ( eviction_index )
+			eviction_index->Touch(v);
+
+		if ( v->GetVal() )
+			return v->GetVal();
+
+		return val_mgr->True();
 		}
 
 	return Val::nil;
@@ -1944,12 +2065,61 @@ TableValPtr TableVal::LookupSubnetValues(const SubNetVal* search)
 			{
 			if ( attrs && attrs->Find(detail::ATTR_EXPIRE_READ) )
 				entry->SetExpireAccess(run_state::network_time);
+
+			if ( eviction_index )
+				eviction_index->Touch(entry);
 			}
 		}
 
 	return nt;
 	}
 
+VectorValPtr TableVal::LookupPatterns(const StringVal* s, bool exact)
+	{
+	if ( ! table_type->IsPatternIndex() )
+		reporter->InternalError("LookupPatterns called on wrong table type");
+
+	auto result = make_intrusive<VectorVal>(id::find_type<VectorType>("pattern_vec"));
+
+	if ( ! pattern_matcher )
+		pattern_matcher = new detail::TablePatternMatcher(this);
+
+	for ( auto& p : pattern_matcher->Lookup(s->AsString(), exact) )
+		result->Assign(result->Size(), std::move(p));
+
+	return result;
+	}
+
+TableValPtr TableVal::LookupPatternValues(const StringVal* s, bool exact)
+	{
+	if ( ! table_type->IsPatternIndex() )
+		reporter->InternalError("LookupPatternValues called on wrong table type");
+
+	auto nt = make_intrusive<TableVal>(this->GetType<TableType>());
+
+	if ( ! pattern_matcher )
+		pattern_matcher = new detail::TablePatternMatcher(this);
+
+	for ( auto& p : pattern_matcher->Lookup(s->AsString(), exact) )
+		{
+		auto k = MakeHashKey(*p);
+		TableEntryVal* entry = k ? table_val->Lookup(k.get()) : nullptr;
+
+		if ( ! entry )
+			continue;
+
+		nt->Assign(std::move(p), entry->GetVal());
+
+		if ( attrs && attrs->Find(detail::ATTR_EXPIRE_READ) )
+			entry->SetExpireAccess(run_state::network_time);
+
+		if ( eviction_index )
+			eviction_index->Touch(entry);
+		}
+
+	return nt;
+	}
+
 bool TableVal::UpdateTimestamp(Val* index)
 	{
 	TableEntryVal* v;
@@ -2164,6 +2334,14 @@ ValPtr TableVal::Remove(const Val& index, bool broker_forward, bool* iterators_i
 	if ( subnets && ! subnets->Remove(&index) )
 		reporter->InternalWarning("index not in prefix table");
 
+	if ( v )
+		{
+		ClearPatternMatcher();
+
+		if ( eviction_index )
+			eviction_index->Remove(v);
+		}
+
 	delete v;
 
 	Modified();
@@ -2197,6 +2375,14 @@ ValPtr TableVal::Remove(const detail::HashKey& k, bool* iterators_invalidated)
 			reporter->InternalWarning("index not in prefix table");
 		}
 
+	if ( v )
+		{
+		ClearPatternMatcher();
+
+		if ( eviction_index )
+			eviction_index->Remove(v);
+		}
+
 	delete v;
 
 	Modified();
@@ -2435,95 +2621,189 @@ void TableVal::DoExpire(double t)
 		// error, it has been reported already.
 		return;
 
+	if ( ! expire_wheel || timeout != expire_wheel_timeout )
+		{
+		// The wheel's placement of the entries depends on the
+		// timeout, so (re-)build it from scratch.
+		delete expire_wheel;
+		expire_wheel = new detail::ExpireWheel(
+			t, std::max(zeek::detail::table_expire_interval, 0.01));
+		expire_wheel_timeout = timeout;
+		expire_wheel_seeded = false;
+
+		delete expire_iterator;
+		expire_iterator = nullptr;
+		}
+
+	bool modified = false;
+
+	if ( ! expire_wheel_seeded )
+		{
+		bool done = SeedExpireWheel(t, timeout, modified);
+
+		if ( modified )
+			Modified();
+
+		if ( done )
+			InitTimer(zeek::detail::table_expire_interval);
+		else
+			InitTimer(zeek::detail::table_expire_delay);
+
+		return;
+		}
+
+	bool done = ExpireDue(t, timeout, modified);
+
+	if ( modified )
+		Modified();
+
+	if ( done )
+		// Come back once the wheel's next tick starts, which is at most
+		// table_expire_interval from now.
+		InitTimer(std::max(expire_wheel->NextTickStart() - run_state::network_time, 0.0));
+	else
+		InitTimer(zeek::detail::table_expire_delay);
+	}
+
+bool TableVal::SeedExpireWheel(double t, double timeout, bool& modified)
+	{
 	if ( ! expire_iterator )
 		{
 		auto it = table_val->begin_robust();
 		expire_iterator = new RobustDictIterator(std::move(it));
 		}
 
-	bool modified = false;
-
 	for ( int i = 0;
 	      i < zeek::detail::table_incremental_step && *expire_iterator != table_val->end_robust();
 	      ++i, ++(*expire_iterator) )
 		{
-		auto v = (*expire_iterator)->value;
+		auto k = (*expire_iterator)->GetHashKey();
 
-		if ( v->ExpireAccessTime() == 0 )
-			{
-			// This happens when we insert val while network_time
-			// hasn't been initialized yet (e.g. in zeek_init()), and
-			// also when zeek_start_network_time hasn't been initialized
-			// (e.g. before first packet).  The expire_access_time is
-			// correct, so we just need to wait.
-			}
+		if ( CheckExpire(*k, (*expire_iterator)->value, t, timeout) )
+			modified = true;
 
-		else if ( v->ExpireAccessTime() + timeout < t )
-			{
-			auto k = (*expire_iterator)->GetHashKey();
-			ListValPtr idx = nullptr;
+		if ( ! expire_iterator )
+			// Entire table got dropped (e.g. clear_table() / RemoveAll())
+			break;
+		}
 
-			if ( expire_func )
-				{
-				idx = RecreateIndex(*k);
-				double secs = CallExpireFunc(idx);
+	if ( expire_iterator && (*expire_iterator) != table_val->end_robust() )
+		return false;
 
-				// It's possible that the user-provided
-				// function modified or deleted the table
-				// value, so look it up again.
-				v = table_val->Lookup(k.get());
+	delete expire_iterator;
+	expire_iterator = nullptr;
+	expire_wheel_seeded = true;
 
-				if ( ! v )
-					{ // user-provided function deleted it
-					if ( ! expire_iterator )
-						// Entire table got dropped (e.g. clear_table() / RemoveAll())
-						break;
+	return true;
+	}
 
-					continue;
-					}
+bool TableVal::ExpireDue(double t, double timeout, bool& modified)
+	{
+	const void* key;
+	int key_size;
+	detail::hash_t hash;
+	int64_t tick;
 
-				if ( secs > 0 )
-					{
-					// User doesn't want us to expire
-					// this now.
-					v->SetExpireAccess(run_state::network_time - timeout + secs);
-					continue;
-					}
-				}
+	for ( int i = 0; i < zeek::detail::table_incremental_step; ++i )
+		{
+		if ( ! expire_wheel->Next(t, key, key_size, hash, tick) )
+			return true;
 
-			if ( subnets )
-				{
-				if ( ! idx )
-					idx = RecreateIndex(*k);
-				if ( ! subnets->Remove(idx.get()) )
-					reporter->InternalWarning("index not in prefix table");
-				}
+		auto v = table_val->Lookup(key, key_size, hash);
 
-			table_val->RemoveEntry(k.get());
-			if ( change_func )
-				{
-				if ( ! idx )
-					idx = RecreateIndex(*k);
+		if ( ! v || v->expire_tick != static_cast<int>(tick) )
+			// Deleted, or scheduled elsewhere by now.
+			continue;
 
-				CallChangeFunc(idx, v->GetVal(), ELEMENT_EXPIRED);
-				}
+		// Copy the key, as the wheel's might not survive calls to
+		// script functions.
+		detail::HashKey k(key, key_size, hash);
 
-			delete v;
+		if ( CheckExpire(k, v, t, timeout) )
 			modified = true;
+		}
+
+	return false;
+	}
+
+bool TableVal::CheckExpire(const detail::HashKey& k, TableEntryVal* v, double t, double timeout)
+	{
+	if ( v->ExpireAccessTime() == 0 )
+		{
+		// This happens when we insert val while network_time
+		// hasn't been initialized yet (e.g. in zeek_init()), and
+		// also when zeek_start_network_time hasn't been initialized
+		// (e.g. before first packet).  The expire_access_time is
+		// correct, so we just need to wait.
+		ScheduleExpire(k, v, t);
+		return false;
+		}
+
+	if ( v->ExpireAccessTime() + timeout >= t )
+		{
+		ScheduleExpire(k, v, v->ExpireAccessTime() + timeout);
+		return false;
+		}
+
+	ListValPtr idx = nullptr;
+
+	if ( expire_func )
+		{
+		idx = RecreateIndex(k);
+		double secs = CallExpireFunc(idx);
+
+		// It's possible that the user-provided
+		// function modified or deleted the table
+		// value, so look it up again.
+		v = table_val->Lookup(&k);
+
+		if ( ! v )
+			// user-provided function deleted it
+			return false;
+
+		if ( secs > 0 )
+			{
+			// User doesn't want us to expire
+			// this now.
+			v->SetExpireAccess(run_state::network_time - timeout + secs);
+			ScheduleExpire(k, v, v->ExpireAccessTime() + timeout);
+			return false;
 			}
 		}
 
-	if ( modified )
-		Modified();
+	if ( subnets )
+		{
+		if ( ! idx )
+			idx = RecreateIndex(k);
+		if ( ! subnets->Remove(idx.get()) )
+			reporter->InternalWarning("index not in prefix table");
+		}
 
-	if ( ! expire_iterator || (*expire_iterator) == table_val->end_robust() )
+	table_val->RemoveEntry(&k);
+	ClearPatternMatcher();
+
+	if ( eviction_index )
+		eviction_index->Remove(v);
+
+	if ( change_func )
 		{
-		delete expire_iterator;
-		expire_iterator = nullptr;
-		InitTimer(zeek::detail::table_expire_interval);
+		if ( ! idx )
+			idx = RecreateIndex(k);
+
+		CallChangeFunc(idx, v->GetVal(), ELEMENT_EXPIRED);
 		}
-	else
-		InitTimer(zeek::detail::table_expire_delay);
+
+	delete v;
+	return true;
+	}
+
+void TableVal::ScheduleExpire(const detail::HashKey& k, TableEntryVal* v, double t)
+	{
+	if ( ! expire_wheel )
+		return;
+
+	auto tick = expire_wheel->Add(k.Key(), k.Size(), k.Hash(), expire_wheel->TickAfter(t));
+	v->expire_tick = static_cast<int>(tick);
 	}
 
 double TableVal::GetExpireTime()
@@ -2617,6 +2897,97 @@ double TableVal::CallExpireFunc(ListValPtr idx)
 	return secs;
 	}
 
+zeek_int_t TableVal::GetMaxSize()
+	{
+	if ( ! max_size )
+		return -1;
+
+	try
+		{
+		auto cap = max_size->Eval(nullptr);
+		return cap ? static_cast<zeek_int_t>(cap->AsCount()) : -1;
+		}
+	catch ( InterpreterException& e )
+		{
+		return -1;
+		}
+	}
+
+void TableVal::EnforceMaxSize(const TableEntryVal* exclude)
+	{
+	// Entries that &expire_func adds during an eviction get accounted
+	// for by the next insertion.
+	if ( in_eviction )
+		return;
+
+	auto cap = GetMaxSize();
+
+	if ( cap < 0 )
+		return;
+
+	auto excess = Size() - cap;
+
+	if ( excess <= 0 )
+		return;
+
+	in_eviction = true;
+
+	for ( ; excess > 0; --excess )
+		{
+		auto victim = eviction_index->Victim(exclude);
+
+		if ( ! victim )
+			break;
+
+		// The victim's key only lives as long as its entry.
+		detail::HashKey k(victim->Key(), victim->Size(), victim->Hash());
+		EvictEntry(k);
+		}
+
+	in_eviction = false;
+	}
+
+void TableVal::EvictEntry(const detail::HashKey& k)
+	{
+	ListValPtr idx = nullptr;
+
+	if ( expire_func )
+		{
+		// Unlike with expiration, the entry has to go regardless of
+		// what the function returns.
+		idx = RecreateIndex(k);
+		CallExpireFunc(idx);
+		}
+
+	// The user-provided function might have removed the entry.
+	TableEntryVal* v = table_val->Lookup(&k);
+
+	if ( ! v )
+		return;
+
+	if ( subnets )
+		{
+		if ( ! idx )
+			idx = RecreateIndex(k);
+		if ( ! subnets->Remove(idx.get()) )
+			reporter->InternalWarning("index not in prefix table");
+		}
+
+	table_val->RemoveEntry(&k);
+	ClearPatternMatcher();
+	eviction_index->Remove(v);
+
+	if ( change_func )
+		{
+		if ( ! idx )
+			idx = RecreateIndex(k);
+
+		CallChangeFunc(idx, v->GetVal(), ELEMENT_EXPIRED);
+		}
+
+	delete v;
+	}
+
 ValPtr TableVal::DoClone(CloneState* state)
 	{
 	auto tv = make_intrusive<TableVal>(table_type);
@@ -2652,6 +3023,16 @@ ValPtr TableVal::DoClone(CloneState* state)
 	if ( expire_func )
 		tv->expire_func = expire_func;
 
+	if ( eviction_index )
+		{
+		// The clone starts out with its entries in iteration order.
+		tv->max_size = max_size;
+		tv->eviction_index = new detail::TableEvictionIndex(eviction_index->GetPolicy());
+
+		for ( const auto& tble : *tv->table_val )
+			tv->eviction_index->Add(*tble.GetHashKey(), tble.value);
+		}
+
 	if ( def_val )
 		tv->def_val = def_val->Clone();
 
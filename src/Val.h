@@ -5,12 +5,14 @@
 #include <sys/types.h> // for u_char
 #include <array>
 #include <list>
+#include <memory>
 #include <unordered_map>
 #include <vector>
 
 #include "zeek/IntrusivePtr.h"
 #include "zeek/Notifier.h"
 #include "zeek/Reporter.h"
+#include "zeek/SlabAllocator.h"
 #include "zeek/Timer.h"
 #include "zeek/Type.h"
 #include "zeek/ZVal.h"
@@ -47,7 +49,10 @@ namespace detail
 class ScriptFunc;
 class Frame;
 class PrefixTable;
+class TablePatternMatcher;
 class CompositeHash;
+class ExpireWheel;
+class TableEvictionIndex;
 class HashKey;
 
 class ValTrace;
@@ -102,6 +107,12 @@ public:
 
 	~Val() override;
 
+	// Vals get created and destroyed at a high rate, so they come from
+	// the slab allocator.  The virtual destructor makes sure that the
+	// size passed to delete is the one of the actual object.
+	static void* operator new(size_t size) { return detail::slab_allocator.Allocate(size); }
+	static void operator delete(void* p, size_t size) { detail::slab_allocator.Free(p, size); }
+
 	Val* Ref()
 		{
 		zeek::Ref(this);
@@ -619,23 +630,27 @@ class PatternVal final : public Val
 	{
 public:
 	explicit PatternVal(RE_Matcher* re);
+	explicit PatternVal(std::shared_ptr<RE_Matcher> re);
 	~PatternVal() override;
 
 	bool AddTo(Val* v, bool is_first_init) const override;
 
 	void SetMatcher(RE_Matcher* re);
+	void SetMatcher(std::shared_ptr<RE_Matcher> re);
 
 	bool MatchExactly(const String* s) const;
 	bool MatchAnywhere(const String* s) const;
 
-	const RE_Matcher* Get() const { return re_val; }
+	const RE_Matcher* Get() const { return re_val.get(); }
 
 protected:
 	void ValDescribe(ODesc* d) const override;
 	ValPtr DoClone(CloneState* state) override;
 
 private:
-	RE_Matcher* re_val;
+	// Compiled matchers may be shared with other PatternVals through
+	// detail::re_matcher_cache().
+	std::shared_ptr<RE_Matcher> re_val;
 	};
 
 // ListVals are mainly used to index tables that have more than one
@@ -695,6 +710,9 @@ public:
 		expire_access_time = int(run_state::network_time - run_state::zeek_start_network_time);
 		}
 
+	static void* operator new(size_t size) { return detail::slab_allocator.Allocate(size); }
+	static void operator delete(void* p, size_t size) { detail::slab_allocator.Free(p, size); }
+
 	TableEntryVal* Clone(Val::CloneState* state);
 
 	const ValPtr& GetVal() const { return val; }
@@ -718,6 +736,11 @@ protected:
 	// to save a few bytes, as we do not need a high resolution for these
 	// anyway.
 	int expire_access_time;
+
+	// The (lower bits of the) tick for which the entry is scheduled in
+	// its table's expiration wheel.  The wheel can also hold stale
+	// records for the entry's key, which this tells apart.
+	int expire_tick = -1;
 	};
 
 class TableValTimer final : public detail::Timer
@@ -851,6 +874,14 @@ public:
 	 */
 	const ValPtr& Find(const ValPtr& index);
 
+	/**
+	 * Same as Find(const ValPtr&), but uses a precomputed hash key.  Not
+	 * applicable to tables indexed by subnets.
+	 * @param k  The hash key to lookup.
+	 * @return  Same as Find(const ValPtr&).
+	 */
+	const ValPtr& Find(const detail::HashKey& k);
+
 	/**
 	 * Finds an index in the table and returns its associated value or else
 	 * the &default value.
@@ -881,6 +912,19 @@ public:
 	// Causes an internal error if called for any other kind of table.
 	TableValPtr LookupSubnetValues(const SubNetVal* s);
 
+	// For a set[pattern]/table[pattern], return all patterns that match
+	// the given string, either as a whole (if exact) or anywhere in it.
+	// All patterns get compiled into a single DFA on first use, so this
+	// takes one pass over the string regardless of the table's size.
+	// Causes an internal error if called for any other kind of table.
+	VectorValPtr LookupPatterns(const StringVal* s, bool exact);
+
+	// For a set[pattern]/table[pattern], return a new table that only
+	// contains entries whose patterns match the given string, as with
+	// LookupPatterns().
+	// Causes an internal error if called for any other kind of table.
+	TableValPtr LookupPatternValues(const StringVal* s, bool exact);
+
 	// Sets the timestamp for the given index to network time.
 	// Returns false if index does not exist.
 	bool UpdateTimestamp(Val* index);
@@ -1024,6 +1068,32 @@ protected:
 	// Calls &expire_func and returns its return interval;
 	double CallExpireFunc(ListValPtr idx);
 
+	// Expires the given entry if it's due by time t, returning true if
+	// it got removed.  Otherwise (re)schedules it in the expiration wheel.
+	bool CheckExpire(const detail::HashKey& k, TableEntryVal* v, double t, double timeout);
+
+	// Schedules the given entry in the expiration wheel for time t.
+	void ScheduleExpire(const detail::HashKey& k, TableEntryVal* v, double t);
+
+	// Visits all entries once to populate the expiration wheel,
+	// expiring those that are due along the way.  Returns true if done.
+	bool SeedExpireWheel(double t, double timeout, bool& modified);
+
+	// Expires the entries that the wheel has as due by time t.
+	// Returns true if done.
+	bool ExpireDue(double t, double timeout, bool& modified);
+
+	// Returns the cap defined by the &max_size attribute, or -1 for
+	// unset/invalid values.
+	zeek_int_t GetMaxSize();
+
+	// Evicts entries until the table no longer exceeds its &max_size,
+	// sparing the given one.
+	void EnforceMaxSize(const TableEntryVal* exclude);
+
+	// Removes the given entry on behalf of &max_size.
+	void EvictEntry(const detail::HashKey& k);
+
 	// Enum for the different kinds of changes an &on_change handler can see
 	enum OnChangeType
 		{
@@ -1050,7 +1120,21 @@ protected:
 	detail::ExprPtr expire_func;
 	TableValTimer* timer;
 	RobustDictIterator<TableEntryVal>* expire_iterator;
+
+	// Index of the entries by when they might expire, along with the
+	// timeout it was built for and whether it covers all entries yet.
+	detail::ExpireWheel* expire_wheel;
+	double expire_wheel_timeout;
+	bool expire_wheel_seeded;
+
+	// For tables with a &max_size: the cap, and the order in which
+	// entries get evicted.
+	detail::ExprPtr max_size;
+	detail::TableEvictionIndex* eviction_index;
+	// prevent recursive evictions via &expire_func
+	bool in_eviction = false;
 	detail::PrefixTable* subnets;
+	detail::TablePatternMatcher* pattern_matcher; // built on demand
 	ValPtr def_val;
 	detail::ExprPtr change_func;
 	std::string broker_store;
@@ -1061,6 +1145,9 @@ protected:
 	static ParseTimeTableStates parse_time_table_states;
 
 private:
+	// Discards the pattern matcher, if any, after the table changed.
+	void ClearPatternMatcher();
+
 	PDict<TableEntryVal>* table_val;
 	};
 
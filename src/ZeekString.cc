@@ -12,6 +12,7 @@
 #include "zeek/3rdparty/doctest.h"
 #include "zeek/ID.h"
 #include "zeek/Reporter.h"
+#include "zeek/StringKernels.h"
 #include "zeek/Val.h"
 #include "zeek/util.h"
 
@@ -195,39 +196,55 @@ char* String::Render(int format, int* len) const
 	char* sp = s;
 	int tmp_len;
 
-	for ( int i = 0; i < n; ++i )
+	int flags = 0;
+	if ( format & (ESC_HEX | ESC_DOT) )
+		flags |= detail::ESCAPE_UNPRINTABLE;
+	if ( format & ESC_ESC )
+		flags |= detail::ESCAPE_BACKSLASH;
+	if ( format & ESC_QUOT )
+		flags |= detail::ESCAPE_QUOTES;
+
+	for ( int i = 0; i < n; )
 		{
-		if ( b[i] == '\\' && (format & ESC_ESC) )
+		// Copy the run of bytes that don't need escaping in one go.
+		int run = detail::find_escapable(b + i, n - i, flags);
+		memcpy(sp, b + i, run);
+		sp += run;
+		i += run;
+
+		if ( i == n )
+			break;
+
+		u_char c = b[i++];
+
+		if ( c == '\\' && (format & ESC_ESC) )
 			{
 			*sp++ = '\\';
 			*sp++ = '\\';
 			}
 
-		else if ( (b[i] == '\'' || b[i] == '"') && (format & ESC_QUOT) )
+		else if ( (c == '\'' || c == '"') && (format & ESC_QUOT) )
 			{
 			*sp++ = '\\';
-			*sp++ = b[i];
+			*sp++ = c;
 			}
 
-		else if ( (b[i] < ' ' || b[i] > 126) && (format & ESC_HEX) )
+		else if ( (c < ' ' || c > 126) && (format & ESC_HEX) )
 			{
-			char hex_fmt[16];
-
 			*sp++ = '\\';
 			*sp++ = 'x';
-			sprintf(hex_fmt, "%02x", b[i]);
-			*sp++ = hex_fmt[0];
-			*sp++ = hex_fmt[1];
+			detail::hex_encode(&c, 1, sp);
+			sp += 2;
 			}
 
-		else if ( (b[i] < ' ' || b[i] > 126) && (format & ESC_DOT) )
+		else if ( (c < ' ' || c > 126) && (format & ESC_DOT) )
 			{
 			*sp++ = '.';
 			}
 
 		else
 			{
-			*sp++ = b[i];
+			*sp++ = c;
 			}
 		}
 
@@ -286,9 +303,7 @@ std::istream& String::Read(std::istream& is, int format)
 
 void String::ToUpper()
 	{
-	for ( int i = 0; i < n; ++i )
-		if ( islower(b[i]) )
-			b[i] = toupper(b[i]);
+	detail::ascii_to_upper(b, b, n);
 	}
 
 String* String::GetSubstring(int start, int len) const
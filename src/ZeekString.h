@@ -9,6 +9,8 @@
 #include <string>
 #include <vector>
 
+#include "zeek/SlabAllocator.h"
+
 namespace zeek
 	{
 
@@ -52,6 +54,12 @@ public:
 	String();
 	~String() { Reset(); }
 
+	// Strings mostly come and go along with StringVals, so they share
+	// their allocator.  Note that this relies on Strings getting deleted
+	// through a pointer of their actual type.
+	static void* operator new(size_t size) { return detail::slab_allocator.Allocate(size); }
+	static void operator delete(void* p, size_t size) { detail::slab_allocator.Free(p, size); }
+
 	const String& operator=(const String& bs);
 	bool operator==(const String& bs) const;
 	bool operator<(const String& bs) const;
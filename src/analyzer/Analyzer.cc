@@ -121,6 +121,7 @@ void Analyzer::CtorInit(const zeek::Tag& arg_tag, Connection* arg_conn)
 	skip = false;
 	finished = false;
 	removing = false;
+	delivery_depth = 0;
 	parent = nullptr;
 	orig_supporters = nullptr;
 	resp_supporters = nullptr;
@@ -172,10 +173,10 @@ void Analyzer::InitChildren()
 	{
 	AppendNewChildren();
 
-	LOOP_OVER_CHILDREN(i)
+	for ( size_t i = 0; i < children.size(); ++i )
 		{
-		(*i)->Init();
-		(*i)->InitChildren();
+		children[i]->Init();
+		children[i]->InitChildren();
 		}
 	}
 
@@ -193,9 +194,9 @@ void Analyzer::Done()
 
 	AppendNewChildren();
 
-	LOOP_OVER_CHILDREN(i)
-	if ( ! (*i)->finished )
-		(*i)->Done();
+	for ( size_t i = 0; i < children.size(); ++i )
+		if ( ! children[i]->finished )
+			children[i]->Done();
 
 	for ( SupportAnalyzer* a = orig_supporters; a; a = a->sibling )
 		if ( ! a->finished )
@@ -291,95 +292,81 @@ void Analyzer::NextEndOfData(bool is_orig)
 		EndOfData(is_orig);
 	}
 
-void Analyzer::ForwardPacket(int len, const u_char* data, bool is_orig, uint64_t seq,
-                             const IP_Hdr* ip, int caplen)
+template <typename Func> void Analyzer::ForwardToChildren(Func deliver)
 	{
-	if ( output_handler )
-		output_handler->DeliverPacket(len, data, is_orig, seq, ip, caplen);
-
 	AppendNewChildren();
 
-	// Pass to all children.
-	for ( auto i = children.begin(); i != children.end(); )
+	// Most analyzers have exactly one child (e.g., TCP -> PIA -> HTTP),
+	// so pass the data on directly in that case.
+	if ( children.size() == 1 )
 		{
-		Analyzer* current = *i;
+		Analyzer* child = children.front();
 
-		if ( ! (current->finished || current->removing) )
+		if ( ! (child->finished || child->removing) )
 			{
-			current->NextPacket(len, data, is_orig, seq, ip, caplen);
-			++i;
+			++delivery_depth;
+			deliver(child);
+			--delivery_depth;
+
+			AppendNewChildren();
+			return;
 			}
-		else
-			i = DeleteChild(i);
 		}
 
-	AppendNewChildren();
-	}
-
-void Analyzer::ForwardStream(int len, const u_char* data, bool is_orig)
-	{
-	if ( output_handler )
-		output_handler->DeliverStream(len, data, is_orig);
+	// Iterate by index: a delivery may recurse into this analyzer and
+	// append further children, which can reallocate the vector. Children
+	// are only ever deleted once the outermost delivery has returned.
+	bool have_finished = false;
 
-	AppendNewChildren();
+	++delivery_depth;
 
-	for ( auto i = children.begin(); i != children.end(); )
+	for ( size_t i = 0; i < children.size(); ++i )
 		{
-		Analyzer* current = *i;
+		Analyzer* current = children[i];
 
-		if ( ! (current->finished || current->removing) )
-			{
-			current->NextStream(len, data, is_orig);
-			++i;
-			}
+		if ( current->finished || current->removing )
+			have_finished = true;
 		else
-			i = DeleteChild(i);
+			deliver(current);
 		}
 
+	--delivery_depth;
+
 	AppendNewChildren();
+
+	if ( have_finished && delivery_depth == 0 )
+		DeleteFinishedChildren();
 	}
 
-void Analyzer::ForwardUndelivered(uint64_t seq, int len, bool is_orig)
+void Analyzer::ForwardPacket(int len, const u_char* data, bool is_orig, uint64_t seq,
+                             const IP_Hdr* ip, int caplen)
 	{
 	if ( output_handler )
-		output_handler->Undelivered(seq, len, is_orig);
-
-	AppendNewChildren();
+		output_handler->DeliverPacket(len, data, is_orig, seq, ip, caplen);
 
-	for ( auto i = children.begin(); i != children.end(); )
-		{
-		Analyzer* current = *i;
+	ForwardToChildren([&](Analyzer* child)
+	                  { child->NextPacket(len, data, is_orig, seq, ip, caplen); });
+	}
 
-		if ( ! (current->finished || current->removing) )
-			{
-			current->NextUndelivered(seq, len, is_orig);
-			++i;
-			}
-		else
-			i = DeleteChild(i);
-		}
+void Analyzer::ForwardStream(int len, const u_char* data, bool is_orig)
+	{
+	if ( output_handler )
+		output_handler->DeliverStream(len, data, is_orig);
 
-	AppendNewChildren();
+	ForwardToChildren([&](Analyzer* child) { child->NextStream(len, data, is_orig); });
 	}
 
-void Analyzer::ForwardEndOfData(bool orig)
+void Analyzer::ForwardUndelivered(uint64_t seq, int len, bool is_orig)
 	{
-	AppendNewChildren();
-
-	for ( auto i = children.begin(); i != children.end(); )
-		{
-		Analyzer* current = *i;
+	if ( output_handler )
+		output_handler->Undelivered(seq, len, is_orig);
 
-		if ( ! (current->finished || current->removing) )
-			{
-			current->NextEndOfData(orig);
-			++i;
-			}
-		else
-			i = DeleteChild(i);
-		}
+	ForwardToChildren([&](Analyzer* child) { child->NextUndelivered(seq, len, is_orig); });
+	}
 
-	AppendNewChildren();
+void Analyzer::ForwardEndOfData(bool orig)
+	{
+	ForwardToChildren([&](Analyzer* child) { child->NextEndOfData(orig); });
 	}
 
 bool Analyzer::AddChildAnalyzer(Analyzer* analyzer, bool init)
@@ -430,7 +417,7 @@ Analyzer* Analyzer::AddChildAnalyzer(const zeek::Tag& analyzer)
 	return nullptr;
 	}
 
-bool Analyzer::RemoveChild(const analyzer_list& children, ID id)
+template <typename Container> bool Analyzer::DoRemoveChild(const Container& children, ID id)
 	{
 	for ( const auto& i : children )
 		{
@@ -455,6 +442,16 @@ bool Analyzer::RemoveChild(const analyzer_list& children, ID id)
 	return false;
 	}
 
+bool Analyzer::RemoveChild(const analyzer_list& children, ID id)
+	{
+	return DoRemoveChild(children, id);
+	}
+
+bool Analyzer::RemoveChild(const analyzer_vector& children, ID id)
+	{
+	return DoRemoveChild(children, id);
+	}
+
 bool Analyzer::RemoveChildAnalyzer(ID id)
 	{
 	return RemoveChild(children, id) || RemoveChild(new_children, id);
@@ -540,25 +537,36 @@ Analyzer* Analyzer::FindChild(const char* name)
 	return tag ? FindChild(tag) : nullptr;
 	}
 
-analyzer_list::iterator Analyzer::DeleteChild(analyzer_list::iterator i)
+void Analyzer::DeleteFinishedChildren()
 	{
-	Analyzer* child = *i;
-
-	// Analyzer must have already been finished or marked for removal.
-	assert(child->finished || child->removing);
+	// Guard against deliveries triggered from a child's Done() deleting
+	// children underneath us.
+	++delivery_depth;
 
-	if ( child->removing )
+	for ( size_t i = 0; i < children.size(); )
 		{
-		child->Done();
-		child->removing = false;
-		}
+		Analyzer* child = children[i];
+
+		if ( ! (child->finished || child->removing) )
+			{
+			++i;
+			continue;
+			}
 
-	DBG_LOG(DBG_ANALYZER, "%s deleted child %s 3", fmt_analyzer(this).c_str(),
-	        fmt_analyzer(child).c_str());
+		if ( child->removing )
+			{
+			child->Done();
+			child->removing = false;
+			}
 
-	auto next = children.erase(i);
-	delete child;
-	return next;
+		DBG_LOG(DBG_ANALYZER, "%s deleted child %s 3", fmt_analyzer(this).c_str(),
+		        fmt_analyzer(child).c_str());
+
+		children.erase(children.begin() + i);
+		delete child;
+		}
+
+	--delivery_depth;
 	}
 
 void Analyzer::AddSupportAnalyzer(SupportAnalyzer* analyzer)
@@ -794,8 +802,10 @@ void Analyzer::CancelTimers()
 
 void Analyzer::AppendNewChildren()
 	{
-	LOOP_OVER_GIVEN_CHILDREN(i, new_children)
-	children.push_back(*i);
+	if ( new_children.empty() )
+		return;
+
+	children.insert(children.end(), new_children.begin(), new_children.end());
 	new_children.clear();
 	}
 
@@ -51,12 +51,15 @@ class AnalyzerTimer;
 class SupportAnalyzer;
 class OutputHandler;
 
-// This needs to remain a std::list because of the usage of iterators in the
-// Analyzer::Forward methods. These methods have the chance to loop back
-// into the same analyzer in the case of tunnels. If the recursive call adds
-// to the children list, it can invalidate iterators in the outer call,
-// causing a crash.
+// List type used by analyzers that maintain additional sets of children
+// outside of the analyzer tree (e.g., TCP packet children).
 using analyzer_list = std::list<Analyzer*>;
+
+// Storage for an analyzer's direct children. The Analyzer::Forward methods
+// iterate over it by index and defer deleting children until the outermost
+// delivery has returned, so that a delivery looping back into the same
+// analyzer (e.g., with tunnels) can safely add children to it.
+using analyzer_vector = std::vector<Analyzer*>;
 using ID = uint32_t;
 using analyzer_timer_func = void (Analyzer::*)(double t);
 
@@ -484,7 +487,7 @@ public:
 	 * currently queued up to be added. If you just added an analyzer,
 	 * it will not immediately be in this list.
 	 */
-	const analyzer_list& GetChildren() { return children; }
+	const analyzer_vector& GetChildren() { return children; }
 
 	/**
 	 * Returns a pointer to the parent analyzer, or null if this instance
@@ -703,11 +706,24 @@ protected:
 	 */
 	bool RemoveChild(const analyzer_list& children, ID id);
 
+	/**
+	 * Returns true if the child analyzer is now scheduled to be
+	 * removed (and was not before)
+	 */
+	bool RemoveChild(const analyzer_vector& children, ID id);
+
 private:
-	// Internal method to eventually delete a child analyzer that's
-	// already Done(). Returns an iterator pointing to the next element after
-	// the just-removed element.
-	analyzer_list::iterator DeleteChild(analyzer_list::iterator i);
+	// Internal helper passing a delivery on to all active children.
+	// Children that are finished or marked for removal are skipped and
+	// deleted once no delivery is in progress on this analyzer anymore.
+	template <typename Func> void ForwardToChildren(Func deliver);
+
+	// Internal method to delete all children that are already Done() or
+	// marked for removal.
+	void DeleteFinishedChildren();
+
+	// Internal helper for the RemoveChild() overloads.
+	template <typename Container> bool DoRemoveChild(const Container& children, ID id);
 
 	// Helper for the ctors.
 	void CtorInit(const zeek::Tag& tag, Connection* conn);
@@ -734,11 +750,11 @@ private:
 	const zeek::detail::Rule* signature;
 	OutputHandler* output_handler;
 
-	analyzer_list children;
+	analyzer_vector children;
 	SupportAnalyzer* orig_supporters;
 	SupportAnalyzer* resp_supporters;
 
-	analyzer_list new_children;
+	analyzer_vector new_children;
 	std::vector<zeek::Tag> prevented;
 
 	bool protocol_confirmed;
@@ -750,6 +766,9 @@ private:
 	bool finished;
 	bool removing;
 
+	// Number of Forward* calls currently in progress on this analyzer.
+	unsigned int delivery_depth;
+
 	static ID id_counter;
 	};
 
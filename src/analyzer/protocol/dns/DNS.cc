@@ -27,6 +27,7 @@ DNS_Interpreter::DNS_Interpreter(analyzer::Analyzer* arg_analyzer)
 	{
 	analyzer = arg_analyzer;
 	first_message = true;
+	name_weirds = 0;
 	}
 
 void DNS_Interpreter::ParseMessage(const u_char* data, int len, int is_query)
@@ -41,6 +42,10 @@ void DNS_Interpreter::ParseMessage(const u_char* data, int len, int is_query)
 
 	detail::DNS_MsgInfo msg((detail::DNS_RawMsgHdr*)data, is_query);
 
+	// Offsets into the name cache are only valid within a message.
+	name_arena.Clear();
+	name_cache.Clear();
+
 	if ( first_message && msg.QR && is_query == 1 )
 		{
 		is_query = msg.is_query = 0;
@@ -225,7 +230,7 @@ bool DNS_Interpreter::ParseAnswer(detail::DNS_MsgInfo* msg, const u_char*& data,
 	// Note that the exact meaning of some of these fields will be
 	// re-interpreted by other, more adventurous RR types.
 
-	msg->query_name = make_intrusive<StringVal>(new String(name, name_end - name, true));
+	msg->SetQueryName(&name_arena, name_arena.Add(name, name_end - name));
 	msg->atype = detail::RR_Type(ExtractShort(data, len));
 	msg->aclass = ExtractShort(data, len);
 	msg->ttl = ExtractLong(data, len);
@@ -385,7 +390,7 @@ u_char* DNS_Interpreter::ExtractName(const u_char*& data, int& len, u_char* name
 	int n = name - name_start;
 
 	if ( n >= 255 )
-		analyzer->Weird("DNS_NAME_too_long");
+		NameWeird("DNS_NAME_too_long");
 
 	if ( n >= 2 && name[-1] == '.' )
 		{
@@ -441,7 +446,7 @@ bool DNS_Interpreter::ExtractLabel(const u_char*& data, int& len, u_char*& name,
 			//  But actually this turns out not to be the case -
 			//  sometimes compression points to compression.)
 
-			analyzer->Weird("DNS_label_forward_compress_offset");
+			NameWeird("DNS_label_forward_compress_offset");
 			return false;
 			}
 
@@ -449,8 +454,26 @@ bool DNS_Interpreter::ExtractLabel(const u_char*& data, int& len, u_char*& name,
 		const u_char* recurse_data = msg_start + offset;
 		int recurse_max_len = orig_data - recurse_data;
 
+		// A cached expansion is reused only if this pointer leaves it
+		// the same room, both in the message and in the name buffer, so
+		// that the result is the same as expanding again.
+		const auto* cached = name_cache.Lookup(offset);
+		if ( cached && cached->consumed < recurse_max_len && cached->name.len + 1 < name_len )
+			{
+			memcpy(name, name_arena.Data(cached->name), cached->name.len);
+			name_len -= cached->name.len;
+			name += cached->name.len;
+			return false;
+			}
+
+		int prev_weirds = name_weirds;
 		u_char* name_end = ExtractName(recurse_data, recurse_max_len, name, name_len, msg_start);
 
+		// Only cache expansions that didn't stop short.
+		if ( name_weirds == prev_weirds && recurse_max_len > 0 )
+			name_cache.Insert(offset, recurse_data - (msg_start + offset),
+			                  name_arena.Add(name, name_end - name));
+
 		name_len -= name_end - name;
 		name = name_end;
 
@@ -459,7 +482,7 @@ bool DNS_Interpreter::ExtractLabel(const u_char*& data, int& len, u_char*& name,
 
 	if ( label_len > len )
 		{
-		analyzer->Weird("DNS_label_len_gt_pkt");
+		NameWeird("DNS_label_len_gt_pkt");
 		data += len; // consume the rest of the packet
 		len = 0;
 		return false;
@@ -469,13 +492,13 @@ bool DNS_Interpreter::ExtractLabel(const u_char*& data, int& len, u_char*& name,
 	     // NetBIOS name service look ups can use longer labels.
 	     ntohs(analyzer->Conn()->RespPort()) != 137 )
 		{
-		analyzer->Weird("DNS_label_too_long");
+		NameWeird("DNS_label_too_long");
 		return false;
 		}
 
 	if ( label_len >= name_len )
 		{
-		analyzer->Weird("DNS_label_len_gt_name_len");
+		NameWeird("DNS_label_len_gt_name_len");
 		return false;
 		}
 
@@ -491,6 +514,12 @@ bool DNS_Interpreter::ExtractLabel(const u_char*& data, int& len, u_char*& name,
 	return true;
 	}
 
+void DNS_Interpreter::NameWeird(const char* name)
+	{
+	++name_weirds;
+	analyzer->Weird(name);
+	}
+
 uint16_t DNS_Interpreter::ExtractShort(const u_char*& data, int& len)
 	{
 	if ( len < 2 )
@@ -1813,6 +1842,22 @@ DNS_MsgInfo::DNS_MsgInfo(DNS_RawMsgHdr* hdr, int arg_is_query)
 	skip_event = 0;
 	}
 
+void DNS_MsgInfo::SetQueryName(const DNS_NameArena* arena, DNS_NameArena::Span name)
+	{
+	query_name = nullptr;
+	query_name_arena = arena;
+	query_name_span = name;
+	}
+
+const StringValPtr& DNS_MsgInfo::QueryName()
+	{
+	if ( ! query_name && query_name_arena )
+		query_name = make_intrusive<StringVal>(
+			new String(query_name_arena->Data(query_name_span), query_name_span.len, true));
+
+	return query_name;
+	}
+
 RecordValPtr DNS_MsgInfo::BuildHdrVal()
 	{
 	static auto dns_msg = id::find_type<RecordType>("dns_msg");
@@ -1841,7 +1886,7 @@ RecordValPtr DNS_MsgInfo::BuildAnswerVal()
 	auto r = make_intrusive<RecordVal>(dns_answer);
 
 	r->Assign(0, answer_type);
-	r->Assign(1, query_name);
+	r->Assign(1, QueryName());
 	r->Assign(2, atype);
 	r->Assign(3, aclass);
 	r->AssignInterval(4, double(ttl));
@@ -1856,7 +1901,7 @@ RecordValPtr DNS_MsgInfo::BuildEDNS_Val()
 	static auto dns_edns_additional = id::find_type<RecordType>("dns_edns_additional");
 	auto r = make_intrusive<RecordVal>(dns_edns_additional);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, answer_type);
 
 	// type = 0x29 or 41 = EDNS
@@ -1930,7 +1975,7 @@ RecordValPtr DNS_MsgInfo::BuildTSIG_Val(struct TSIG_DATA* tsig)
 	double rtime = tsig->time_s + tsig->time_ms / 1000.0;
 
 	// r->Assign(0, answer_type);
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, answer_type);
 	r->Assign(2, tsig->alg_name);
 	r->Assign(3, tsig->sig);
@@ -1948,7 +1993,7 @@ RecordValPtr DNS_MsgInfo::BuildRRSIG_Val(RRSIG_DATA* rrsig)
 	static auto dns_rrsig_rr = id::find_type<RecordType>("dns_rrsig_rr");
 	auto r = make_intrusive<RecordVal>(dns_rrsig_rr);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, answer_type);
 	r->Assign(2, rrsig->type_covered);
 	r->Assign(3, rrsig->algorithm);
@@ -1969,7 +2014,7 @@ RecordValPtr DNS_MsgInfo::BuildDNSKEY_Val(DNSKEY_DATA* dnskey)
 	static auto dns_dnskey_rr = id::find_type<RecordType>("dns_dnskey_rr");
 	auto r = make_intrusive<RecordVal>(dns_dnskey_rr);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, answer_type);
 	r->Assign(2, dnskey->dflags);
 	r->Assign(3, dnskey->dprotocol);
@@ -1985,7 +2030,7 @@ RecordValPtr DNS_MsgInfo::BuildNSEC3_Val(NSEC3_DATA* nsec3)
 	static auto dns_nsec3_rr = id::find_type<RecordType>("dns_nsec3_rr");
 	auto r = make_intrusive<RecordVal>(dns_nsec3_rr);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, answer_type);
 	r->Assign(2, nsec3->nsec_flags);
 	r->Assign(3, nsec3->nsec_hash_algo);
@@ -2005,7 +2050,7 @@ RecordValPtr DNS_MsgInfo::BuildNSEC3PARAM_Val(NSEC3PARAM_DATA* nsec3param)
 	static auto dns_nsec3param_rr = id::find_type<RecordType>("dns_nsec3param_rr");
 	auto r = make_intrusive<RecordVal>(dns_nsec3param_rr);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, answer_type);
 	r->Assign(2, nsec3param->nsec_flags);
 	r->Assign(3, nsec3param->nsec_hash_algo);
@@ -2022,7 +2067,7 @@ RecordValPtr DNS_MsgInfo::BuildDS_Val(DS_DATA* ds)
 	static auto dns_ds_rr = id::find_type<RecordType>("dns_ds_rr");
 	auto r = make_intrusive<RecordVal>(dns_ds_rr);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, answer_type);
 	r->Assign(2, ds->key_tag);
 	r->Assign(3, ds->algorithm);
@@ -2038,7 +2083,7 @@ RecordValPtr DNS_MsgInfo::BuildBINDS_Val(BINDS_DATA* binds)
 	static auto dns_binds_rr = id::find_type<RecordType>("dns_binds_rr");
 	auto r = make_intrusive<RecordVal>(dns_binds_rr);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, answer_type);
 	r->Assign(2, binds->algorithm);
 	r->Assign(3, binds->key_id);
@@ -2054,7 +2099,7 @@ RecordValPtr DNS_MsgInfo::BuildLOC_Val(LOC_DATA* loc)
 	static auto dns_loc_rr = id::find_type<RecordType>("dns_loc_rr");
 	auto r = make_intrusive<RecordVal>(dns_loc_rr);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, answer_type);
 	r->Assign(2, loc->version);
 	r->Assign(3, loc->size);
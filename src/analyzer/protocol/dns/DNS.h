@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include <vector>
+
 #include "zeek/analyzer/protocol/tcp/TCP.h"
 #include "zeek/binpac_zeek.h"
 
@@ -292,11 +294,89 @@ struct SVCB_DATA
 	StringValPtr target_name;
 	};
 
+// Scratch space for the names extracted from a single DNS message. The
+// storage is retained across messages, so that name extraction normally
+// does not need to allocate anything. Since the buffer may move when it
+// grows, names are referred to by offset.
+class DNS_NameArena
+	{
+public:
+	struct Span
+		{
+		int offset = 0;
+		int len = 0;
+		};
+
+	void Clear() { buf.clear(); }
+
+	Span Add(const u_char* data, int len)
+		{
+		Span s{static_cast<int>(buf.size()), len};
+		buf.insert(buf.end(), data, data + len);
+		return s;
+		}
+
+	const u_char* Data(const Span& s) const { return buf.data() + s.offset; }
+
+private:
+	std::vector<u_char> buf;
+	};
+
+// Remembers how the compression pointers seen in the current message
+// expanded, so that a name suffix referenced by many RRs of a response is
+// only expanded once.
+class DNS_NameCache
+	{
+public:
+	struct Entry
+		{
+		int offset; ///< offset of the pointed-to suffix in the message
+		int consumed; ///< number of message bytes the expansion read
+		DNS_NameArena::Span name; ///< the expanded suffix
+		};
+
+	void Clear()
+		{
+		num_entries = 0;
+		next = 0;
+		}
+
+	const Entry* Lookup(int offset) const
+		{
+		for ( int i = 0; i < num_entries; ++i )
+			if ( entries[i].offset == offset )
+				return &entries[i];
+
+		return nullptr;
+		}
+
+	void Insert(int offset, int consumed, DNS_NameArena::Span name)
+		{
+		entries[next] = {offset, consumed, name};
+		next = (next + 1) % MAX_ENTRIES;
+
+		if ( num_entries < MAX_ENTRIES )
+			++num_entries;
+		}
+
+private:
+	static constexpr int MAX_ENTRIES = 16;
+
+	Entry entries[MAX_ENTRIES];
+	int num_entries = 0;
+	int next = 0;
+	};
+
 class DNS_MsgInfo
 	{
 public:
 	DNS_MsgInfo(DNS_RawMsgHdr* hdr, int is_query);
 
+	// Sets the name of the current RR. The StringVal is only created
+	// once one of the Build*Val() methods needs it.
+	void SetQueryName(const DNS_NameArena* arena, DNS_NameArena::Span name);
+	const StringValPtr& QueryName();
+
 	RecordValPtr BuildHdrVal();
 	RecordValPtr BuildAnswerVal();
 	RecordValPtr BuildEDNS_Val();
@@ -328,7 +408,9 @@ public:
 	int arcount; ///< number of additional RRs
 	int is_query; ///< whether it came from the session initiator
 
-	StringValPtr query_name;
+	StringValPtr query_name; ///< materialized by QueryName()
+	const DNS_NameArena* query_name_arena = nullptr;
+	DNS_NameArena::Span query_name_span;
 	RR_Type atype;
 	int aclass; ///< normally = 1, inet
 	uint32_t ttl;
@@ -367,6 +449,9 @@ protected:
 	bool ExtractLabel(const u_char*& data, int& len, u_char*& label, int& label_len,
 	                  const u_char* msg_start);
 
+	// Reports a problem encountered while extracting a name.
+	void NameWeird(const char* name);
+
 	uint16_t ExtractShort(const u_char*& data, int& len);
 	uint32_t ExtractLong(const u_char*& data, int& len);
 	void ExtractOctets(const u_char*& data, int& len, String** p);
@@ -425,6 +510,10 @@ protected:
 
 	analyzer::Analyzer* analyzer;
 	bool first_message;
+
+	detail::DNS_NameArena name_arena;
+	detail::DNS_NameCache name_cache;
+	int name_weirds; ///< number of NameWeird() calls so far
 	};
 
 enum TCP_DNS_state
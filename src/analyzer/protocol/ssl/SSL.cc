@@ -1,15 +1,19 @@
 #include "zeek/analyzer/protocol/ssl/SSL.h"
 
 #include <arpa/inet.h>
+#include <algorithm>
+#include <cstring>
 #include <openssl/evp.h>
 #include <openssl/opensslv.h>
 
 #include "zeek/Reporter.h"
 #include "zeek/analyzer/Manager.h"
+#include "zeek/analyzer/protocol/ssl/consts.bif.h"
 #include "zeek/analyzer/protocol/ssl/events.bif.h"
 #include "zeek/analyzer/protocol/ssl/ssl_pac.h"
 #include "zeek/analyzer/protocol/ssl/tls-handshake_pac.h"
 #include "zeek/analyzer/protocol/tcp/TCP_Reassembler.h"
+#include "zeek/packet_analysis/protocol/tcp/TCPSessionAdapter.h"
 #include "zeek/util.h"
 
 #ifdef OPENSSL_HAVE_KDF_H
@@ -103,6 +107,22 @@ void SSL_Analyzer::DeliverStream(int len, const u_char* data, bool orig)
 		// deliver data to the other side if the script layer can handle this.
 		return;
 
+	auto& tracker = record_tracker[orig];
+
+	if ( tracker.skipping )
+		{
+		int consumed = TrackRecords(len, data, orig);
+		if ( consumed == len )
+			return;
+
+		// We lost track of the records; let binpac deal with the rest.
+		data += consumed;
+		len -= consumed;
+		}
+
+	else if ( tracker.valid )
+		TrackRecords(len, data, orig);
+
 	try
 		{
 		interp->NewData(orig, data, data + len);
@@ -111,6 +131,132 @@ void SSL_Analyzer::DeliverStream(int len, const u_char* data, bool orig)
 		{
 		AnalyzerViolation(util::fmt("Binpac exception: %s", e.c_msg()));
 		}
+
+	// Switch over only on a record boundary, where binpac does not have
+	// any partial record buffered.
+	if ( tracker.valid && tracker.hdr_len == 0 && tracker.remaining == 0 &&
+	     CanSkipEncryptedPhase(orig) )
+		StartEncryptedPhase(orig);
+	}
+
+int SSL_Analyzer::TrackRecords(int len, const u_char* data, bool orig)
+	{
+	auto& t = record_tracker[orig];
+	int i = 0;
+
+	while ( i < len )
+		{
+		if ( t.remaining > 0 )
+			{
+			int n = std::min(t.remaining, len - i);
+			t.remaining -= n;
+			i += n;
+
+			if ( t.remaining > 0 )
+				break;
+			}
+
+		else
+			{
+			int n = std::min(5 - t.hdr_len, len - i);
+			memcpy(t.hdr + t.hdr_len, data + i, n);
+			t.hdr_len += n;
+			i += n;
+
+			if ( t.hdr_len < 5 )
+				break;
+
+			// Same checks as binpac's determine_ssl_record_layer(),
+			// which accepts any version from SSLv3 to TLS 1.2 and, once
+			// it has seen a TLS record (which rules out SSLv2), any
+			// content type.  It remembers that per connection, not per
+			// direction, so we may give up on the first record of the
+			// second direction where binpac doesn't.  That only costs
+			// us the skipping, as binpac still sees all data then.
+			uint8_t content_type = t.hdr[0];
+			uint16_t version = (t.hdr[1] << 8) | t.hdr[2];
+			bool bad_type = ! t.had_record && (content_type < 20 || content_type > 30);
+
+			if ( bad_type || version < 0x0300 || version > 0x0303 )
+				{
+				t.valid = false;
+				t.hdr_len = 0;
+
+				if ( ! t.skipping )
+					return i;
+
+				// Hand the header over to binpac, which will flag the
+				// violation; the caller passes on what's left.
+				t.skipping = false;
+
+				try
+					{
+					interp->NewData(orig, t.hdr, t.hdr + 5);
+					}
+				catch ( const binpac::Exception& e )
+					{
+					AnalyzerViolation(util::fmt("Binpac exception: %s", e.c_msg()));
+					}
+
+				return i;
+				}
+
+			t.remaining = (t.hdr[3] << 8) | t.hdr[4];
+			t.had_record = true;
+			}
+
+		if ( t.remaining == 0 )
+			{
+			// Record complete.
+			t.hdr_len = 0;
+
+			if ( t.skipping && ssl_encrypted_data )
+				BifEvent::enqueue_ssl_encrypted_data(
+					this, Conn(), orig ^ GetFlipped(), (t.hdr[1] << 8) | t.hdr[2], t.hdr[0],
+					(t.hdr[3] << 8) | t.hdr[4]);
+			}
+		}
+
+	return i;
+	}
+
+bool SSL_Analyzer::CanSkipEncryptedPhase(bool orig) const
+	{
+	if ( ! BifConst::SSL::skip_encrypted_phase )
+		return false;
+
+	if ( ! interp->established() || interp->state(orig) != binpac::SSL::STATE_ENCRYPTED )
+		return false;
+
+	// Application data has to go through binpac if we (still) try to
+	// decrypt it.
+	if ( (secret.size() != 0 || keys.size() != 0) && ! interp->decryption_failed() )
+		return false;
+
+	return true;
+	}
+
+void SSL_Analyzer::StartEncryptedPhase(bool orig)
+	{
+	DBG_LOG(DBG_ANALYZER, "SSL: bypassing record parser for %s encrypted data",
+	        orig ? "originator" : "responder");
+
+	record_tracker[orig].skipping = true;
+
+	if ( ! BifConst::SSL::disable_reassembly_after_handshake || ssl_encrypted_data )
+		return;
+
+	if ( ! record_tracker[! orig].skipping )
+		return;
+
+	// Nothing left to do for us in this connection. If we sit directly on
+	// top of TCP, we can also spare it the reassembly.
+	auto tcp = TCP();
+	if ( tcp && Parent() == tcp )
+		{
+		DBG_LOG(DBG_ANALYZER, "SSL: disabling reassembly in encrypted phase");
+		tcp->DisableReassembly();
+		}
 	}
 
 void SSL_Analyzer::SendHandshake(uint16_t raw_tls_version, const u_char* begin, const u_char* end,
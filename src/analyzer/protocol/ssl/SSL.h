@@ -161,6 +161,56 @@ protected:
 	 */
 	void ForwardDecryptedData(const std::vector<u_char>& data, bool is_orig);
 
+	/**
+	 * Follows the TLS record boundaries of one direction by looking only at
+	 * the 5-byte record headers. Once the connection is in its encrypted
+	 * phase, this replaces the binpac parser and raises ssl_encrypted_data
+	 * for every complete record.
+	 *
+	 * @param len Length of the data
+	 *
+	 * @param data Pointer to the data
+	 *
+	 * @param is_orig Direction of the connection
+	 *
+	 * @return The number of bytes consumed. This is less than *len* only if
+	 * the encrypted phase had to be left because of a record header that
+	 * does not look like TLS; the remaining data then has to be passed on
+	 * to the binpac parser.
+	 */
+	int TrackRecords(int len, const u_char* data, bool is_orig);
+
+	/**
+	 * Checks if the binpac parser can be bypassed for a direction, which
+	 * is the case once the handshake is done and we are not decrypting.
+	 *
+	 * @param is_orig Direction of the connection
+	 *
+	 * @return True if the encrypted phase can be started.
+	 */
+	bool CanSkipEncryptedPhase(bool is_orig) const;
+
+	/**
+	 * Switches a direction into its encrypted phase. Must only be called on
+	 * a record boundary.
+	 *
+	 * @param is_orig Direction of the connection
+	 */
+	void StartEncryptedPhase(bool is_orig);
+
+	// Per-direction state of the record boundary tracking.
+	struct RecordTracker
+		{
+		u_char hdr[5];
+		int hdr_len = 0; // number of header bytes seen so far
+		int remaining = 0; // payload bytes left in the current record
+		bool valid = true; // false if the stream is not made up of TLS records
+		bool had_record = false; // true once a complete header passed the checks
+		bool skipping = false; // true if the binpac parser is bypassed
+		};
+
+	RecordTracker record_tracker[2];
+
 	binpac::SSL::SSL_Conn* interp;
 	binpac::TLSHandshake::Handshake_Conn* handshake_interp;
 	bool had_gap;
@@ -68,6 +68,10 @@ public:
 	// Can be used to skip HTTP data for performance considerations.
 	void SkipToSeq(uint64_t seq);
 
+	// If set, any further data is ignored rather than reassembled.
+	void SetSkipDeliveries(bool should_skip) { skip_deliveries = should_skip; }
+	bool SkipDeliveries() const { return skip_deliveries; }
+
 	bool DataSent(double t, uint64_t seq, int len, const u_char* data,
 	              analyzer::tcp::TCP_Flags flags, bool replaying = true);
 	void AckReceived(uint64_t seq);
@@ -463,17 +463,18 @@ struct val_converter
 			if ( ! exact_text || ! anywhere_text )
 				return nullptr;
 
-			auto* re = new RE_Matcher(exact_text->c_str(), anywhere_text->c_str());
+			bool compiled;
+			auto re = zeek::detail::cached_RE_Matcher(exact_text->c_str(), anywhere_text->c_str(),
+			                                          &compiled);
 
-			if ( ! re->Compile() )
+			if ( ! compiled )
 				{
 				reporter->Error("failed compiling unserialized pattern: %s, %s",
 				                exact_text->c_str(), anywhere_text->c_str());
-				delete re;
 				return nullptr;
 				}
 
-			auto rval = make_intrusive<PatternVal>(re);
+			auto rval = make_intrusive<PatternVal>(std::move(re));
 			return rval;
 			}
 		else if ( type->Tag() == TYPE_OPAQUE )
@@ -778,9 +779,10 @@ struct type_checker
 			if ( ! exact_text || ! anywhere_text )
 				return false;
 
-			auto* re = new RE_Matcher(exact_text->c_str(), anywhere_text->c_str());
-			auto compiled = re->Compile();
-			delete re;
+			// Goes through the cache, so the matcher is ready once the value
+			// gets unserialized.
+			bool compiled;
+			zeek::detail::cached_RE_Matcher(exact_text->c_str(), anywhere_text->c_str(), &compiled);
 
 			if ( ! compiled )
 				{
@@ -2356,9 +2356,8 @@ Val* Manager::ValueToVal(const Stream* i, const Value* val, Type* request_type,
 
 		case TYPE_PATTERN:
 			{
-			auto* re = new RE_Matcher(val->val.pattern_text_val);
-			re->Compile();
-			return new PatternVal(re);
+			auto re = zeek::detail::cached_RE_Matcher(val->val.pattern_text_val);
+			return new PatternVal(std::move(re));
 			}
 
 		case TYPE_TABLE:
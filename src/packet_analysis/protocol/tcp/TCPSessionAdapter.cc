@@ -759,6 +759,15 @@ void TCPSessionAdapter::EnableReassembly()
 					   this, this, analyzer::tcp::TCP_Reassembler::Forward, resp));
 	}
 
+void TCPSessionAdapter::DisableReassembly()
+	{
+	if ( orig->contents_processor )
+		orig->contents_processor->SetSkipDeliveries(true);
+
+	if ( resp->contents_processor )
+		resp->contents_processor->SetSkipDeliveries(true);
+	}
+
 void TCPSessionAdapter::SetReassembler(analyzer::tcp::TCP_Reassembler* rorig,
                                        analyzer::tcp::TCP_Reassembler* rresp)
 	{
@@ -1342,13 +1351,16 @@ FilePtr TCPSessionAdapter::GetContentsFile(unsigned int direction) const
 void TCPSessionAdapter::ConnectionClosed(analyzer::tcp::TCP_Endpoint* endpoint,
                                          analyzer::tcp::TCP_Endpoint* peer, bool gen_event)
 	{
-	const analyzer::analyzer_list& children(GetChildren());
-	LOOP_OVER_CONST_CHILDREN(i)
-	// Using this type of cast here is nasty (will crash if
-	// we inadvertantly have a child analyzer that's not a
-	// TCP_ApplicationAnalyzer), but we have to ...
-	static_cast<analyzer::tcp::TCP_ApplicationAnalyzer*>(*i)->ConnectionClosed(endpoint, peer,
-	                                                                           gen_event);
+	const analyzer::analyzer_vector& children(GetChildren());
+	// Iterate by index, the callbacks may end up appending children.
+	for ( size_t i = 0; i < children.size(); ++i )
+		{
+		// Using this type of cast here is nasty (will crash if
+		// we inadvertantly have a child analyzer that's not a
+		// TCP_ApplicationAnalyzer), but we have to ...
+		auto child = static_cast<analyzer::tcp::TCP_ApplicationAnalyzer*>(children[i]);
+		child->ConnectionClosed(endpoint, peer, gen_event);
+		}
 
 	if ( DataPending(endpoint) )
 		{
@@ -1438,10 +1450,13 @@ void TCPSessionAdapter::ConnectionClosed(analyzer::tcp::TCP_Endpoint* endpoint,
 
 void TCPSessionAdapter::ConnectionFinished(bool half_finished)
 	{
-	const analyzer::analyzer_list& children(GetChildren());
-	LOOP_OVER_CONST_CHILDREN(i)
-	// Again, nasty - see TCPSessionAdapter::ConnectionClosed.
-	static_cast<analyzer::tcp::TCP_ApplicationAnalyzer*>(*i)->ConnectionFinished(half_finished);
+	const analyzer::analyzer_vector& children(GetChildren());
+	for ( size_t i = 0; i < children.size(); ++i )
+		{
+		// Again, nasty - see TCPSessionAdapter::ConnectionClosed.
+		auto child = static_cast<analyzer::tcp::TCP_ApplicationAnalyzer*>(children[i]);
+		child->ConnectionFinished(half_finished);
+		}
 
 	if ( half_finished )
 		Event(connection_half_finished);
@@ -1455,9 +1470,12 @@ void TCPSessionAdapter::ConnectionReset()
 	{
 	Event(connection_reset);
 
-	const analyzer::analyzer_list& children(GetChildren());
-	LOOP_OVER_CONST_CHILDREN(i)
-	static_cast<analyzer::tcp::TCP_ApplicationAnalyzer*>(*i)->ConnectionReset();
+	const analyzer::analyzer_vector& children(GetChildren());
+	for ( size_t i = 0; i < children.size(); ++i )
+		{
+		auto child = static_cast<analyzer::tcp::TCP_ApplicationAnalyzer*>(children[i]);
+		child->ConnectionReset();
+		}
 
 	is_active = 0;
 	}
@@ -1490,9 +1508,12 @@ void TCPSessionAdapter::EndpointEOF(analyzer::tcp::TCP_Reassembler* endp)
 	if ( connection_EOF )
 		EnqueueConnEvent(connection_EOF, ConnVal(), val_mgr->Bool(endp->IsOrig()));
 
-	const analyzer::analyzer_list& children(GetChildren());
-	LOOP_OVER_CONST_CHILDREN(i)
-	static_cast<analyzer::tcp::TCP_ApplicationAnalyzer*>(*i)->EndpointEOF(endp->IsOrig());
+	const analyzer::analyzer_vector& children(GetChildren());
+	for ( size_t i = 0; i < children.size(); ++i )
+		{
+		auto child = static_cast<analyzer::tcp::TCP_ApplicationAnalyzer*>(children[i]);
+		child->EndpointEOF(endp->IsOrig());
+		}
 
 	if ( close_deferred )
 		{
@@ -1512,9 +1533,12 @@ void TCPSessionAdapter::EndpointEOF(analyzer::tcp::TCP_Reassembler* endp)
 
 void TCPSessionAdapter::PacketWithRST()
 	{
-	const analyzer::analyzer_list& children(GetChildren());
-	LOOP_OVER_CONST_CHILDREN(i)
-	static_cast<analyzer::tcp::TCP_ApplicationAnalyzer*>(*i)->PacketWithRST();
+	const analyzer::analyzer_vector& children(GetChildren());
+	for ( size_t i = 0; i < children.size(); ++i )
+		{
+		auto child = static_cast<analyzer::tcp::TCP_ApplicationAnalyzer*>(children[i]);
+		child->PacketWithRST();
+		}
 	}
 
 void TCPSessionAdapter::CheckPIA_FirstPacket(bool is_orig, const IP_Hdr* ip)
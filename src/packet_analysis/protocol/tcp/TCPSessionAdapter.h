@@ -38,6 +38,10 @@ public:
 
 	void EnableReassembly();
 
+	// Stops reassembly for both endpoints. Analyzers that know they
+	// won't need any further stream data can use this to shed the cost.
+	void DisableReassembly();
+
 	// Add a child analyzer that will always get the packets,
 	// independently of whether we do any reassembly.
 	void AddChildPacketAnalyzer(analyzer::Analyzer* a);
@@ -135,6 +135,12 @@ const char* CPPCompile::AttrName(AttrTag t)
 			return "ATTR_IS_ASSIGNED";
 		case ATTR_IS_USED:
 			return "ATTR_IS_USED";
+		case ATTR_ORDERED:
+			return "ATTR_ORDERED";
+		case ATTR_MAX_SIZE:
+			return "ATTR_MAX_SIZE";
+		case ATTR_EVICTION:
+			return "ATTR_EVICTION";
 
 		default:
 			return "<busted>";
@@ -1004,7 +1004,8 @@ string CPPCompile::GenBinaryPattern(const Expr* e, GenType gt, const char* op)
 	auto v1 = GenExpr(e->GetOp1(), GEN_DONT_CARE) + "->AsPattern()";
 	auto v2 = GenExpr(e->GetOp2(), GEN_DONT_CARE) + "->AsPattern()";
 
-	auto func = e->Tag() == EXPR_AND ? "RE_Matcher_conjunction" : "RE_Matcher_disjunction";
+	auto func = e->Tag() == EXPR_AND ? "cached_RE_Matcher_conjunction"
+	                                 : "cached_RE_Matcher_disjunction";
 
 	return NativeToGT(string("make_intrusive<PatternVal>(") + func + "(" + v1 + ", " + v2 + "))",
 	                  e->GetType(), gt);
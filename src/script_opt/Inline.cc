@@ -128,7 +128,9 @@ void Inliner::Analyze()
 		}
 
 	for ( auto& f : funcs )
-		if ( should_analyze(f.FuncPtr(), f.Body()) )
+		// Skipped functions have been marked as already taken care
+		// of, for example because they were found in the ZAM cache.
+		if ( should_analyze(f.FuncPtr(), f.Body()) && ! f.ShouldSkip() )
 			InlineFunction(&f);
 	}
 
@@ -317,6 +317,14 @@ public:
 
 	p_hash_type HashAttrs(const AttributesPtr& attrs);
 
+	// Returns the representative Type* for a hash previously computed
+	// by HashType(), or nil if no such type has been hashed.
+	const Type* TypeForHash(p_hash_type h) const
+		{
+		auto it = type_hash_reps.find(h);
+		return it == type_hash_reps.end() ? nullptr : it->second;
+		}
+
 protected:
 	// Incorporate the given function profile into the global profile.
 	void MergeInProfile(ProfileFunc* pf);
@@ -8,6 +8,7 @@
 #include "zeek/Options.h"
 #include "zeek/Reporter.h"
 #include "zeek/module_util.h"
+#include "zeek/util.h"
 #include "zeek/script_opt/CPP/Compile.h"
 #include "zeek/script_opt/CPP/Func.h"
 #include "zeek/script_opt/GenIDDefs.h"
@@ -16,6 +17,7 @@
 #include "zeek/script_opt/Reduce.h"
 #include "zeek/script_opt/UsageAnalyzer.h"
 #include "zeek/script_opt/UseDefs.h"
+#include "zeek/script_opt/ZAM/Cache.h"
 #include "zeek/script_opt/ZAM/Compile.h"
 
 namespace zeek::detail
@@ -31,7 +33,9 @@ void (*CPP_activation_hook)() = nullptr;
 // Tracks all of the loaded functions (including event handlers and hooks).
 static std::vector<FuncInfo> funcs;
 
-static ZAMCompiler* ZAM = nullptr;
+// Function bodies whose ZAM instructions have been generated, but that
+// still need low-level optimization and finishing.
+static std::vector<std::pair<FuncInfo*, ZAMCompiler*>> pending_ZAM_bodies;
 
 static bool generating_CPP = false;
 static std::string CPP_dir; // where to generate C++ code
@@ -141,25 +145,28 @@ static bool optimize_AST(ScriptFunc* f, std::shared_ptr<ProfileFunc>& pf,
 	return true;
 	}
 
-static void optimize_func(ScriptFunc* f, std::shared_ptr<ProfileFunc> pf, ScopePtr scope,
-                          StmtPtr& body)
+// Returns the compiler holding the body's ZAM instructions, if generating
+// those, and nil if that didn't happen.  The body then still needs to be
+// finished and installed; see finish_ZAM_bodies().
+static ZAMCompiler* optimize_func(ScriptFunc* f, std::shared_ptr<ProfileFunc> pf, ScopePtr scope,
+                                  StmtPtr& body)
 	{
 	if ( reporter->Errors() > 0 )
-		return;
+		return nullptr;
 
 	if ( analysis_options.dump_xform )
 		printf("Original: %s\n", obj_desc(body.get()).c_str());
 
 	if ( body->Tag() == STMT_CPP )
 		// We're not able to optimize this.
-		return;
+		return nullptr;
 
 	const char* reason;
 	if ( ! is_ZAM_compilable(pf.get(), &reason) )
 		{
 		if ( analysis_options.report_uncompilable )
 			printf("Skipping compilation of %s due to %s\n", f->Name(), reason);
-		return;
+		return nullptr;
 		}
 
 	push_existing_scope(scope);
@@ -170,7 +177,7 @@ static void optimize_func(ScriptFunc* f, std::shared_ptr<ProfileFunc> pf, ScopeP
 	if ( reporter->Errors() > 0 )
 		{
 		pop_scope();
-		return;
+		return nullptr;
 		}
 
 	non_reduced_perp = nullptr;
@@ -196,7 +203,7 @@ static void optimize_func(ScriptFunc* f, std::shared_ptr<ProfileFunc> pf, ScopeP
 	if ( analysis_options.optimize_AST && ! optimize_AST(f, pf, rc, scope, body) )
 		{
 		pop_scope();
-		return;
+		return nullptr;
 		}
 
 	// Profile the new body.
@@ -226,23 +233,60 @@ static void optimize_func(ScriptFunc* f, std::shared_ptr<ProfileFunc> pf, ScopeP
 	if ( new_frame_size > f->FrameSize() )
 		f->SetFrameSize(new_frame_size);
 
+	ZAMCompiler* ZAM = nullptr;
+
 	if ( analysis_options.gen_ZAM_code )
 		{
 		ZAM = new ZAMCompiler(f, pf, scope, new_body, ud, rc);
 
-		new_body = ZAM->CompileBody();
+		if ( ! ZAM->CompileInsts() )
+			{
+			pop_scope();
+			return nullptr;
+			}
+		}
+
+	pop_scope();
+
+	return ZAM;
+	}
+
+// Runs the low-level optimization for the pending ZAM bodies, spread across
+// threads, and then installs the finished bodies in their original order.
+static void finish_ZAM_bodies(ZAMCache* cache)
+	{
+	auto& pending = pending_ZAM_bodies;
+
+	if ( ! analysis_options.no_ZAM_opt )
+		{
+		// Dumping happens from within the optimizer, so keep it serial
+		// to avoid interleaved output.
+		unsigned int threads = analysis_options.dump_ZAM ? 1
+		                                                 : analysis_options.ZAM_compile_threads;
+
+		util::detail::run_parallel(pending.size(), threads,
+		                           [&pending](size_t i) { pending[i].second->OptimizeInsts(); });
+		}
+
+	for ( auto& [f, ZAM] : pending )
+		{
+		auto new_body = ZAM->FinishBody();
 
 		if ( reporter->Errors() > 0 )
-			return;
+			break;
 
 		if ( analysis_options.dump_ZAM )
 			ZAM->Dump();
 
-		f->ReplaceBody(body, new_body);
-		body = new_body;
+		if ( cache )
+			cache->Save(*f, static_cast<const ZBody*>(new_body.get()));
+
+		auto body = f->Body();
+		f->Func()->ReplaceBody(body, new_body);
+		f->SetBody(new_body);
 		}
 
-	pop_scope();
+	pending.clear();
 	}
 
 static void check_env_opt(const char* opt, bool& opt_flag)
@@ -270,6 +314,14 @@ static void init_options()
 	check_env_opt("ZEEK_DUMP_ZAM", analysis_options.dump_ZAM);
 	check_env_opt("ZEEK_PROFILE", analysis_options.profile_ZAM);
 
+	auto zam_threads = getenv("ZEEK_ZAM_THREADS");
+	if ( zam_threads )
+		analysis_options.ZAM_compile_threads = atoi(zam_threads);
+
+	auto zam_cache = getenv("ZEEK_ZAM_CACHE");
+	if ( zam_cache )
+		analysis_options.ZAM_cache_dir = zam_cache;
+
 	// Compile-to-C++-related options.
 	check_env_opt("ZEEK_ADD_CPP", analysis_options.add_CPP);
 	check_env_opt("ZEEK_GEN_CPP", analysis_options.gen_CPP);
@@ -451,6 +503,36 @@ static void analyze_scripts_for_ZAM(std::unique_ptr<ProfileFuncs>& pfs)
 
 	pfs = std::make_unique<ProfileFuncs>(funcs, nullptr, true);
 
+	// Look for already-compiled bodies prior to inlining, which changes
+	// the bodies.  We skip the cache if we're dumping intermediary
+	// results, since those won't be produced for cached bodies.
+	std::unique_ptr<ZAMCache> cache;
+	std::unordered_map<const FuncInfo*, StmtPtr> cached_bodies;
+
+	if ( ! analysis_options.ZAM_cache_dir.empty() && analysis_options.gen_ZAM_code &&
+	     analysis_options.activate && ! analysis_options.dump_ZAM &&
+	     ! analysis_options.dump_xform && ! analysis_options.dump_uds )
+		{
+		cache = std::make_unique<ZAMCache>(analysis_options.ZAM_cache_dir, *pfs);
+		if ( ! cache->IsValid() )
+			cache.reset();
+		}
+
+	if ( cache )
+		for ( auto& f : funcs )
+			{
+			if ( ! should_analyze(f.FuncPtr(), f.Body()) || f.Body()->Tag() == STMT_CPP )
+				continue;
+
+			auto zb = cache->Load(f);
+			if ( zb )
+				{
+				cached_bodies[&f] = zb;
+				// Tells the inliner to leave the body alone.
+				f.SetSkip(true);
+				}
+			}
+
 	bool report_recursive = analysis_options.report_recursive;
 	std::unique_ptr<Inliner> inl;
 	if ( analysis_options.inliner )
@@ -508,15 +590,34 @@ static void analyze_scripts_for_ZAM(std::unique_ptr<ProfileFuncs>& pfs)
 			// No need to compile as it won't be called directly.
 			continue;
 
+		auto cb = cached_bodies.find(&f);
+		if ( cb != cached_bodies.end() )
+			{
+			func->ReplaceBody(f.Body(), cb->second);
+			f.SetBody(cb->second);
+			did_one = true;
+			continue;
+			}
+
 		auto new_body = f.Body();
-		optimize_func(func, f.ProfilePtr(), f.Scope(), new_body);
+		auto ZAM = optimize_func(func, f.ProfilePtr(), f.Scope(), new_body);
 		f.SetBody(new_body);
+
+		if ( ZAM )
+			pending_ZAM_bodies.emplace_back(&f, ZAM);
+
 		did_one = true;
 		}
 
 	if ( ! did_one )
 		reporter->FatalError("no matching functions/files for -O ZAM");
 
+	finish_ZAM_bodies(cache.get());
+
+	if ( cache && analysis_options.report_ZAM_cache )
+		fprintf(stderr, "ZAM cache: %d loaded, %d saved\n", cache->NumLoaded(),
+		        cache->NumSaved());
+
 	finalize_functions(funcs);
 	}
 
@@ -72,6 +72,18 @@ struct AnalyOpt
 	// Produce a profile of ZAM execution.
 	bool profile_ZAM = false;
 
+	// Number of threads for the low-level optimization of ZAM function
+	// bodies.  Zero means one per CPU core.
+	int ZAM_compile_threads = 0;
+
+	// If non-empty, a directory in which to cache compiled ZAM function
+	// bodies across runs.
+	std::string ZAM_cache_dir;
+
+	// If true, report to stderr how many bodies were loaded from and
+	// saved to the ZAM cache.
+	bool report_ZAM_cache = false;
+
 	// If true, dump out transformed code: the results of reducing
 	// interpreted scripts, and, if optimize is set, of then optimizing
 	// them.
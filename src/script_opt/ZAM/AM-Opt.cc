@@ -4,6 +4,8 @@
 // i.e., code improvement that's done after the compiler has generated
 // an initial, complete intermediary function body.
 
+#include <cstdarg>
+
 #include "zeek/Desc.h"
 #include "zeek/Reporter.h"
 #include "zeek/input.h"
@@ -133,8 +135,35 @@ void ZAMCompiler::OptimizeInsts()
 			}
 		} while ( something_changed );
 
+	if ( FuseInsts() )
+		{
+		if ( dump_intermediaries )
+			{
+			printf("Did some fusing:\n");
+			DumpInsts1(nullptr);
+			}
+
+		ComputeFrameLifetimes();
+		}
+
 	ReMapFrame();
-	ReMapInterpreterFrame();
+	}
+
+void ZAMCompiler::OptError(const char* fmt, ...)
+	{
+	// Not util::fmt(), as that uses a static buffer.
+	va_list ap, ap_copy;
+	va_start(ap, fmt);
+	va_copy(ap_copy, ap);
+
+	int n = vsnprintf(nullptr, 0, fmt, ap);
+	std::vector<char> buf(n > 0 ? n + 1 : 1);
+	vsnprintf(buf.data(), buf.size(), fmt, ap_copy);
+
+	va_end(ap_copy);
+	va_end(ap);
+
+	opt_errors.emplace_back(buf.data());
 	}
 
 template <typename T> void ZAMCompiler::TallySwitchTargets(const CaseMapsI<T>& switches)
@@ -323,8 +352,8 @@ bool ZAMCompiler::PruneUnused()
 		if ( assignmentless_op.count(inst->op) == 0 )
 			reporter->InternalError("inconsistency in re-flavoring instruction with side effects");
 
-		inst->op_type = assignmentless_op_type[inst->op];
-		inst->op = assignmentless_op[inst->op];
+		inst->op_type = assignmentless_op_type.at(inst->op);
+		inst->op = assignmentless_op.at(inst->op);
 
 		inst->v1 = inst->v2;
 		inst->v2 = inst->v3;
@@ -338,6 +367,74 @@ bool ZAMCompiler::PruneUnused()
 	return did_prune;
 	}
 
+bool ZAMCompiler::FuseInsts()
+	{
+	bool did_fuse = false;
+	auto bool_index_op = AssignmentFlavor(OP_TABLE_INDEX1_VVV, TYPE_BOOL);
+
+	for ( auto i0 : insts1 )
+		{
+		if ( ! i0->live || ! i0->AssignsToSlot1() )
+			continue;
+
+		auto i1 = NextLiveInst(i0);
+
+		if ( ! i1 || i1->num_labels > 0 )
+			// Control can reach i1 without going through i0.
+			continue;
+
+		int slot = i0->v1;
+
+		if ( frame_denizens[slot]->IsGlobal() || ! VarIsUsedOnlyBy(slot, i1) )
+			continue;
+
+		// In each case, i1 becomes the superinstruction, so it keeps
+		// any branch target, and killing i0 moves its labels to i1.
+		bool is_if = i1->op == OP_IF_VV || i1->op == OP_IF_ELSE_VV || i1->op == OP_IF_NOT_VV;
+		bool is_if_not = i1->op == OP_IF_NOT_VV;
+
+		if ( i0->op == OP_FIELD_VVi_R && i1->IsFieldLoad() && i1->v2 == slot )
+			{
+			i1->op = OP_FIELD_FIELD_VVii;
+			i1->op_type = OP_VVVV_I3_I4;
+			i1->v4 = i1->v3;
+			i1->v3 = i0->v3;
+			i1->v2 = i0->v2;
+			}
+
+		else if ( i0->op == OP_FIELD_VVi && is_if && i1->v1 == slot )
+			{
+			i1->op = is_if_not ? OP_FIELD_IF_NOT_VVV : OP_FIELD_IF_VVV;
+			i1->op_type = OP_VVV_I2_I3;
+			i1->v1 = i0->v2;
+			i1->v2 = i0->v3;
+			i1->target_slot = 3;
+			}
+
+		else if ( i0->op == bool_index_op && is_if && i1->v1 == slot )
+			{
+			i1->op = is_if_not ? OP_TABLE_INDEX1_IF_NOT_VVV : OP_TABLE_INDEX1_IF_VVV;
+			i1->op_type = OP_VVV_I3;
+			i1->v1 = i0->v3;
+			i1->v2 = i0->v2;
+			i1->t = std::move(i0->t);
+			i1->target_slot = 3;
+			}
+
+		else
+			continue;
+
+		// Run-time errors now come from i1, so report them for
+		// the statement that gave rise to i0.
+		i1->stmt = i0->stmt;
+
+		KillInst(i0);
+		did_fuse = true;
+		}
+
+	return did_fuse;
+	}
+
 void ZAMCompiler::ComputeFrameLifetimes()
 	{
 	// Start analysis from scratch, since we might do this repeatedly.
@@ -529,19 +626,22 @@ void ZAMCompiler::ReMapFrame()
 	std::vector<GlobalInfo> used_globals;
 	std::vector<int> remapped_globals;
 
+	// Moving rather than copying keeps reference counts of the
+	// (shared) globals untouched, which matters when running on a
+	// worker thread.
 	for ( auto& g : globalsI )
 		{
 		g.slot = frame1_to_frame2[g.slot];
 		if ( g.slot >= 0 )
 			{
 			remapped_globals.push_back(used_globals.size());
-			used_globals.push_back(g);
+			used_globals.push_back(std::move(g));
 			}
 		else
 			remapped_globals.push_back(-1);
 		}
 
-	globalsI = used_globals;
+	globalsI = std::move(used_globals);
 
 	// Gulp - now rewrite every instruction to update its slot usage.
 	// In the process, if an instruction becomes a direct assignment
@@ -599,8 +699,8 @@ void ZAMCompiler::ReMapFrame()
 						{
 						ODesc d;
 						inst->stmt->GetLocationInfo()->Describe(&d);
-						reporter->Error("%s: value used but not set: %s", d.Description(),
-						                frame_denizens[slot]->Name());
+						OptError("%s: value used but not set: %s", d.Description(),
+						         frame_denizens[slot]->Name());
 						}
 
 					slot = new_slot;
@@ -786,8 +886,8 @@ void ZAMCompiler::CheckSlotUse(int slot, const ZInstI* inst)
 		{
 		ODesc d;
 		inst->stmt->GetLocationInfo()->Describe(&d);
-		reporter->Error("%s: value used but not set: %s", d.Description(),
-		                frame_denizens[slot]->Name());
+		OptError("%s: value used but not set: %s", d.Description(),
+		         frame_denizens[slot]->Name());
 		}
 
 	// See comment above about temporaries not having their values
@@ -958,6 +1058,25 @@ bool ZAMCompiler::VarIsUsed(int slot) const
 	return false;
 	}
 
+bool ZAMCompiler::VarIsUsedOnlyBy(int slot, const ZInstI* i) const
+	{
+	for ( auto& inst : insts1 )
+		{
+		if ( inst != i && inst->live && inst->UsesSlot(slot) )
+			return false;
+
+		auto aux = inst->aux;
+		if ( aux && aux->slots )
+			{
+			for ( int j = 0; j < aux->n; ++j )
+				if ( aux->slots[j] == slot )
+					return false;
+			}
+		}
+
+	return true;
+	}
+
 ZInstI* ZAMCompiler::FirstLiveInst(ZInstI* i, bool follow_gotos)
 	{
 	if ( i == pending_inst )
@@ -982,7 +1101,7 @@ zeek_uint_t ZAMCompiler::FirstLiveInst(zeek_uint_t i, bool follow_gotos)
 				{
 				if ( ++num_inspected > insts1.size() )
 					{
-					reporter->Error("%s contains an infinite loop", func->Name());
+					OptError("%s contains an infinite loop", func->Name());
 					return i;
 					}
 
@@ -0,0 +1,1073 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/script_opt/ZAM/Cache.h"
+
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <unordered_set>
+
+#include "zeek/EventRegistry.h"
+#include "zeek/Func.h"
+#include "zeek/IPAddr.h"
+#include "zeek/RE.h"
+#include "zeek/Reporter.h"
+#include "zeek/Scope.h"
+#include "zeek/Val.h"
+#include "zeek/script_opt/ZAM/Compile.h"
+
+namespace zeek
+	{
+extern const char* zeek_version();
+	}
+
+namespace zeek::detail
+	{
+
+// Bump this whenever the layout of cache entries changes.
+constexpr uint32_t ZAM_CACHE_FORMAT = 1;
+
+// Each cache entry starts with this header, followed by the serialized
+// body.  Entries are only ever read on the host that wrote them, so we
+// use native byte order.
+struct ZAMCacheHeader
+	{
+	char magic[4];
+	uint32_t format;
+	uint64_t key;
+	uint64_t len;
+	uint64_t checksum;
+	};
+
+static const char ZAM_CACHE_MAGIC[4] = {'Z', 'A', 'M', 'C'};
+
+// How we represent a type in a cache entry.
+enum ZAMCacheTypeKind
+	{
+	ZCT_NIL, // no type
+	ZCT_BASE, // one of the base_type()'s, given by its tag
+	ZCT_NAMED, // a named global type, given by its name
+	ZCT_HASHED, // any other type, given by its profile hash
+	};
+
+// Strings and locations that loaded bodies refer to.  Like the bodies
+// themselves, these stick around for the lifetime of the process.
+static const char* intern_string(const std::string& s)
+	{
+	static std::unordered_set<std::string> strings;
+	return strings.insert(s).first->c_str();
+	}
+
+static std::deque<Location> loaded_locations;
+
+// True if base_type() yields a well-defined type for the given tag.
+static bool has_base_type(TypeTag tag)
+	{
+	switch ( tag )
+		{
+		case TYPE_VOID:
+		case TYPE_BOOL:
+		case TYPE_INT:
+		case TYPE_COUNT:
+		case TYPE_DOUBLE:
+		case TYPE_TIME:
+		case TYPE_INTERVAL:
+		case TYPE_STRING:
+		case TYPE_PATTERN:
+		case TYPE_PORT:
+		case TYPE_ADDR:
+		case TYPE_SUBNET:
+		case TYPE_ANY:
+			return true;
+
+		default:
+			return false;
+		}
+	}
+
+// Returns the function that the given global name refers to, or nil if
+// there isn't one.
+static Func* global_func(const std::string& name)
+	{
+	const auto& id = global_scope()->Find(name);
+	if ( ! id || id->GetType()->Tag() != TYPE_FUNC || ! id->GetVal() )
+		return nullptr;
+
+	return id->GetVal()->AsFunc();
+	}
+
+// True if the given function can be found again, via its name, in a
+// later run.  This isn't the case for lambdas, for example.
+static bool is_global_func(const Func* f)
+	{
+	return global_func(f->Name()) == f;
+	}
+
+ZAMCache::ZAMCache(std::string _dir, ProfileFuncs& _pfs) : dir(std::move(_dir)), pfs(_pfs)
+	{
+	if ( ! util::detail::ensure_intermediate_dirs(dir.c_str()) )
+		{
+		reporter->Warning("can't use ZAM cache directory %s", dir.c_str());
+		return;
+		}
+
+	valid = true;
+
+	base_key = merge_p_hashes(p_hash("ZAM-cache"), p_hash(ZAM_CACHE_FORMAT));
+	base_key = merge_p_hashes(base_key, p_hash(zeek_version()));
+
+	// Compiled code is only meaningful for the same instruction set.
+	for ( int i = 0; i <= OP_NOP; ++i )
+		{
+		base_key = merge_p_hashes(base_key, p_hash(ZOP_name(ZOp(i))));
+		base_key = merge_p_hashes(base_key, p_hash(op1_flavor[i]));
+		base_key = merge_p_hashes(base_key, p_hash(op_side_effects[i]));
+		}
+
+	// As well as for the same code generation options.
+	base_key = merge_p_hashes(base_key, p_hash(analysis_options.inliner));
+	base_key = merge_p_hashes(base_key, p_hash(analysis_options.optimize_AST));
+	base_key = merge_p_hashes(base_key, p_hash(analysis_options.no_ZAM_opt));
+	}
+
+StmtPtr ZAMCache::Load(const FuncInfo& f)
+	{
+	auto key = BodyKey(f);
+	keys[&f] = key;
+
+	auto fn = EntryName(key);
+	auto file = fopen(fn.c_str(), "r");
+	if ( ! file )
+		return nullptr;
+
+	ZAMCacheHeader hdr;
+	std::string payload;
+
+	bool ok = fread(&hdr, sizeof hdr, 1, file) == 1 &&
+	          memcmp(hdr.magic, ZAM_CACHE_MAGIC, sizeof hdr.magic) == 0 &&
+	          hdr.format == ZAM_CACHE_FORMAT && hdr.key == key && hdr.len <= UINT32_MAX;
+
+	if ( ok )
+		{
+		payload.resize(hdr.len);
+		ok = fread(payload.data(), 1, hdr.len, file) == hdr.len && p_hash(payload) == hdr.checksum;
+		}
+
+	fclose(file);
+
+	if ( ! ok )
+		// Corrupt or from a colliding key.  We'll overwrite it once
+		// we've compiled the body.
+		return nullptr;
+
+	auto zb = make_intrusive<ZBody>(f.Func()->Name());
+
+	fmt.StartRead(payload.data(), payload.size());
+	ok = ReadBody(zb.get());
+	fmt.EndRead();
+
+	if ( ! ok )
+		return nullptr;
+
+	if ( ! analysis_options.no_ZAM_opt )
+		{
+		// Mirror ZAMCompiler::ReMapInterpreterFrame().
+		auto func = f.Func();
+		int nparam = func->GetType()->Params()->NumFields();
+
+		if ( remapped_intrp_frame_sizes.count(func) == 0 ||
+		     remapped_intrp_frame_sizes[func] < nparam )
+			remapped_intrp_frame_sizes[func] = nparam;
+		}
+
+	++num_loaded;
+
+	return zb;
+	}
+
+void ZAMCache::Save(const FuncInfo& f, const ZBody* zb)
+	{
+	auto k = keys.find(&f);
+	if ( ! valid || k == keys.end() )
+		return;
+
+	fmt.StartWrite();
+	bool ok = WriteBody(zb);
+
+	char* data;
+	auto len = fmt.EndWrite(&data);
+
+	if ( ! ok )
+		{
+		free(data);
+		return;
+		}
+
+	ZAMCacheHeader hdr;
+	memcpy(hdr.magic, ZAM_CACHE_MAGIC, sizeof hdr.magic);
+	hdr.format = ZAM_CACHE_FORMAT;
+	hdr.key = k->second;
+	hdr.len = len;
+	hdr.checksum = p_hash(std::string_view(data, len));
+
+	// Other processes may be reading the entry, or writing the very
+	// same one, so write it under a private name and then move it
+	// into place atomically.
+	auto fn = EntryName(k->second);
+	auto tmp_fn = fn + "." + std::to_string(getpid()) + ".tmp";
+
+	auto file = fopen(tmp_fn.c_str(), "w");
+	if ( file )
+		{
+		ok = fwrite(&hdr, sizeof hdr, 1, file) == 1 && fwrite(data, 1, len, file) == len;
+		ok = fclose(file) == 0 && ok;
+		ok = ok && rename(tmp_fn.c_str(), fn.c_str()) == 0;
+		}
+	else
+		ok = false;
+
+	free(data);
+
+	if ( ! ok )
+		{
+		reporter->Warning("can't write ZAM cache entry %s: %s", fn.c_str(), strerror(errno));
+		unlink(tmp_fn.c_str());
+
+		// No point in trying further.
+		valid = false;
+		}
+	else
+		++num_saved;
+	}
+
+p_hash_type ZAMCache::BodyKey(const FuncInfo& f)
+	{
+	auto pf = f.Profile();
+	auto h = merge_p_hashes(base_key, BodyHash(pf));
+
+	// The body can wind up including any of the functions it calls,
+	// directly or indirectly, due to inlining.
+	std::vector<p_hash_type> callee_hashes;
+	std::unordered_set<const ScriptFunc*> seen;
+	std::vector<const ScriptFunc*> to_do(pf->ScriptCalls().begin(), pf->ScriptCalls().end());
+
+	// Globals used by the body or any of those functions.
+	IDSet globals(pf->AllGlobals());
+
+	while ( ! to_do.empty() )
+		{
+		auto c = to_do.back();
+		to_do.pop_back();
+
+		if ( ! seen.insert(c).second )
+			continue;
+
+		auto cpf = pfs.FuncProf(c);
+		if ( ! cpf )
+			{
+			callee_hashes.push_back(p_hash(c->Name()));
+			continue;
+			}
+
+		callee_hashes.push_back(BodyHash(cpf.get()));
+		globals.insert(cpf->AllGlobals().begin(), cpf->AllGlobals().end());
+		to_do.insert(to_do.end(), cpf->ScriptCalls().begin(), cpf->ScriptCalls().end());
+		}
+
+	// The traversal order depends on pointer values, so impose one.
+	std::sort(callee_hashes.begin(), callee_hashes.end());
+
+	h = merge_p_hashes(h, p_hash("callees"));
+	for ( auto ch : callee_hashes )
+		h = merge_p_hashes(h, ch);
+
+	std::vector<const ID*> ordered_globals(globals.begin(), globals.end());
+	std::sort(ordered_globals.begin(), ordered_globals.end(),
+	          [](const ID* a, const ID* b) { return strcmp(a->Name(), b->Name()) < 0; });
+
+	// Reduction folds the values of constant globals into the code,
+	// and code generation differs depending on whether a called
+	// function is a BiF or script function, or not defined at all.
+	// Folding isn't limited to atomic values: NameExpr::FoldVal()
+	// also provides aggregates, such as sets for "|s|" or patterns
+	// for "p1 | p2".  Their descriptions are deterministic.
+	h = merge_p_hashes(h, p_hash("globals"));
+	for ( auto g : ordered_globals )
+		{
+		h = merge_p_hashes(h, p_hash(g->Name()));
+
+		const auto& v = g->GetVal();
+		if ( ! v )
+			h = merge_p_hashes(h, p_hash("<unset>"));
+
+		else if ( g->GetType()->Tag() == TYPE_FUNC )
+			h = merge_p_hashes(h, p_hash(v->AsFunc()->GetKind()));
+
+		else if ( g->IsConst() && ! g->GetAttr(ATTR_REDEF) )
+			h = merge_p_hashes(h, p_hash(v.get()));
+		}
+
+	return h;
+	}
+
+p_hash_type ZAMCache::BodyHash(const ProfileFunc* pf)
+	{
+	// The profile hash abstracts away from the details of how the
+	// body's elements fit together, so we also hash its description.
+	// That in turn lacks locations, which we need to get right for
+	// run-time error messages.
+	auto h = merge_p_hashes(pf->HashVal(), p_hash(pf->ProfiledBody()));
+
+	for ( auto s : pf->Stmts() )
+		{
+		auto loc = s->GetLocationInfo();
+		h = merge_p_hashes(h, p_hash(loc->first_line));
+		h = merge_p_hashes(h, p_hash(loc->last_line));
+		}
+
+	return h;
+	}
+
+std::string ZAMCache::EntryName(p_hash_type key) const
+	{
+	char buf[64];
+	snprintf(buf, sizeof buf, "/%016llx.zam", key);
+	return dir + buf;
+	}
+
+bool ZAMCache::WriteBody(const ZBody* zb)
+	{
+	fmt.Write(int(zb->frame_denizens.size()), "num-denizens");
+
+	for ( const auto& fd : zb->frame_denizens )
+		{
+		fmt.Write(int(fd.names.size()), "num-names");
+
+		for ( auto i = 0U; i < fd.names.size(); ++i )
+			{
+			fmt.Write(fd.names[i], "name");
+			fmt.Write(uint64_t(fd.id_start[i]), "id-start");
+			}
+
+		fmt.Write(fd.scope_end, "scope-end");
+		fmt.Write(fd.is_managed, "is-managed");
+		}
+
+	fmt.Write(int(zb->managed_slots.size()), "num-managed");
+	for ( auto ms : zb->managed_slots )
+		fmt.Write(ms, "managed-slot");
+
+	fmt.Write(int(zb->globals.size()), "num-globals");
+	for ( const auto& g : zb->globals )
+		{
+		fmt.Write(g.id->Name(), "global");
+		fmt.Write(g.slot, "global-slot");
+		}
+
+	if ( ! WriteCases(zb->int_cases) || ! WriteCases(zb->uint_cases) ||
+	     ! WriteCases(zb->double_cases) || ! WriteCases(zb->str_cases) )
+		return false;
+
+	fmt.Write(zb->fixed_frame != nullptr, "non-recursive");
+	fmt.Write(int(zb->table_iters.size()), "num-table-iters");
+	fmt.Write(zb->num_step_iters, "num-step-iters");
+
+	fmt.Write(int(zb->ninst), "num-insts");
+	for ( auto i = 0U; i < zb->ninst; ++i )
+		if ( ! WriteInst(zb->insts[i]) )
+			return false;
+
+	return true;
+	}
+
+bool ZAMCache::ReadBody(ZBody* zb)
+	{
+	int n;
+	if ( ! fmt.Read(&n, "num-denizens") )
+		return false;
+
+	for ( int i = 0; i < n; ++i )
+		{
+		FrameSharingInfo fd;
+
+		int num_names;
+		if ( ! fmt.Read(&num_names, "num-names") )
+			return false;
+
+		for ( int j = 0; j < num_names; ++j )
+			{
+			std::string name;
+			uint64_t start;
+			if ( ! fmt.Read(&name, "name") || ! fmt.Read(&start, "id-start") )
+				return false;
+
+			fd.names.push_back(intern_string(name));
+			fd.id_start.push_back(start);
+			}
+
+		if ( ! fmt.Read(&fd.scope_end, "scope-end") || ! fmt.Read(&fd.is_managed, "is-managed") )
+			return false;
+
+		zb->frame_denizens.emplace_back(std::move(fd));
+		}
+
+	zb->frame_size = zb->frame_denizens.size();
+
+	if ( ! fmt.Read(&n, "num-managed") )
+		return false;
+
+	for ( int i = 0; i < n; ++i )
+		{
+		int ms;
+		if ( ! fmt.Read(&ms, "managed-slot") )
+			return false;
+		zb->managed_slots.push_back(ms);
+		}
+
+	if ( ! fmt.Read(&n, "num-globals") )
+		return false;
+
+	for ( int i = 0; i < n; ++i )
+		{
+		std::string name;
+		GlobalInfo gi;
+
+		if ( ! fmt.Read(&name, "global") || ! fmt.Read(&gi.slot, "global-slot") )
+			return false;
+
+		gi.id = global_scope()->Find(name);
+		if ( ! gi.id )
+			return false;
+
+		zb->globals.emplace_back(std::move(gi));
+		}
+
+	zb->num_globals = zb->globals.size();
+
+	if ( ! ReadCases(zb->int_cases) || ! ReadCases(zb->uint_cases) ||
+	     ! ReadCases(zb->double_cases) || ! ReadCases(zb->str_cases) )
+		return false;
+
+	bool non_recursive;
+	int num_table_iters;
+
+	if ( ! fmt.Read(&non_recursive, "non-recursive") ||
+	     ! fmt.Read(&num_table_iters, "num-table-iters") ||
+	     ! fmt.Read(&zb->num_step_iters, "num-step-iters") )
+		return false;
+
+	zb->table_iters.resize(num_table_iters);
+
+	if ( non_recursive )
+		zb->InitFixedFrame();
+
+	if ( ! fmt.Read(&n, "num-insts") )
+		return false;
+
+	std::vector<ZInst> insts(n);
+	std::vector<ZInst*> inst_ptrs;
+
+	for ( auto& z : insts )
+		{
+		if ( ! ReadInst(z) )
+			return false;
+		inst_ptrs.push_back(&z);
+		}
+
+	zb->SetInsts(inst_ptrs);
+
+	return true;
+	}
+
+bool ZAMCache::WriteInst(const ZInst& z)
+	{
+	if ( z.e || z.attrs )
+		// "when" conditions and constructor attributes would require
+		// persisting expressions.
+		return false;
+
+	fmt.Write(int(z.op), "op");
+	fmt.Write(int(z.op_type), "op-type");
+	fmt.Write(z.v1, "v1");
+	fmt.Write(z.v2, "v2");
+	fmt.Write(z.v3, "v3");
+	fmt.Write(z.v4, "v4");
+	fmt.Write(z.is_managed, "is-managed");
+
+	if ( ! WriteType(z.t) || ! WriteType(z.t2) )
+		return false;
+
+	auto c = z.ConstVal();
+	fmt.Write(c != nullptr, "has-const");
+	if ( c && ! WriteVal(c) )
+		return false;
+
+	if ( z.func && ! is_global_func(z.func) )
+		return false;
+
+	fmt.Write(z.func ? z.func->Name() : "", "func");
+
+	auto eh = z.event_handler;
+	if ( eh && event_registry->Lookup(eh->Name()) != eh )
+		return false;
+
+	fmt.Write(eh ? eh->Name() : "", "event");
+
+	return WriteAux(z.aux) && WriteLoc(z.loc);
+	}
+
+bool ZAMCache::ReadInst(ZInst& z)
+	{
+	int op, op_type;
+	if ( ! fmt.Read(&op, "op") || ! fmt.Read(&op_type, "op-type") )
+		return false;
+
+	if ( op < 0 || op > OP_NOP )
+		return false;
+
+	z.op = ZOp(op);
+	z.op_type = ZAMOpType(op_type);
+
+	if ( ! fmt.Read(&z.v1, "v1") || ! fmt.Read(&z.v2, "v2") || ! fmt.Read(&z.v3, "v3") ||
+	     ! fmt.Read(&z.v4, "v4") || ! fmt.Read(&z.is_managed, "is-managed") )
+		return false;
+
+	if ( ! ReadType(z.t) || ! ReadType(z.t2) )
+		return false;
+
+	bool has_const;
+	if ( ! fmt.Read(&has_const, "has-const") )
+		return false;
+
+	if ( has_const )
+		{
+		ValPtr c;
+		if ( ! ReadVal(c) || ! z.t )
+			return false;
+
+		z.c = ZVal(c, z.t);
+		}
+
+	std::string func, event;
+	if ( ! fmt.Read(&func, "func") || ! fmt.Read(&event, "event") )
+		return false;
+
+	if ( ! func.empty() && ! (z.func = global_func(func)) )
+		return false;
+
+	if ( ! event.empty() && ! (z.event_handler = event_registry->Lookup(event)) )
+		return false;
+
+	return ReadAux(z.aux) && ReadLoc(z.loc);
+	}
+
+bool ZAMCache::WriteAux(const ZInstAux* aux)
+	{
+	fmt.Write(aux != nullptr, "has-aux");
+	if ( ! aux )
+		return true;
+
+	if ( aux->cat_args )
+		// These hold pre-analyzed formatting state for cat().
+		return false;
+
+	fmt.Write(aux->n, "n");
+	fmt.Write(aux->slots != nullptr, "has-slots");
+
+	for ( int i = 0; i < aux->n; ++i )
+		{
+		fmt.Write(aux->ints[i], "int");
+
+		const auto& c = aux->constants[i];
+		fmt.Write(c != nullptr, "has-const");
+		if ( c && ! WriteVal(c) )
+			return false;
+
+		if ( ! WriteType(aux->types[i]) )
+			return false;
+		}
+
+	auto id = aux->id_val;
+	if ( id && (! id->IsGlobal() || global_scope()->Find(id->Name()).get() != id) )
+		return false;
+
+	fmt.Write(id ? id->Name() : "", "id");
+	fmt.Write(aux->can_change_globals, "can-change-globals");
+
+	fmt.Write(int(aux->map.size()), "map-size");
+	for ( auto m : aux->map )
+		fmt.Write(m, "map");
+
+	fmt.Write(int(aux->loop_vars.size()), "num-loop-vars");
+	for ( auto i = 0U; i < aux->loop_vars.size(); ++i )
+		{
+		fmt.Write(aux->loop_vars[i], "loop-var");
+		if ( ! WriteType(aux->loop_var_types[i]) )
+			return false;
+		}
+
+	return WriteType(aux->value_var_type);
+	}
+
+bool ZAMCache::ReadAux(ZInstAux*& aux)
+	{
+	bool has_aux;
+	if ( ! fmt.Read(&has_aux, "has-aux") )
+		return false;
+
+	if ( ! has_aux )
+		return true;
+
+	int n;
+	bool has_slots;
+	if ( ! fmt.Read(&n, "n") || ! fmt.Read(&has_slots, "has-slots") )
+		return false;
+
+	aux = new ZInstAux(n);
+
+	if ( ! has_slots )
+		aux->slots = nullptr;
+
+	for ( int i = 0; i < n; ++i )
+		{
+		bool has_const;
+		if ( ! fmt.Read(&aux->ints[i], "int") || ! fmt.Read(&has_const, "has-const") )
+			return false;
+
+		if ( has_const && ! ReadVal(aux->constants[i]) )
+			return false;
+
+		if ( ! ReadType(aux->types[i]) )
+			return false;
+		}
+
+	std::string id;
+	int num_map, num_loop_vars;
+
+	if ( ! fmt.Read(&id, "id") || ! fmt.Read(&aux->can_change_globals, "can-change-globals") )
+		return false;
+
+	if ( ! id.empty() && ! (aux->id_val = global_scope()->Find(id).get()) )
+		return false;
+
+	if ( ! fmt.Read(&num_map, "map-size") )
+		return false;
+
+	for ( int i = 0; i < num_map; ++i )
+		{
+		int m;
+		if ( ! fmt.Read(&m, "map") )
+			return false;
+		aux->map.push_back(m);
+		}
+
+	if ( ! fmt.Read(&num_loop_vars, "num-loop-vars") )
+		return false;
+
+	for ( int i = 0; i < num_loop_vars; ++i )
+		{
+		int lv;
+		TypePtr lvt;
+		if ( ! fmt.Read(&lv, "loop-var") || ! ReadType(lvt) )
+			return false;
+
+		aux->loop_vars.push_back(lv);
+		aux->loop_var_types.emplace_back(std::move(lvt));
+		}
+
+	return ReadType(aux->value_var_type);
+	}
+
+bool ZAMCache::WriteType(const TypePtr& t)
+	{
+	if ( ! t )
+		{
+		fmt.Write(int(ZCT_NIL), "type-kind");
+		return true;
+		}
+
+	auto tag = t->Tag();
+
+	if ( has_base_type(tag) && t == base_type(tag) )
+		{
+		fmt.Write(int(ZCT_BASE), "type-kind");
+		fmt.Write(int(tag), "type-tag");
+		return true;
+		}
+
+	const auto& name = t->GetName();
+	if ( ! name.empty() )
+		{
+		const auto& id = global_scope()->Find(name);
+		if ( id && id->IsType() && id->GetType() == t )
+			{
+			fmt.Write(int(ZCT_NAMED), "type-kind");
+			fmt.Write(name, "type-name");
+			return true;
+			}
+		}
+
+	fmt.Write(int(ZCT_HASHED), "type-kind");
+	fmt.Write(uint64_t(pfs.HashType(t)), "type-hash");
+
+	return true;
+	}
+
+bool ZAMCache::ReadType(TypePtr& t)
+	{
+	int kind;
+	if ( ! fmt.Read(&kind, "type-kind") )
+		return false;
+
+	switch ( kind )
+		{
+		case ZCT_NIL:
+			t = nullptr;
+			return true;
+
+		case ZCT_BASE:
+			{
+			int tag;
+			if ( ! fmt.Read(&tag, "type-tag") || tag < 0 || tag >= NUM_TYPES ||
+			     ! has_base_type(TypeTag(tag)) )
+				return false;
+
+			t = base_type(TypeTag(tag));
+			return true;
+			}
+
+		case ZCT_NAMED:
+			{
+			std::string name;
+			if ( ! fmt.Read(&name, "type-name") )
+				return false;
+
+			const auto& id = global_scope()->Find(name);
+			if ( ! id || ! id->IsType() )
+				return false;
+
+			t = id->GetType();
+			return true;
+			}
+
+		case ZCT_HASHED:
+			{
+			uint64_t h;
+			if ( ! fmt.Read(&h, "type-hash") )
+				return false;
+
+			// This only finds types that the scripts use
+			// directly, which in practice covers the ones
+			// that instructions refer to.
+			auto rep = pfs.TypeForHash(h);
+			if ( ! rep )
+				return false;
+
+			t = {NewRef{}, const_cast<Type*>(rep)};
+			return true;
+			}
+
+		default:
+			return false;
+		}
+	}
+
+bool ZAMCache::WriteVal(const ValPtr& v)
+	{
+	const auto& t = v->GetType();
+
+	if ( ! WriteType(t) )
+		return false;
+
+	switch ( t->Tag() )
+		{
+		case TYPE_BOOL:
+		case TYPE_INT:
+		case TYPE_ENUM:
+			fmt.Write(int64_t(v->AsInt()), "int-val");
+			break;
+
+		case TYPE_COUNT:
+			fmt.Write(uint64_t(v->AsCount()), "count-val");
+			break;
+
+		case TYPE_PORT:
+			{
+			auto pv = v->AsPortVal();
+			fmt.Write(pv->Port(), "port-val");
+			fmt.Write(int(pv->PortType()), "port-proto");
+			}
+			break;
+
+		case TYPE_DOUBLE:
+		case TYPE_TIME:
+		case TYPE_INTERVAL:
+			fmt.Write(v->AsDouble(), "double-val");
+			break;
+
+		case TYPE_STRING:
+			{
+			auto s = v->AsString();
+			fmt.Write(reinterpret_cast<const char*>(s->Bytes()), s->Len(), "string-val");
+			}
+			break;
+
+		case TYPE_ADDR:
+			fmt.Write(v->AsAddr(), "addr-val");
+			break;
+
+		case TYPE_SUBNET:
+			fmt.Write(v->AsSubNet(), "subnet-val");
+			break;
+
+		case TYPE_PATTERN:
+			{
+			auto re = v->AsPattern();
+			fmt.Write(re->OrigText(), "pattern-val");
+			fmt.Write(re->IsCaseInsensitive(), "pattern-case-insensitive");
+			fmt.Write(re->IsSingleLine(), "pattern-single-line");
+			}
+			break;
+
+		case TYPE_FUNC:
+			{
+			auto f = v->AsFunc();
+			if ( ! is_global_func(f) )
+				return false;
+
+			fmt.Write(f->Name(), "func-val");
+			}
+			break;
+
+		default:
+			// Aggregates, files, opaque values and the like.
+			return false;
+		}
+
+	return true;
+	}
+
+bool ZAMCache::ReadVal(ValPtr& v)
+	{
+	TypePtr t;
+	if ( ! ReadType(t) || ! t )
+		return false;
+
+	switch ( t->Tag() )
+		{
+		case TYPE_BOOL:
+		case TYPE_INT:
+		case TYPE_ENUM:
+			{
+			int64_t i;
+			if ( ! fmt.Read(&i, "int-val") )
+				return false;
+
+			if ( t->Tag() == TYPE_BOOL )
+				v = val_mgr->Bool(i);
+			else if ( t->Tag() == TYPE_INT )
+				v = val_mgr->Int(i);
+			else
+				v = t->AsEnumType()->GetEnumVal(i);
+			}
+			break;
+
+		case TYPE_COUNT:
+			{
+			uint64_t u;
+			if ( ! fmt.Read(&u, "count-val") )
+				return false;
+
+			v = val_mgr->Count(u);
+			}
+			break;
+
+		case TYPE_PORT:
+			{
+			uint32_t port;
+			int proto;
+			if ( ! fmt.Read(&port, "port-val") || ! fmt.Read(&proto, "port-proto") )
+				return false;
+
+			v = val_mgr->Port(port, TransportProto(proto));
+			}
+			break;
+
+		case TYPE_DOUBLE:
+		case TYPE_TIME:
+		case TYPE_INTERVAL:
+			{
+			double d;
+			if ( ! fmt.Read(&d, "double-val") )
+				return false;
+
+			if ( t->Tag() == TYPE_DOUBLE )
+				v = make_intrusive<DoubleVal>(d);
+			else if ( t->Tag() == TYPE_TIME )
+				v = make_intrusive<TimeVal>(d);
+			else
+				v = make_intrusive<IntervalVal>(d);
+			}
+			break;
+
+		case TYPE_STRING:
+			{
+			std::string s;
+			if ( ! fmt.Read(&s, "string-val") )
+				return false;
+
+			v = make_intrusive<StringVal>(s.size(), s.data());
+			}
+			break;
+
+		case TYPE_ADDR:
+			{
+			IPAddr a;
+			if ( ! fmt.Read(&a, "addr-val") )
+				return false;
+
+			v = make_intrusive<AddrVal>(a);
+			}
+			break;
+
+		case TYPE_SUBNET:
+			{
+			IPPrefix p;
+			if ( ! fmt.Read(&p, "subnet-val") )
+				return false;
+
+			v = make_intrusive<SubNetVal>(p);
+			}
+			break;
+
+		case TYPE_PATTERN:
+			{
+			std::string text;
+			bool case_insensitive, single_line;
+			if ( ! fmt.Read(&text, "pattern-val") ||
+			     ! fmt.Read(&case_insensitive, "pattern-case-insensitive") ||
+			     ! fmt.Read(&single_line, "pattern-single-line") )
+				return false;
+
+			auto re = new RE_Matcher(text.c_str());
+			if ( case_insensitive )
+				re->MakeCaseInsensitive();
+			if ( single_line )
+				re->MakeSingleLine();
+
+			re->Compile();
+
+			v = make_intrusive<PatternVal>(re);
+			}
+			break;
+
+		case TYPE_FUNC:
+			{
+			std::string name;
+			if ( ! fmt.Read(&name, "func-val") )
+				return false;
+
+			auto f = global_func(name);
+			if ( ! f )
+				return false;
+
+			v = make_intrusive<FuncVal>(FuncPtr{NewRef{}, f});
+			}
+			break;
+
+		default:
+			return false;
+		}
+
+	return v != nullptr;
+	}
+
+bool ZAMCache::WriteLoc(const Location* loc)
+	{
+	fmt.Write(loc != nullptr, "has-loc");
+	if ( ! loc )
+		return true;
+
+	fmt.Write(loc->filename ? loc->filename : "", "filename");
+	fmt.Write(loc->first_line, "first-line");
+	fmt.Write(loc->last_line, "last-line");
+	fmt.Write(loc->first_column, "first-column");
+	fmt.Write(loc->last_column, "last-column");
+
+	return true;
+	}
+
+bool ZAMCache::ReadLoc(const Location*& loc)
+	{
+	bool has_loc;
+	if ( ! fmt.Read(&has_loc, "has-loc") )
+		return false;
+
+	if ( ! has_loc )
+		return true;
+
+	std::string filename;
+	int first_line, last_line, first_column, last_column;
+
+	if ( ! fmt.Read(&filename, "filename") || ! fmt.Read(&first_line, "first-line") ||
+	     ! fmt.Read(&last_line, "last-line") || ! fmt.Read(&first_column, "first-column") ||
+	     ! fmt.Read(&last_column, "last-column") )
+		return false;
+
+	loc = &loaded_locations.emplace_back(intern_string(filename), first_line, last_line,
+	                                     first_column, last_column);
+	return true;
+	}
+
+template <typename T> bool ZAMCache::WriteCases(const CaseMaps<T>& cases)
+	{
+	fmt.Write(int(cases.size()), "num-case-maps");
+
+	for ( const auto& cm : cases )
+		{
+		fmt.Write(int(cm.size()), "num-cases");
+
+		for ( const auto& [val, inst] : cm )
+			{
+			fmt.Write(val, "case-val");
+			fmt.Write(inst, "case-inst");
+			}
+		}
+
+	return true;
+	}
+
+template <typename T> bool ZAMCache::ReadCases(CaseMaps<T>& cases)
+	{
+	int n;
+	if ( ! fmt.Read(&n, "num-case-maps") )
+		return false;
+
+	for ( int i = 0; i < n; ++i )
+		{
+		int num_cases;
+		if ( ! fmt.Read(&num_cases, "num-cases") )
+			return false;
+
+		CaseMap<T> cm;
+
+		for ( int j = 0; j < num_cases; ++j )
+			{
+			T val;
+			int inst;
+			if ( ! fmt.Read(&val, "case-val") || ! fmt.Read(&inst, "case-inst") )
+				return false;
+
+			cm[val] = inst;
+			}
+
+		cases.emplace_back(std::move(cm));
+		}
+
+	return true;
+	}
+
+	} // namespace zeek::detail
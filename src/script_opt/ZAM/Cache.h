@@ -0,0 +1,115 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// A persistent, on-disk cache of compiled ZAM function bodies.
+//
+// Compiling a large set of scripts to ZAM takes a while, mostly for
+// inlining, reduction and instruction generation, and every restart
+// of a Zeek process repeats that work for identical code.  The cache
+// lets later runs load the final instructions of unchanged bodies
+// directly instead.
+//
+// Entries are keyed on a hash covering the body itself (via its profile
+// and its full description, including statement locations), the bodies
+// of the script functions it might inline, the values of the global
+// constants that reduction can fold into it, the ZAM-related options in
+// effect, and the Zeek version and ZAM instruction set.  Each entry lives
+// in its own file, named after its key, and is written to a temporary
+// file that's then atomically renamed.  Any number of Zeek processes on
+// the same host can thus share a cache directory.
+//
+// Not all bodies can be cached: those whose instructions refer to
+// elements we can't identify across runs, such as lambdas, "when"
+// conditions, or attributes attached to table constructors, are always
+// compiled afresh.
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+#include "zeek/SerializationFormat.h"
+#include "zeek/script_opt/ProfileFunc.h"
+#include "zeek/script_opt/ZAM/ZBody.h"
+
+namespace zeek::detail
+	{
+
+class ZAMCache
+	{
+public:
+	// "dir" is the directory holding the cache entries, which is
+	// created if needed.  "pfs" is the profile of all of the functions,
+	// used for identifying types.
+	ZAMCache(std::string dir, ProfileFuncs& pfs);
+
+	// True if the cache directory is usable.
+	bool IsValid() const { return valid; }
+
+	// The number of bodies loaded from and saved to the cache so far.
+	int NumLoaded() const { return num_loaded; }
+	int NumSaved() const { return num_saved; }
+
+	// Returns the cached compiled body for the given function body,
+	// or nil if there isn't a usable one.  Must be called prior to
+	// inlining, since the key covers the original body.
+	StmtPtr Load(const FuncInfo& f);
+
+	// Stores the compiled body for the given function body, which
+	// previously must have been passed to Load().  Does nothing if the
+	// body can't be cached.
+	void Save(const FuncInfo& f, const ZBody* zb);
+
+private:
+	// Computes the cache key for the given function body.
+	p_hash_type BodyKey(const FuncInfo& f);
+
+	// Hash over a single function body, finer-grained than its
+	// profile hash.
+	p_hash_type BodyHash(const ProfileFunc* pf);
+
+	// Returns the name of the file holding the entry for the given key.
+	std::string EntryName(p_hash_type key) const;
+
+	// The following return false if the given element can't be
+	// cached (when writing) or can't be resolved in this run (when
+	// reading).
+	bool WriteBody(const ZBody* zb);
+	bool ReadBody(ZBody* zb);
+
+	bool WriteInst(const ZInst& z);
+	bool ReadInst(ZInst& z);
+
+	bool WriteAux(const ZInstAux* aux);
+	bool ReadAux(ZInstAux*& aux);
+
+	bool WriteType(const TypePtr& t);
+	bool ReadType(TypePtr& t);
+
+	// Values include their type.
+	bool WriteVal(const ValPtr& v);
+	bool ReadVal(ValPtr& v);
+
+	bool WriteLoc(const Location* loc);
+	bool ReadLoc(const Location*& loc);
+
+	template <typename T> bool WriteCases(const CaseMaps<T>& cases);
+	template <typename T> bool ReadCases(CaseMaps<T>& cases);
+
+	std::string dir;
+	ProfileFuncs& pfs;
+	bool valid = false;
+
+	int num_loaded = 0;
+	int num_saved = 0;
+
+	// The part of every key that's independent of the particular
+	// function body.
+	p_hash_type base_key;
+
+	// Keys computed by Load(), for use by Save().
+	std::unordered_map<const FuncInfo*, p_hash_type> keys;
+
+	BinarySerializationFormat fmt;
+	};
+
+	} // namespace zeek::detail
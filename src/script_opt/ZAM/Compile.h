@@ -63,6 +63,15 @@ public:
 
 	StmtPtr CompileBody();
 
+	// CompileBody() split into its phases, so that the low-level
+	// optimization, which only touches the compiler's own state, can
+	// run on a worker thread.  The other two phases have to run on
+	// the main thread.  CompileInsts() returns false if compilation
+	// failed, in which case the other phases must not be run.
+	bool CompileInsts();
+	void OptimizeInsts();
+	StmtPtr FinishBody();
+
 	const FrameReMap& FrameDenizens() const { return shared_frame_denizens_final; }
 
 	const std::vector<int>& ManagedSlots() const { return managed_slotsI; }
@@ -386,8 +395,9 @@ private:
 	// different from the methods above that relate to the initial
 	// compilation.
 
-	// Optimizing the low-level compiled instructions.
-	void OptimizeInsts();
+	// Reports an error found during low-level optimization.  As that
+	// can run on a worker thread, the error is held until FinishBody().
+	void OptError(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
 
 	// Tracks which instructions can be branched to via the given
 	// set of switches.
@@ -403,6 +413,11 @@ private:
 	// pruned.
 	bool PruneUnused();
 
+	// Fuse adjacent instructions into superinstructions where the first
+	// computes a temporary used only by the second.  True if any were
+	// fused.
+	bool FuseInsts();
+
 	// For the current state of insts1, compute lifetimes of frame
 	// denizens (variable(s) using a given frame slot) in terms of
 	// first-instruction-to-last-instruction during which they're
@@ -454,6 +469,9 @@ private:
 	// True if any statement other than a frame sync uses the given slot.
 	bool VarIsUsed(int slot) const;
 
+	// True if the given statement is the only one that uses the slot.
+	bool VarIsUsedOnlyBy(int slot, const ZInstI* i) const;
+
 	// Find the first non-dead instruction after i (inclusive).
 	// If follow_gotos is true, then if that instruction is
 	// an unconditional branch, continues the process until
@@ -495,6 +513,9 @@ private:
 	std::vector<ZInstI*> insts1;
 	std::vector<ZInstI*> insts2;
 
+	// Errors held by OptError().
+	std::vector<std::string> opt_errors;
+
 	// Used as a placeholder when we have to generate a GoTo target
 	// beyond the end of what we've compiled so far.
 	ZInstI* pending_inst = nullptr;
@@ -601,6 +622,9 @@ private:
 	int pending_global_store = -1;
 	};
 
+// Tracks per function its maximum remapped interpreter frame size.
+extern std::unordered_map<const Func*, int> remapped_intrp_frame_sizes;
+
 // Invokes after compiling all of the function bodies.
 class FuncInfo;
 extern void finalize_functions(const std::vector<FuncInfo>& funcs);
@@ -121,6 +121,17 @@ void ZAMCompiler::TrackMemoryManagement()
 	}
 
 StmtPtr ZAMCompiler::CompileBody()
+	{
+	if ( ! CompileInsts() )
+		return nullptr;
+
+	if ( ! analysis_options.no_ZAM_opt )
+		OptimizeInsts();
+
+	return FinishBody();
+	}
+
+bool ZAMCompiler::CompileInsts()
 	{
 	curr_stmt = nullptr;
 
@@ -130,7 +141,7 @@ StmtPtr ZAMCompiler::CompileBody()
 	(void)CompileStmt(body);
 
 	if ( reporter->Errors() > 0 )
-		return nullptr;
+		return false;
 
 	ResolveHookBreaks();
 
@@ -155,8 +166,20 @@ StmtPtr ZAMCompiler::CompileBody()
 
 	ComputeLoopLevels();
 
+	return true;
+	}
+
+StmtPtr ZAMCompiler::FinishBody()
+	{
+	for ( auto& e : opt_errors )
+		reporter->Error("%s", e.c_str());
+
+	opt_errors.clear();
+
 	if ( ! analysis_options.no_ZAM_opt )
-		OptimizeInsts();
+		// This updates state shared across functions, so isn't
+		// part of OptimizeInsts().
+		ReMapInterpreterFrame();
 
 	AdjustBranches();
 
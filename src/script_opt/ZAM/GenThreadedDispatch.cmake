@@ -0,0 +1,24 @@
+# Post-processes the ZAM-EvalDefs.h produced by gen-zam for threaded
+# dispatch in ZBody::DoExec().  Invoked in script mode:
+#
+#   cmake -DEVAL_DEFS=<in> -DLABELED_DEFS=<out> -DHANDLERS=<out> -P <this file>
+#
+# LABELED_DEFS is EVAL_DEFS with a ZAM_OP_LABEL(OP_X) marker placed after
+# each "case OP_X:", so every operation gets a jump target.  HANDLERS lists
+# one ZAM_OP_HANDLER(OP_X) per operation, for filling in the table that
+# maps opcodes to those targets.  Both macros are defined in ZBody.cc.
+
+file(READ ${EVAL_DEFS} defs)
+
+string(REGEX MATCHALL "case OP_[A-Za-z0-9_]+:" cases "${defs}")
+string(REGEX REPLACE "case (OP_[A-Za-z0-9_]+):" "case \\1: ZAM_OP_LABEL(\\1)" defs "${defs}")
+
+set(handlers "// Generated from ZAM-EvalDefs.h, do not edit.\n")
+
+foreach ( c ${cases} )
+    string(REGEX REPLACE "case (OP_[A-Za-z0-9_]+):" "\\1" op "${c}")
+    string(APPEND handlers "ZAM_OP_HANDLER(${op})\n")
+endforeach ()
+
+file(WRITE ${LABELED_DEFS} "${defs}")
+file(WRITE ${HANDLERS} "${handlers}")
@@ -5,7 +5,10 @@
 #include "zeek/script_opt/ZAM/Support.h"
 
 #include "zeek/Desc.h"
+#include "zeek/Hash.h"
+#include "zeek/IPAddr.h"
 #include "zeek/Reporter.h"
+#include "zeek/Val.h"
 #include "zeek/ZeekString.h"
 #include "zeek/script_opt/ProfileFunc.h"
 
@@ -86,6 +89,37 @@ StringValPtr ZAM_val_cat(const ValPtr& v)
 	return make_intrusive<StringVal>(s);
 	}
 
+const ValPtr& ZAM_find_index(TableVal* tv, const ZVal& index, const TypePtr& t)
+	{
+	// The keys built here need to match those CompositeHash generates
+	// for tables with a single index.  Tables indexed by subnets don't
+	// use hash keys for lookups, since they match on prefixes.
+	if ( ! tv->Subnets() )
+		switch ( t->InternalType() )
+			{
+			case TYPE_INTERNAL_INT:
+				return tv->Find(HashKey(index.AsInt()));
+
+			case TYPE_INTERNAL_UNSIGNED:
+				return tv->Find(HashKey(index.AsCount()));
+
+			case TYPE_INTERNAL_DOUBLE:
+				return tv->Find(HashKey(index.AsDouble()));
+
+			case TYPE_INTERNAL_ADDR:
+				{
+				uint32_t addr[4];
+				index.AsAddr()->AsAddr().CopyIPv6(addr);
+				return tv->Find(HashKey(addr, 4));
+				}
+
+			default:
+				break;
+			}
+
+	return tv->Find(index.ToVal(t));
+	}
+
 void ZAM_run_time_error(const char* msg)
 	{
 	fprintf(stderr, "%s\n", msg);
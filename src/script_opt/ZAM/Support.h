@@ -6,6 +6,7 @@
 
 #include "zeek/Expr.h"
 #include "zeek/Stmt.h"
+#include "zeek/ZVal.h"
 
 namespace zeek::detail
 	{
@@ -56,4 +57,9 @@ extern StringVal* ZAM_sub_bytes(const StringVal* s, zeek_uint_t start, zeek_int_
 
 extern StringValPtr ZAM_val_cat(const ValPtr& v);
 
+// Looks up a single index, of type "t", in the given table, returning the
+// associated value or nil if not present.  Indices of atomic types are
+// hashed directly from their ZVal, sparing the creation of a Val.
+extern const ValPtr& ZAM_find_index(TableVal* tv, const ZVal& index, const TypePtr& t);
+
 	} // namespace zeek::detail
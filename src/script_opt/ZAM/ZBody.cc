@@ -1,5 +1,7 @@
 // See the file "COPYING" in the main distribution directory for copyright.
 
+#include <algorithm>
+
 #include "zeek/Desc.h"
 #include "zeek/EventHandler.h"
 #include "zeek/Frame.h"
@@ -35,11 +37,27 @@ static bool did_init = false;
 int ZOP_count[OP_NOP + 1];
 double ZOP_CPU[OP_NOP + 1];
 
+// Count of how often each pair of ZOPs executed back-to-back, with the
+// second falling through from the first.  These are the candidates for
+// fusing into superinstructions.
+static std::map<std::pair<ZOp, ZOp>, int> ZOP_pair_count;
+
 void report_ZOP_profile()
 	{
 	for ( int i = 1; i <= OP_NOP; ++i )
 		if ( ZOP_count[i] > 0 )
 			printf("%s\t%d\t%.06f\n", ZOP_name(ZOp(i)), ZOP_count[i], ZOP_CPU[i]);
+
+	vector<std::pair<int, std::pair<ZOp, ZOp>>> pairs;
+	for ( auto& zp : ZOP_pair_count )
+		pairs.emplace_back(zp.second, zp.first);
+
+	// Most frequent first.
+	std::sort(pairs.begin(), pairs.end(),
+	          [](const auto& a, const auto& b) { return a.first > b.first; });
+
+	for ( auto& p : pairs )
+		printf("%s,%s\t%d\n", ZOP_name(p.second.first), ZOP_name(p.second.second), p.first);
 	}
 
 // Sets the given element to a copy of an existing (not newly constructed)
@@ -147,17 +165,23 @@ ZBody::ZBody(const char* _func_name, const ZAMCompiler* zc) : Stmt(STMT_ZAM)
 	str_cases = zc->GetCases<std::string>();
 
 	if ( zc->NonRecursive() )
-		{
-		fixed_frame = new ZVal[frame_size];
-
-		for ( auto& ms : managed_slots )
-			fixed_frame[ms].ClearManagedVal();
-		}
+		InitFixedFrame();
 
 	table_iters = zc->GetTableIters();
 	num_step_iters = zc->NumStepIters();
 
-	// It's a little weird doing this in the constructor, but unless
+	InitZAM();
+	}
+
+ZBody::ZBody(const char* _func_name) : Stmt(STMT_ZAM)
+	{
+	func_name = _func_name;
+	InitZAM();
+	}
+
+void ZBody::InitZAM()
+	{
+	// It's a little weird doing this as part of construction, but unless
 	// we add a general "initialize for ZAM" function, this is as good
 	// a place as any.
 	if ( ! did_init )
@@ -174,6 +198,14 @@ ZBody::ZBody(const char* _func_name, const ZAMCompiler* zc) : Stmt(STMT_ZAM)
 		}
 	}
 
+void ZBody::InitFixedFrame()
+	{
+	fixed_frame = new ZVal[frame_size];
+
+	for ( auto& ms : managed_slots )
+		fixed_frame[ms].ClearManagedVal();
+	}
+
 ZBody::~ZBody()
 	{
 	delete[] fixed_frame;
@@ -259,6 +291,7 @@ ValPtr ZBody::DoExec(Frame* f, int start_pc, StmtFlowType& flow)
 
 #ifdef DEBUG
 	bool do_profile = analysis_options.profile_ZAM;
+	int prev_pc = -1; // most recently executed instruction
 #endif
 
 	ZVal* frame;
@@ -284,6 +317,36 @@ ValPtr ZBody::DoExec(Frame* f, int start_pc, StmtFlowType& flow)
 
 	flow = FLOW_RETURN; // can be over-written by a Hook-Break
 
+#ifdef ZAM_THREADED_DISPATCH
+#define ZAM_OP_LABEL(op) zam_op_##op:
+#define ZAM_OP_HANDLER(op) op_handlers[op] = &&zam_op_##op;
+
+	// Maps opcodes to the labels marking their code.  Opcodes without
+	// an evaluation case map to the "bad opcode" error.
+	static const void* op_handlers[OP_NOP + 1];
+
+	if ( ! op_handlers[OP_NOP] )
+		{
+		for ( auto& h : op_handlers )
+			h = &&zam_op_bad;
+
+#include "ZAM-EvalHandlers.h"
+
+		op_handlers[OP_NOP] = &&zam_op_OP_NOP;
+		}
+
+	if ( inst_handlers.empty() && ninst > 0 )
+		{
+		inst_handlers.resize(ninst);
+		for ( auto i = 0U; i < ninst; ++i )
+			inst_handlers[i] = op_handlers[insts[i].op];
+		}
+
+	auto handlers = inst_handlers.data();
+#else
+#define ZAM_OP_LABEL(op)
+#endif
+
 	while ( pc < end_pc && ! ZAM_error )
 		{
 		auto& z = insts[pc];
@@ -297,23 +360,40 @@ ValPtr ZBody::DoExec(Frame* f, int start_pc, StmtFlowType& flow)
 			++ZOP_count[z.op];
 			++(*inst_count)[pc];
 
+			if ( pc > 0 && prev_pc == pc - 1 )
+				++ZOP_pair_count[{insts[prev_pc].op, z.op}];
+
+			prev_pc = pc;
+
 			profile_pc = pc;
 			profile_CPU = util::curr_CPU_time();
 			}
 #endif
 
+#ifdef ZAM_THREADED_DISPATCH
+		// Jumps straight to the instruction's case below, using the
+		// target resolved for it in advance rather than the switch's
+		// range check and table lookup on the opcode.  The cases
+		// themselves are unchanged: "break" still leads to the common
+		// tail and "continue" back here, so all instructions share this
+		// one indirect jump.
+		goto *handlers[pc];
+#endif
+
 		switch ( z.op )
 			{
 			case OP_NOP:
+				ZAM_OP_LABEL(OP_NOP)
 				break;
 
 				// These must stay in this order or the build fails.
 				// clang-format off
 #include "ZAM-EvalMacros.h"
-#include "ZAM-EvalDefs.h"
+#include "ZAM-EvalLabeledDefs.h"
 				// clang-format on
 
 			default:
+				ZAM_OP_LABEL(bad)
 				reporter->InternalError("bad ZAM opcode");
 			}
 
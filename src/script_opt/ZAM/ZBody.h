@@ -7,6 +7,15 @@
 #include "zeek/script_opt/ZAM/IterInfo.h"
 #include "zeek/script_opt/ZAM/Support.h"
 
+// Defining ZEEK_ZAM_THREADED_DISPATCH, with a compiler that supports
+// taking the address of a label (GCC and Clang), has the interpreter jump
+// to each instruction's case through a target resolved in advance rather
+// than through the switch.  All instructions still share that one jump,
+// which hasn't proven faster than the switch, so it's off by default.
+#if defined(__GNUC__) && defined(ZEEK_ZAM_THREADED_DISPATCH)
+#define ZAM_THREADED_DISPATCH
+#endif
+
 namespace zeek::detail
 	{
 
@@ -31,28 +40,34 @@ class ZBody : public Stmt
 public:
 	ZBody(const char* _func_name, const ZAMCompiler* zc);
 
+	// Used when loading a body from the ZAM cache, which then fills
+	// in the remaining state.
+	ZBody(const char* _func_name);
+
 	~ZBody() override;
 
 	// These are split out from the constructor to allow construction
-	// of a ZBody from either save-file full instructions (first method,
-	// not currently supported) or intermediary instructions (second method).
+	// of a ZBody from either full instructions loaded from the ZAM
+	// cache (first method) or intermediary instructions (second method).
 	void SetInsts(std::vector<ZInst*>& insts);
 	void SetInsts(std::vector<ZInstI*>& instsI);
 
 	ValPtr Exec(Frame* f, StmtFlowType& flow) override;
 
-	// Older code exists for save files, but let's see if we can
-	// avoid having to support them, as they're a fairly elaborate
-	// production.
-	//
-	// void SaveTo(FILE* f, int interp_frame_size) const;
-
 	void Dump() const;
 
 	void ProfileExecution() const;
 
 protected:
 	friend class ZAMResumption;
+	friend class ZAMCache;
+
+	// Sets up state shared by all bodies, the first time a body is
+	// constructed.
+	void InitZAM();
+
+	// Pre-allocates the frame used by non-recursive functions.
+	void InitFixedFrame();
 
 	// Initializes profiling information, if needed.
 	void InitProfile();
@@ -75,6 +90,13 @@ private:
 	const ZInst* insts = nullptr;
 	unsigned int ninst;
 
+#ifdef ZAM_THREADED_DISPATCH
+	// For each instruction, the address of the code that executes it.
+	// Label addresses only exist within DoExec(), so this gets filled
+	// in there, the first time the body runs.
+	std::vector<const void*> inst_handlers;
+#endif
+
 	FrameReMap frame_denizens;
 	int frame_size;
 
@@ -296,6 +296,15 @@ string ZInst::ConstDump() const
 	return d.Description();
 	}
 
+bool ZInst::CheckSameTypeAsT(const TypePtr& vt) const
+	{
+	if ( ! same_type(vt, t) )
+		return false;
+
+	checked_type = vt;
+	return true;
+	}
+
 void ZInstI::Dump(const FrameMap* frame_ids, const FrameReMap* remappings) const
 	{
 	int n = NumFrameSlots();
@@ -403,6 +412,30 @@ bool ZInstI::IsDirectAssignment() const
 		}
 	}
 
+bool ZInstI::IsFieldLoad() const
+	{
+	switch ( op )
+		{
+		case OP_FIELD_VVi_N:
+		case OP_FIELD_VVi_A:
+		case OP_FIELD_VVi_O:
+		case OP_FIELD_VVi_P:
+		case OP_FIELD_VVi_R:
+		case OP_FIELD_VVi_S:
+		case OP_FIELD_VVi_F:
+		case OP_FIELD_VVi_T:
+		case OP_FIELD_VVi_V:
+		case OP_FIELD_VVi_L:
+		case OP_FIELD_VVi_f:
+		case OP_FIELD_VVi_t:
+		case OP_FIELD_VVi:
+			return true;
+
+		default:
+			return false;
+		}
+	}
+
 bool ZInstI::HasSideEffects() const
 	{
 	return op_side_effects[op];
@@ -630,19 +663,23 @@ bool ZInstI::IsGlobalLoad() const
 		// These don't have flavors.
 		return true;
 
-	static std::unordered_set<ZOp> global_ops;
+	// Initialized on first use, in a way that's safe for the
+	// low-level optimizer running on multiple threads.
+	static const auto global_ops = []()
+	{
+		std::unordered_set<ZOp> ops;
 
-	if ( global_ops.empty() )
-		{ // Initialize the set.
 		for ( int t = 0; t < NUM_TYPES; ++t )
 			{
 			TypeTag tag = TypeTag(t);
 			ZOp global_op_flavor = AssignmentFlavor(OP_LOAD_GLOBAL_VV, tag, false);
 
 			if ( global_op_flavor != OP_NOP )
-				global_ops.insert(global_op_flavor);
+				ops.insert(global_op_flavor);
 			}
-		}
+
+		return ops;
+	}();
 
 	return global_ops.count(op) > 0;
 	}
@@ -95,6 +95,14 @@ public:
 	// Returns a string describing the constant.
 	std::string ConstDump() const;
 
+	// True if a value of type "vt" has the same type as the instruction's
+	// "t".  Successful checks are remembered in an inline cache, making
+	// repeated checks against the same type a pointer comparison.
+	bool SameTypeAsT(const TypePtr& vt) const
+		{
+		return vt == checked_type || CheckSameTypeAsT(vt);
+		}
+
 	ZOp op = OP_NOP;
 	ZAMOpType op_type = OP_X;
 
@@ -130,6 +138,15 @@ public:
 	// Whether v1 represents a frame slot type for which we
 	// explicitly manage the memory.
 	bool is_managed = false;
+
+protected:
+	// Slow path for SameTypeAsT().
+	bool CheckSameTypeAsT(const TypePtr& vt) const;
+
+	// Inline cache for SameTypeAsT(): the most recent type found to be
+	// the same as "t".  We hold a reference so the type can't be freed
+	// and its address reused for a different one.
+	mutable TypePtr checked_type;
 	};
 
 // A intermediary ZAM instruction, one that includes information/methods
@@ -216,6 +233,9 @@ public:
 	// True if this instruction is of the form "v1 = v2".
 	bool IsDirectAssignment() const;
 
+	// True if this instruction is of the form "v1 = v2$field".
+	bool IsFieldLoad() const;
+
 	// True if this instruction has side effects when executed, so
 	// should not be pruned even if it has a dead assignment.
 	bool HasSideEffects() const;
@@ -90,16 +90,16 @@ std::unordered_map<ZOp, ZAMOpType> assignmentless_op_type;
 
 ZOp AssignmentFlavor(ZOp orig, TypeTag tag, bool strict)
 	{
-	static bool did_init = false;
-
-	if ( ! did_init )
-		{
+	// Initialized on first use, in a way that's safe for the
+	// low-level optimizer running on multiple threads.
+	[[maybe_unused]] static const bool did_init = []()
+	{
 		std::unordered_map<TypeTag, ZOp> empty_map;
 
 #include "zeek/ZAM-AssignFlavorsDefs.h"
 
-		did_init = true;
-		}
+		return true;
+	}();
 
 	// Map type tag to equivalent, as needed.
 	switch ( tag )
@@ -130,7 +130,7 @@ ZOp AssignmentFlavor(ZOp orig, TypeTag tag, bool strict)
 			return OP_NOP;
 		}
 
-	auto orig_map = assignment_flavor[orig];
+	const auto& orig_map = assignment_flavor.at(orig);
 
 	if ( orig_map.count(tag) == 0 )
 		{
@@ -140,7 +140,7 @@ ZOp AssignmentFlavor(ZOp orig, TypeTag tag, bool strict)
 			return OP_NOP;
 		}
 
-	return orig_map[tag];
+	return orig_map.at(tag);
 	}
 
 	} // zeek::detail
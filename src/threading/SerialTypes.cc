@@ -519,9 +519,8 @@ Val* Value::ValueToVal(const std::string& source, const Value* val, bool& have_e
 
 		case TYPE_PATTERN:
 			{
-			auto* re = new RE_Matcher(val->val.pattern_text_val);
-			re->Compile();
-			return new PatternVal(re);
+			auto re = zeek::detail::cached_RE_Matcher(val->val.pattern_text_val);
+			return new PatternVal(std::move(re));
 			}
 
 		case TYPE_TABLE:
@@ -39,8 +39,10 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <iostream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "zeek/3rdparty/ConvertUTF.h"
@@ -51,6 +53,7 @@
 #include "zeek/Obj.h"
 #include "zeek/Reporter.h"
 #include "zeek/RunState.h"
+#include "zeek/StringKernels.h"
 #include "zeek/Val.h"
 #include "zeek/digest.h"
 #include "zeek/input.h"
@@ -969,6 +972,40 @@ void set_thread_name(const char* name, pthread_t tid)
 #endif
 	}
 
+void run_parallel(size_t n, unsigned int max_threads, const std::function<void(size_t)>& func)
+	{
+	if ( max_threads == 0 )
+		max_threads = std::max(1u, std::thread::hardware_concurrency());
+
+	size_t num_threads = std::min<size_t>(max_threads, n);
+
+	if ( num_threads <= 1 )
+		{
+		for ( size_t i = 0; i < n; ++i )
+			func(i);
+
+		return;
+		}
+
+	std::atomic<size_t> next = 0;
+
+	auto worker = [&]()
+	{
+		for ( size_t i = next++; i < n; i = next++ )
+			func(i);
+	};
+
+	std::vector<std::thread> threads;
+
+	for ( size_t i = 1; i < num_threads; ++i )
+		threads.emplace_back(worker);
+
+	worker();
+
+	for ( auto& t : threads )
+		t.join();
+	}
+
 	} // namespace detail
 
 TEST_CASE("util get_unescaped_string")
@@ -1492,13 +1529,7 @@ int strstr_n(const int big_len, const u_char* big, const int little_len, const u
 	if ( little_len > big_len )
 		return -1;
 
-	for ( int i = 0; i <= big_len - little_len; ++i )
-		{
-		if ( ! memcmp(big + i, little, little_len) )
-			return i;
-		}
-
-	return -1;
+	return zeek::detail::find_substring(big, big_len, little, little_len);
 	}
 
 int fputs(int len, const char* s, FILE* fp)
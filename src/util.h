@@ -22,6 +22,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <functional>
 #include <memory> // std::unique_ptr
 #include <string>
 #include <string_view>
@@ -286,6 +287,12 @@ double parse_rotate_base_time(const char* rotate_base_time);
 // This function is thread-safe.
 double calc_next_rotate(double current, double rotate_interval, double base);
 
+// Runs func(i) for all i < n, spread across up to max_threads threads, with
+// 0 meaning one per core.  Callers keep results by index, so that they don't
+// depend on the order in which the threads get to them.
+extern void run_parallel(size_t n, unsigned int max_threads,
+                         const std::function<void(size_t)>& func);
+
 	} // namespace detail
 
 template <class T> void delete_each(T* t)
@@ -36,6 +36,7 @@
 #include "zeek/Hash.h"
 #include "zeek/NetVar.h"
 #include "zeek/Options.h"
+#include "zeek/RE.h"
 #include "zeek/Reporter.h"
 #include "zeek/RuleMatcher.h"
 #include "zeek/RunState.h"
@@ -433,6 +434,7 @@ static void terminate_zeek()
 	delete session_mgr;
 	delete fragment_mgr;
 	delete telemetry_mgr;
+	telemetry_mgr = nullptr;
 
 	// free the global scope
 	pop_scope();
@@ -821,6 +823,9 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 
 		plugin_mgr->InitBifs();
 
+		detail::DFA_Machine::SetMemoryBudget(BifConst::dfa_memory_budget);
+		detail::re_matcher_cache().SetCapacity(BifConst::pattern_cache_size);
+
 		if ( reporter->Errors() > 0 )
 			exit(1);
 
@@ -924,6 +929,9 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 				exit(1);
 				}
 
+			if ( BifConst::signature_dfa_cache->Len() > 0 )
+				rule_matcher->LoadDFACache(BifConst::signature_dfa_cache->CheckString());
+
 			if ( options.print_signature_debug_info )
 				rule_matcher->PrintDebug();
 
@@ -1120,6 +1128,9 @@ int cleanup(bool did_run_loop)
 	// might write to connection content files.
 	File::CloseOpenFiles();
 
+	if ( rule_matcher && BifConst::signature_dfa_cache->Len() > 0 )
+		rule_matcher->SaveDFACache(BifConst::signature_dfa_cache->CheckString());
+
 	delete rule_matcher;
 
 	return 0;